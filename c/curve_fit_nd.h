@@ -32,6 +32,111 @@
  *  \ingroup curve_fit
  */
 
+#include <stddef.h>
+
+struct CurveFitContext;
+struct CurveFitStream;
+
+/* curve_fit_context.c */
+
+/**
+ * Create a context which can be passed to any of the functions in this API,
+ * memory used for calculations is kept between calls (only growing as needed),
+ * so fitting many curves doesn't need to allocate memory each time.
+ *
+ * Passing NULL instead of a context is supported, using temporary memory.
+ *
+ * \note A context must not be used by multiple threads at once.
+ */
+struct CurveFitContext *curve_fit_context_create(void);
+void curve_fit_context_free(struct CurveFitContext *ctx);
+
+/** Identifies the arrays passed to #CurveFitOutputAllocFn. */
+enum {
+	CURVE_FIT_OUTPUT_CUBIC_ARRAY        = 0,
+	CURVE_FIT_OUTPUT_CUBIC_ORIG_INDEX   = 1,
+	/** Corner indices (also used for #curve_fit_corners_detect_db). */
+	CURVE_FIT_OUTPUT_CORNER_INDEX       = 2,
+};
+
+/**
+ * \param output: One of the `CURVE_FIT_OUTPUT_*` values.
+ * \param size: The size of the array in bytes.
+ * \return Memory for the array, or NULL when it can't be stored.
+ */
+typedef void *(*CurveFitOutputAllocFn)(void *user_data, unsigned int output, size_t size);
+
+/**
+ * Use \a alloc_fn to allocate the arrays returned by functions which use this context (instead of `malloc`),
+ * so the caller can provide its own memory (reusing buffers for example).
+ * These arrays must not be freed by the caller.
+ *
+ * When \a alloc_fn returns NULL, the function returns nonzero and the array is set to NULL,
+ * the lengths are still set, so this can be used to query the size of the result.
+ *
+ * \param alloc_fn: The allocation function, NULL to use `malloc`.
+ * \param user_data: Passed to \a alloc_fn.
+ */
+void curve_fit_context_output_alloc_set(
+        struct CurveFitContext *ctx,
+        CurveFitOutputAllocFn alloc_fn, void *user_data);
+
+/**
+ * Counters to help find out why fitting some points is slow,
+ * see #curve_fit_context_stats_set.
+ */
+struct CurveFitStats {
+	/* curve_fit_cubic.c */
+
+	/** The number of times a cubic was fitted to points (including fitting a single cubic). */
+	size_t fit_count;
+	/**
+	 * The largest number of spans waiting to be fitted once the points are split
+	 * (the depth of splitting, per thread when using #CURVE_FIT_CALC_PARALLEL).
+	 */
+	size_t fit_stack_max;
+	/** The number of times points were re-parameterized. */
+	size_t reparameterize_count;
+	/** The number of times a fallback cubic was closer than the least squares fit. */
+	size_t fallback_circular_count;
+	size_t fallback_offset_count;
+	/** Calls to #curve_fit_cubic_to_points_single_db (including calls from the refit functions). */
+	size_t fit_single_count;
+
+	/* curve_fit_cubic_refit.c */
+
+	size_t heap_insert_count;
+	size_t heap_update_count;
+	size_t heap_remove_count;
+	size_t heap_pop_count;
+	/** Spans between knots found in the cache (instead of calling #curve_fit_cubic_to_points_single_db). */
+	size_t span_cache_hit_count;
+
+	/** Memory allocated for the context & output arrays (in bytes). */
+	size_t alloc_bytes;
+};
+
+/**
+ * Add to \a stats for each call using this context (the caller must initialize it to zero),
+ * so the statistics can be collected for a single call or many calls.
+ *
+ * \param stats: The statistics to add to, NULL to stop collecting them.
+ */
+void curve_fit_context_stats_set(
+        struct CurveFitContext *ctx,
+        struct CurveFitStats *stats);
+
+/**
+ * Set the fraction of the error threshold used to remove points with #CURVE_FIT_CALC_DECIMATE,
+ * the remaining error is used for fitting.
+ *
+ * \param error_factor: A value between zero and one (0.25 by default),
+ * larger values remove more points at the cost of fitting more cubics.
+ */
+void curve_fit_context_decimate_set(
+        struct CurveFitContext *ctx,
+        double error_factor);
+
 
 /* curve_fit_cubic.c */
 
@@ -52,6 +157,7 @@
  * The size of the *flat* array will be `r_cubic_array_len * 3 * dims`.
  * \param r_corner_index_array, r_corner_index_len: Corner indices in \a r_cubic_array (optional).
  * This allows you to access corners on the resulting curve.
+ * \param ctx: Memory to reuse between calls (optional), see #curve_fit_context_create.
  *
  * \returns zero on success, nonzero is reserved for error values.
  */
@@ -66,7 +172,8 @@ int curve_fit_cubic_to_points_db(
 
         double **r_cubic_array, unsigned int *r_cubic_array_len,
         unsigned int **r_cubic_orig_index,
-        unsigned int **r_corner_index_array, unsigned int *r_corner_index_len);
+        unsigned int **r_corner_index_array, unsigned int *r_corner_index_len,
+        struct CurveFitContext *ctx);
 
 int curve_fit_cubic_to_points_fl(
         const float        *points,
@@ -79,7 +186,54 @@ int curve_fit_cubic_to_points_fl(
 
         float **r_cubic_array, unsigned int *r_cubic_array_len,
         unsigned int **r_cubic_orig_index,
-        unsigned int **r_corners_index_array, unsigned int *r_corners_index_len);
+        unsigned int **r_corners_index_array, unsigned int *r_corners_index_len,
+        struct CurveFitContext *ctx);
+
+/**
+ * A version of #curve_fit_cubic_to_points_db which limits how much work is done,
+ * for interactive use where a coarser curve can be shown until there is time to refine it.
+ *
+ * Instead of splitting the curve in order, the part with the largest error is split first,
+ * so the error is reduced evenly along the curve when the budget runs out.
+ * The result is the same as #curve_fit_cubic_to_points_db when the budget is large enough.
+ *
+ * \param fit_points_budget: The number of points cubics may be fitted to
+ * (points are counted each time they're fitted), roughly proportional to the time taken.
+ * A cubic is always fitted between each pair of corners, even when this exceeds the budget.
+ * \param r_is_complete: Set to 1 when the curve is within \a error_threshold, otherwise 0
+ * (the budget ran out).
+ */
+int curve_fit_cubic_to_points_budget_db(
+        const double       *points,
+        const unsigned int  points_len,
+        const unsigned int  dims,
+        const double        error_threshold,
+        const unsigned int  calc_flag,
+        const unsigned int *corners,
+        unsigned int        corners_len,
+        const unsigned int  fit_points_budget,
+
+        double **r_cubic_array, unsigned int *r_cubic_array_len,
+        unsigned int **r_cubic_orig_index,
+        unsigned int **r_corner_index_array, unsigned int *r_corner_index_len,
+        int *r_is_complete,
+        struct CurveFitContext *ctx);
+
+int curve_fit_cubic_to_points_budget_fl(
+        const float        *points,
+        const unsigned int  points_len,
+        const unsigned int  dims,
+        const float         error_threshold,
+        const unsigned int  calc_flag,
+        const unsigned int *corners,
+        unsigned int        corners_len,
+        const unsigned int  fit_points_budget,
+
+        float **r_cubic_array, unsigned int *r_cubic_array_len,
+        unsigned int **r_cubic_orig_index,
+        unsigned int **r_corner_index_array, unsigned int *r_corner_index_len,
+        int *r_is_complete,
+        struct CurveFitContext *ctx);
 
 /**
  * Takes a flat array of points and evaluates that to calculate handle lengths.
@@ -88,6 +242,7 @@ int curve_fit_cubic_to_points_fl(
  * \param dims: The number of dimensions for each element in \a points.
  * \param points_length_cache: Optional pre-calculated lengths between points.
  * \param error_threshold: the error threshold to allow for,
+ * \param calc_flag: `CURVE_FIT_CALC_*` flags (only those which control how a cubic is calculated are used).
  * \param tan_l, tan_r: Normalized tangents the handles will be aligned to.
  * Note that tangents must both point along the direction of the \a points,
  * so \a tan_l points in the same direction of the resulting handle,
@@ -95,6 +250,7 @@ int curve_fit_cubic_to_points_fl(
  *
  * \param r_handle_l, r_handle_r: Resulting calculated handles.
  * \param r_error_sq: The maximum distance  (squared) this curve diverges from \a points.
+ * \param ctx: Memory to reuse between calls (optional), see #curve_fit_context_create.
  */
 int curve_fit_cubic_to_points_single_db(
         const double      *points,
@@ -102,13 +258,15 @@ int curve_fit_cubic_to_points_single_db(
         const double      *points_length_cache,
         const unsigned int dims,
         const double       error_threshold,
+        const unsigned int calc_flag,
         const double       tan_l[],
         const double       tan_r[],
 
         double  r_handle_l[],
         double  r_handle_r[],
         double *r_error_sq,
-        unsigned int *r_error_index);
+        unsigned int *r_error_index,
+        struct CurveFitContext *ctx);
 
 int curve_fit_cubic_to_points_single_fl(
         const float       *points,
@@ -116,17 +274,158 @@ int curve_fit_cubic_to_points_single_fl(
         const float       *points_length_cache,
         const unsigned int dims,
         const float        error_threshold,
+        const unsigned int calc_flag,
         const float        tan_l[],
         const float        tan_r[],
 
         float   r_handle_l[],
         float   r_handle_r[],
         float  *r_error_sq,
-        unsigned int *r_error_index);
+        unsigned int *r_error_index,
+        struct CurveFitContext *ctx);
+
+/**
+ * Fit a curve to points as they're added (freehand drawing for example),
+ * so the whole curve isn't re-fitted each time points are added.
+ *
+ * Cubics are committed once the points after them need to be split
+ * (or the points which haven't been committed exceed a fixed number),
+ * see #curve_fit_stream_stable_db, since these can no longer change,
+ * the result may differ from #curve_fit_cubic_to_points_db for the same points.
+ *
+ * \param dims, error_threshold, calc_flag: See #curve_fit_cubic_to_points_db
+ * (#CURVE_FIT_CALC_PARALLEL is ignored).
+ *
+ * \note A stream from #curve_fit_stream_begin_db must only be used with other `*_db` functions,
+ * (the same applies to `*_fl` functions).
+ */
+struct CurveFitStream *curve_fit_stream_begin_db(
+        const unsigned int  dims,
+        const double        error_threshold,
+        const unsigned int  calc_flag);
+
+/**
+ * Add points to the end of the curve.
+ */
+void curve_fit_stream_append_db(
+        struct CurveFitStream *stream,
+        const double       *points,
+        const unsigned int  points_len);
+
+/**
+ * Access the cubics which have been committed (which won't change as points are added).
+ *
+ * \param r_cubic_array, r_cubic_array_len: Formatted as #curve_fit_cubic_to_points_db,
+ * (zero length when no cubics have been committed), the last handle is set to something useful
+ * until the next cubic is committed. The array is owned by the stream
+ * and is only valid until points are added.
+ */
+void curve_fit_stream_stable_db(
+        struct CurveFitStream *stream,
+        const double **r_cubic_array, unsigned int *r_cubic_array_len);
+
+/**
+ * Fit the remaining points and free the stream.
+ *
+ * \param r_cubic_array, r_cubic_array_len, r_cubic_orig_index: The resulting curve,
+ * see #curve_fit_cubic_to_points_db (zero length when no points were added).
+ * Pass NULL for \a r_cubic_array to free the stream without calculating the result.
+ *
+ * \returns zero on success, nonzero is reserved for error values.
+ */
+int curve_fit_stream_finish_db(
+        struct CurveFitStream *stream,
+        double **r_cubic_array, unsigned int *r_cubic_array_len,
+        unsigned int **r_cubic_orig_index);
+
+struct CurveFitStream *curve_fit_stream_begin_fl(
+        const unsigned int  dims,
+        const float         error_threshold,
+        const unsigned int  calc_flag);
+
+void curve_fit_stream_append_fl(
+        struct CurveFitStream *stream,
+        const float        *points,
+        const unsigned int  points_len);
+
+void curve_fit_stream_stable_fl(
+        struct CurveFitStream *stream,
+        const float **r_cubic_array, unsigned int *r_cubic_array_len);
+
+int curve_fit_stream_finish_fl(
+        struct CurveFitStream *stream,
+        float **r_cubic_array, unsigned int *r_cubic_array_len,
+        unsigned int **r_cubic_orig_index);
 
 enum {
 	CURVE_FIT_CALC_HIGH_QUALIY          = (1 << 0),
 	CURVE_FIT_CALC_CYCLIC               = (1 << 1),
+	/**
+	 * Use multiple threads for large inputs (only when built with OpenMP, otherwise ignored).
+	 * For the re-fit functions, the error of every knot at the start of each pass is calculated in parallel.
+	 * The resulting curve is the same as the single threaded result,
+	 * although values may differ slightly from rounding.
+	 */
+	CURVE_FIT_CALC_PARALLEL             = (1 << 2),
+
+	/* Options to trade the number of cubics for speed (or the reverse). */
+
+	/**
+	 * Don't test a cubic with handle lengths calculated from the curvature
+	 * when the least squares fit isn't close enough.
+	 * Typically this gives many more cubics (not included in #CURVE_FIT_CALC_FAST).
+	 */
+	CURVE_FIT_CALC_NO_FALLBACK_CIRCULAR = (1 << 3),
+	/**
+	 * Don't test a cubic with handle lengths calculated from the offset of the points
+	 * when the least squares fit isn't close enough.
+	 */
+	CURVE_FIT_CALC_NO_FALLBACK_OFFSET   = (1 << 4),
+	/**
+	 * Don't re-parameterize the points to improve a fit which isn't close enough,
+	 * this is the most expensive step when points need to be split.
+	 */
+	CURVE_FIT_CALC_NO_REPARAMETERIZE    = (1 << 5),
+	/**
+	 * Re-parameterize more times before splitting (ignored with #CURVE_FIT_CALC_NO_REPARAMETERIZE),
+	 * only occasionally gives fewer cubics.
+	 */
+	CURVE_FIT_CALC_REPARAMETERIZE_EXTRA = (1 << 6),
+	/**
+	 * Remove points which are almost coincident or collinear before fitting,
+	 * using part of the error threshold (see #curve_fit_context_decimate_set).
+	 * This is worthwhile for dense input (tablets with a high sample rate for e.g.),
+	 * especially for the refit functions, which begin with a knot for every point.
+	 *
+	 * The original indices still refer to the points passed in.
+	 * Ignored by the stream API & when fitting a single cubic.
+	 */
+	CURVE_FIT_CALC_DECIMATE             = (1 << 7),
+	/**
+	 * Find where long spans need to be split by fitting cubics to a subset of their points first,
+	 * instead of fitting cubics to all points in the span only to find it needs to be split.
+	 * The error threshold is still checked for every point.
+	 *
+	 * Typically faster for long curves, at the cost of a few more cubics.
+	 * Ignored by the stream API & the budgeted functions.
+	 */
+	CURVE_FIT_CALC_MULTIRES             = (1 << 8),
+	/**
+	 * When re-fitting, remove knots in rounds instead of one at a time.
+	 * Each round removes knots under the error threshold which aren't next to each other
+	 * (lowest error first), then re-calculates the error of their neighbors.
+	 *
+	 * The error threshold is respected, with a result close to removing one knot at a time,
+	 * combined with #CURVE_FIT_CALC_PARALLEL each round is calculated using multiple threads.
+	 * Only used by the re-fit functions.
+	 */
+	CURVE_FIT_CALC_REFIT_ROUNDS         = (1 << 9),
+
+	/** Split the points instead of trying to improve a fit, giving a few more cubics. */
+	CURVE_FIT_CALC_FAST = (
+	        CURVE_FIT_CALC_NO_FALLBACK_OFFSET |
+	        CURVE_FIT_CALC_NO_REPARAMETERIZE |
+	        CURVE_FIT_CALC_MULTIRES),
 };
 
 
@@ -144,7 +443,8 @@ int curve_fit_cubic_to_points_refit_db(
 
         double **r_cubic_array, unsigned int *r_cubic_array_len,
         unsigned int   **r_cubic_orig_index,
-        unsigned int   **r_corner_index_array, unsigned int *r_corner_index_len);
+        unsigned int   **r_corner_index_array, unsigned int *r_corner_index_len,
+        struct CurveFitContext *ctx);
 
 int curve_fit_cubic_to_points_refit_fl(
         const float          *points,
@@ -158,7 +458,8 @@ int curve_fit_cubic_to_points_refit_fl(
 
         float **r_cubic_array, unsigned int *r_cubic_array_len,
         unsigned int   **r_cubic_orig_index,
-        unsigned int   **r_corner_index_array, unsigned int *r_corner_index_len);
+        unsigned int   **r_corner_index_array, unsigned int *r_corner_index_len,
+        struct CurveFitContext *ctx);
 
 /* curve_fit_corners_detect.c */
 
@@ -175,6 +476,7 @@ int curve_fit_cubic_to_points_refit_fl(
  * (higher value for fewer corners).
  *
  * \param r_corners, r_corners_len: Resulting array of corners.
+ * \param ctx: Memory to reuse between calls (optional), see #curve_fit_context_create.
  *
  * \returns zero on success, nonzero is reserved for error values.
  */
@@ -188,7 +490,8 @@ int curve_fit_corners_detect_db(
         const double       angle_threshold,
 
         unsigned int **r_corners,
-        unsigned int  *r_corners_len);
+        unsigned int  *r_corners_len,
+        struct CurveFitContext *ctx);
 
 int curve_fit_corners_detect_fl(
         const float       *points,
@@ -200,6 +503,7 @@ int curve_fit_corners_detect_fl(
         const float        angle_threshold,
 
         unsigned int **r_corners,
-        unsigned int  *r_corners_len);
+        unsigned int  *r_corners_len,
+        struct CurveFitContext *ctx);
 
 #endif  /* __CURVE_FIT_ND_H__ */
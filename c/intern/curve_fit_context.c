@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2016, Campbell Barton.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** \file curve_fit_context.c
+ *  \ingroup curve_fit
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../curve_fit_nd.h"
+
+#include "curve_fit_context.h"
+
+#include "generic_heap.h"
+
+/** \name Internal Context API
+ * \{ */
+
+struct CurveFitContext *curve_fit_context_init(struct CurveFitContext *ctx)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->decimate_factor = 0.25;
+	return ctx;
+}
+
+static void buffer_free(CurveFitBuffer *buf)
+{
+	free(buf->data);
+	buf->data = NULL;
+	buf->size = 0;
+}
+
+/**
+ * Free all memory owned by the context.
+ */
+void curve_fit_context_clear(struct CurveFitContext *ctx)
+{
+	buffer_free(&ctx->length_cache);
+	buffer_free(&ctx->u);
+	buffer_free(&ctx->fit_stack);
+	buffer_free(&ctx->multires_points);
+	buffer_free(&ctx->multires_length_cache);
+	buffer_free(&ctx->budget_spans);
+	buffer_free(&ctx->budget_span_cubics);
+	buffer_free(&ctx->budget_span_tangents);
+	if (ctx->budget_heap) {
+		assert(HEAP_is_empty(ctx->budget_heap));
+		HEAP_free(ctx->budget_heap, NULL);
+		ctx->budget_heap = NULL;
+	}
+
+	buffer_free(&ctx->refit_knots);
+	buffer_free(&ctx->refit_knots_fit);
+	buffer_free(&ctx->refit_tangents);
+	buffer_free(&ctx->refit_length_cache);
+	buffer_free(&ctx->refit_span_wrap);
+	buffer_free(&ctx->refit_seed);
+	buffer_free(&ctx->refit_rounds);
+	buffer_free(&ctx->refit_span_cache);
+	if (ctx->refit_cache) {
+		curve_fit_refit_cache_free(ctx->refit_cache);
+		ctx->refit_cache = NULL;
+	}
+
+	buffer_free(&ctx->points_angle);
+
+	buffer_free(&ctx->decimate_index);
+	buffer_free(&ctx->decimate_points);
+	buffer_free(&ctx->decimate_corners);
+
+	buffer_free(&ctx->points_db);
+	buffer_free(&ctx->length_cache_db);
+
+	buffer_free(&ctx->output_cubic_array);
+	buffer_free(&ctx->output_cubic_orig_index);
+}
+
+/**
+ * Return memory of at least \a size bytes,
+ * the contents aren't kept when the buffer needs to grow.
+ */
+void *curve_fit_buffer_ensure(struct CurveFitContext *ctx, CurveFitBuffer *buf, const size_t size)
+{
+	if (buf->size < size) {
+		free(buf->data);
+		buf->data = malloc(size);
+		if (ctx->stats) {
+			ctx->stats->alloc_bytes += size - buf->size;
+		}
+		buf->size = size;
+	}
+	return buf->data;
+}
+
+/**
+ * A version of #curve_fit_buffer_ensure which keeps the contents.
+ */
+void *curve_fit_buffer_resize(struct CurveFitContext *ctx, CurveFitBuffer *buf, const size_t size)
+{
+	if (buf->size < size) {
+		buf->data = realloc(buf->data, size);
+		if (ctx->stats) {
+			ctx->stats->alloc_bytes += size - buf->size;
+		}
+		buf->size = size;
+	}
+	return buf->data;
+}
+
+/**
+ * Allocate an array returned by the API (to be owned by the caller).
+ */
+void *curve_fit_output_alloc(struct CurveFitContext *ctx, const unsigned int output, const size_t size)
+{
+	if (ctx->stats) {
+		ctx->stats->alloc_bytes += size;
+	}
+	if (ctx->output_alloc_fn) {
+		return ctx->output_alloc_fn(ctx->output_alloc_user_data, output, size);
+	}
+	return malloc(size);
+}
+
+/**
+ * Initialize a context for a task which may run at the same time as other tasks,
+ * statistics are collected in \a stats_task, then added to \a ctx by #curve_fit_context_task_end.
+ */
+struct CurveFitContext *curve_fit_context_task_begin(
+        struct CurveFitContext *ctx_task, const struct CurveFitContext *ctx,
+        struct CurveFitStats *stats_task)
+{
+	curve_fit_context_init(ctx_task);
+	if (ctx->stats) {
+		memset(stats_task, 0, sizeof(*stats_task));
+		ctx_task->stats = stats_task;
+	}
+	return ctx_task;
+}
+
+void curve_fit_context_task_end(
+        struct CurveFitContext *ctx_task, struct CurveFitContext *ctx)
+{
+	const struct CurveFitStats *src = ctx_task->stats;
+	if (src) {
+#ifdef _OPENMP
+#pragma omp critical (curve_fit_stats)
+#endif
+		{
+			struct CurveFitStats *dst = ctx->stats;
+			dst->fit_count               += src->fit_count;
+			if (dst->fit_stack_max < src->fit_stack_max) {
+				dst->fit_stack_max = src->fit_stack_max;
+			}
+			dst->reparameterize_count    += src->reparameterize_count;
+			dst->fallback_circular_count += src->fallback_circular_count;
+			dst->fallback_offset_count   += src->fallback_offset_count;
+			dst->fit_single_count        += src->fit_single_count;
+			dst->heap_insert_count       += src->heap_insert_count;
+			dst->heap_update_count       += src->heap_update_count;
+			dst->heap_remove_count       += src->heap_remove_count;
+			dst->heap_pop_count          += src->heap_pop_count;
+			dst->span_cache_hit_count    += src->span_cache_hit_count;
+			dst->alloc_bytes             += src->alloc_bytes;
+		}
+	}
+	curve_fit_context_clear(ctx_task);
+}
+
+/** \} */
+
+
+/* -------------------------------------------------------------------- */
+
+/** \name External Context API
+ * \{ */
+
+struct CurveFitContext *curve_fit_context_create(void)
+{
+	return curve_fit_context_init(malloc(sizeof(struct CurveFitContext)));
+}
+
+void curve_fit_context_free(struct CurveFitContext *ctx)
+{
+	curve_fit_context_clear(ctx);
+	free(ctx);
+}
+
+void curve_fit_context_output_alloc_set(
+        struct CurveFitContext *ctx,
+        CurveFitOutputAllocFn alloc_fn, void *user_data)
+{
+	ctx->output_alloc_fn = alloc_fn;
+	ctx->output_alloc_user_data = user_data;
+}
+
+void curve_fit_context_stats_set(
+        struct CurveFitContext *ctx,
+        struct CurveFitStats *stats)
+{
+	ctx->stats = stats;
+}
+
+void curve_fit_context_decimate_set(
+        struct CurveFitContext *ctx,
+        double error_factor)
+{
+	assert(error_factor >= 0.0 && error_factor <= 1.0);
+	ctx->decimate_factor = error_factor;
+}
+
+/** \} */
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2016, Campbell Barton.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __CURVE_FIT_CONTEXT_H__
+#define __CURVE_FIT_CONTEXT_H__
+
+/** \file curve_fit_context.h
+ *  \ingroup curve_fit
+ *
+ * Memory which is kept between calls, see #curve_fit_context_create.
+ *
+ * Each entry point takes an optional context,
+ * when none is passed, a temporary context is used for the duration of the call.
+ *
+ * \note Functions which use multiple threads
+ * must use a separate context for each task.
+ */
+
+#include <stddef.h>
+
+#include "../curve_fit_nd.h"
+
+struct CurveFitRefitCache;
+struct Heap;
+
+/**
+ * Memory which is only freed with the context, only ever grows.
+ */
+typedef struct CurveFitBuffer {
+	void  *data;
+	size_t size;
+} CurveFitBuffer;
+
+struct CurveFitContext {
+	/* curve_fit_cubic.c */
+	/** Accumulated length at each point (always double precision). */
+	CurveFitBuffer length_cache;
+	/** Storage for `u` & `u_prime` when fitting a single cubic. */
+	CurveFitBuffer u;
+	/** End-point indices of spans which haven't been fitted yet (`uint` stack). */
+	CurveFitBuffer fit_stack;
+	/** The lower resolution points & their lengths, see #CURVE_FIT_CALC_MULTIRES. */
+	CurveFitBuffer multires_points;
+	CurveFitBuffer multires_length_cache;
+	/** Spans, their cubics & tangents, see #curve_fit_cubic_to_points_budget_db. */
+	CurveFitBuffer budget_spans;
+	CurveFitBuffer budget_span_cubics;
+	CurveFitBuffer budget_span_tangents;
+	/** Spans which need to be split (empty between calls). */
+	struct Heap *budget_heap;
+
+	/* curve_fit_cubic_refit.c */
+	CurveFitBuffer refit_knots;
+	/** Handles & error for each knot, kept apart from the links which are accessed more often. */
+	CurveFitBuffer refit_knots_fit;
+	CurveFitBuffer refit_tangents;
+	CurveFitBuffer refit_length_cache;
+	/** Points & lengths of a span which wraps around the start of a cyclic curve. */
+	CurveFitBuffer refit_span_wrap;
+	/** The state & heap value of each knot (see #CURVE_FIT_CALC_PARALLEL). */
+	CurveFitBuffer refit_seed;
+	/** Candidates & neighbors for each round, see #CURVE_FIT_CALC_REFIT_ROUNDS. */
+	CurveFitBuffer refit_rounds;
+	/** The error & handles of spans between knots which have already been fitted. */
+	CurveFitBuffer refit_span_cache;
+	/** Heap & pools (owned by the context). */
+	struct CurveFitRefitCache *refit_cache;
+
+	/* curve_fit_corners_detect.c */
+	CurveFitBuffer points_angle;
+
+	/* #CURVE_FIT_CALC_DECIMATE, see #curve_fit_points_decimate_db. */
+	CurveFitBuffer decimate_index;
+	CurveFitBuffer decimate_points;
+	CurveFitBuffer decimate_corners;
+	/** See #curve_fit_context_decimate_set. */
+	double decimate_factor;
+
+	/* Converting to double precision (`*_fl` functions). */
+	CurveFitBuffer points_db;
+	CurveFitBuffer length_cache_db;
+
+	/* Output arrays, see #curve_fit_context_output_alloc_set. */
+	CurveFitOutputAllocFn output_alloc_fn;
+	void *output_alloc_user_data;
+	/** The cubics are calculated here, then copied into the output. */
+	CurveFitBuffer output_cubic_array;
+	CurveFitBuffer output_cubic_orig_index;
+
+	/** See #curve_fit_context_stats_set (may be NULL). */
+	struct CurveFitStats *stats;
+};
+
+struct CurveFitContext *curve_fit_context_init(struct CurveFitContext *ctx);
+void  curve_fit_context_clear(struct CurveFitContext *ctx);
+void *curve_fit_buffer_ensure(struct CurveFitContext *ctx, CurveFitBuffer *buf, const size_t size);
+void *curve_fit_buffer_resize(struct CurveFitContext *ctx, CurveFitBuffer *buf, const size_t size);
+
+struct CurveFitContext *curve_fit_context_task_begin(
+        struct CurveFitContext *ctx_task, const struct CurveFitContext *ctx,
+        struct CurveFitStats *stats_task);
+void curve_fit_context_task_end(
+        struct CurveFitContext *ctx_task, struct CurveFitContext *ctx);
+
+void *curve_fit_output_alloc(struct CurveFitContext *ctx, const unsigned int output, const size_t size);
+
+/* curve_fit_cubic.c */
+const unsigned int *curve_fit_points_decimate_db(
+        struct CurveFitContext *ctx,
+        const double       *points,
+        const unsigned int  points_len,
+        const unsigned int  dims,
+        const double        error_threshold,
+        const unsigned int *corners,
+        const unsigned int  corners_len,
+        const double      **r_points, unsigned int *r_points_len,
+        const unsigned int **r_corners);
+const unsigned int *curve_fit_points_decimate_fl(
+        struct CurveFitContext *ctx,
+        const float        *points,
+        const unsigned int  points_len,
+        const unsigned int  dims,
+        const float         error_threshold,
+        const unsigned int *corners,
+        const unsigned int  corners_len,
+        const float       **r_points, unsigned int *r_points_len,
+        const unsigned int **r_corners);
+
+/* curve_fit_cubic_refit.c */
+void  curve_fit_refit_cache_free(struct CurveFitRefitCache *cache);
+
+#endif  /* __CURVE_FIT_CONTEXT_H__ */
@@ -40,8 +40,10 @@
 #include "../curve_fit_nd.h"
 
 typedef unsigned int uint;
+typedef double real;
 
 #include "curve_fit_inline.h"
+#include "curve_fit_context.h"
 
 #ifdef _MSC_VER
 #  define alloca(size) _alloca(size)
@@ -332,8 +334,14 @@ int curve_fit_corners_detect_db(
         const double angle_threshold,
 
         uint **r_corners,
-        uint  *r_corners_len)
+        uint  *r_corners_len,
+        struct CurveFitContext *ctx)
 {
+	struct CurveFitContext ctx_local;
+	if (ctx == NULL) {
+		ctx = curve_fit_context_init(&ctx_local);
+	}
+
 	const double angle_threshold_cos = cos(angle_threshold);
 	uint corners_len = 0;
 
@@ -342,7 +350,7 @@ int curve_fit_corners_detect_db(
 	const double radius_mid = (radius_min + radius_max) / 2.0;
 
 	/* we could ignore first/last- but simple to keep aligned with the point array */
-	double *points_angle = malloc(sizeof(double) * points_len);
+	double *points_angle = curve_fit_buffer_ensure(ctx, &ctx->points_angle, sizeof(double) * points_len);
 	points_angle[0] = 0.0;
 
 	*r_corners = NULL;
@@ -362,7 +370,9 @@ int curve_fit_corners_detect_db(
 	}
 
 	if (corners_len == 0) {
-		free(points_angle);
+		if (ctx == &ctx_local) {
+			curve_fit_context_clear(&ctx_local);
+		}
 		return 0;
 	}
 
@@ -416,23 +426,27 @@ int curve_fit_corners_detect_db(
 	/* End angle limit cleaning! */
 
 	corners_len += 2;  /* first and last */
-	uint *corners = malloc(sizeof(uint) * corners_len);
-	uint i_corner = 0;
-	corners[i_corner++] = 0;
-	for (uint i = 0; i < points_len; i++) {
-		if (points_angle[i] != 0.0) {
-			corners[i_corner++] = i;
+	uint *corners = curve_fit_output_alloc(ctx, CURVE_FIT_OUTPUT_CORNER_INDEX, sizeof(uint) * corners_len);
+	if (corners) {
+		uint i_corner = 0;
+		corners[i_corner++] = 0;
+		for (uint i = 0; i < points_len; i++) {
+			if (points_angle[i] != 0.0) {
+				corners[i_corner++] = i;
+			}
 		}
+		corners[i_corner++] = points_len - 1;
+		assert(i_corner == corners_len);
 	}
-	corners[i_corner++] = points_len - 1;
-	assert(i_corner == corners_len);
 
-	free(points_angle);
+	if (ctx == &ctx_local) {
+		curve_fit_context_clear(&ctx_local);
+	}
 
 	*r_corners = corners;
 	*r_corners_len = corners_len;
 
-	return 0;
+	return (corners != NULL) ? 0 : 1;
 }
 
 int curve_fit_corners_detect_fl(
@@ -445,10 +459,16 @@ int curve_fit_corners_detect_fl(
         const float angle_threshold,
 
         uint **r_corners,
-        uint  *r_corners_len)
+        uint  *r_corners_len,
+        struct CurveFitContext *ctx)
 {
+	struct CurveFitContext ctx_local;
+	if (ctx == NULL) {
+		ctx = curve_fit_context_init(&ctx_local);
+	}
+
 	const uint points_flat_len = points_len * dims;
-	double *points_db = malloc(sizeof(double) * points_flat_len);
+	double *points_db = curve_fit_buffer_ensure(ctx, &ctx->points_db, sizeof(double) * points_flat_len);
 
 	for (uint i = 0; i < points_flat_len; i++) {
 		points_db[i] = (double)points[i];
@@ -460,9 +480,12 @@ int curve_fit_corners_detect_fl(
 	        radius_min, radius_max,
 	        samples_max,
 	        angle_threshold,
-	        r_corners, r_corners_len);
+	        r_corners, r_corners_len,
+	        ctx);
 
-	free(points_db);
+	if (ctx == &ctx_local) {
+		curve_fit_context_clear(&ctx_local);
+	}
 
 	return result;
 }
@@ -27,6 +27,9 @@
 
 /** \file curve_fit_cubic.c
  *  \ingroup curve_fit
+ *
+ * \note This file is compiled a second time by `curve_fit_cubic_fl.c`
+ * (with `CURVE_FIT_FLOAT` defined) for the single precision `*_fl` functions.
  */
 
 #ifdef _MSC_VER
@@ -54,7 +57,18 @@
  */
 #define USE_OFFSET_FALLBACK
 
-/** Avoid re-calculating lengths multiple times. */
+/**
+ * The number of times to re-parameterize when the fit isn't close enough,
+ * see #CURVE_FIT_CALC_NO_REPARAMETERIZE & #CURVE_FIT_CALC_REPARAMETERIZE_EXTRA.
+ */
+#define REPARAMETERIZE_ITER_DEFAULT 4
+#define REPARAMETERIZE_ITER_EXTRA 16
+
+/**
+ * Avoid re-calculating lengths multiple times,
+ * the accumulated length is stored for each point in the span between corners,
+ * so the parameterization of any part of the span can be calculated from it.
+ */
 #define USE_LENGTH_CACHE
 
 /**
@@ -63,9 +77,72 @@
  */
 #define USE_ORIG_INDEX_DATA
 
+/**
+ * Find where long spans need to be split from a lower resolution, see #CURVE_FIT_CALC_MULTIRES
+ * (uses the original indices of the cubics fitted to the lower resolution).
+ */
+#ifdef USE_ORIG_INDEX_DATA
+#  define USE_MULTIRES
+#endif
+
+/**
+ * Generate versions of the inner loops for 2, 3 & 4 dimensions,
+ * where the dimensions are known at compile time, so loops over them can be unrolled.
+ * Other dimensions use the generic version.
+ */
+#define USE_DIMS_SPECIALIZE
+
+/**
+ * Evaluate the error for multiple points at once using SIMD instructions,
+ * (SSE2 or AVX when enabled by the compiler).
+ */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#  define USE_SIMD
+#endif
+
+/**
+ * Fit both sides of a split as tasks, see #CURVE_FIT_CALC_PARALLEL.
+ * Requires OpenMP 4.5 (for `taskloop`).
+ */
+#if defined(_OPENMP) && (_OPENMP >= 201511)
+#  define USE_PARALLEL
+#endif
+
 typedef unsigned int uint;
 
+#ifdef CURVE_FIT_FLOAT
+typedef float real;
+#  define REAL_EPSILON FLT_EPSILON
+/* Define the single precision versions of the public functions. */
+#  define curve_fit_cubic_to_points_db        curve_fit_cubic_to_points_fl
+#  define curve_fit_cubic_to_points_budget_db curve_fit_cubic_to_points_budget_fl
+#  define curve_fit_cubic_to_points_single_db curve_fit_cubic_to_points_single_fl
+#  define curve_fit_stream_begin_db           curve_fit_stream_begin_fl
+#  define curve_fit_stream_append_db          curve_fit_stream_append_fl
+#  define curve_fit_stream_stable_db          curve_fit_stream_stable_fl
+#  define curve_fit_stream_finish_db          curve_fit_stream_finish_fl
+#else
+typedef double real;
+#  define REAL_EPSILON DBL_EPSILON
+#endif
+
 #include "curve_fit_inline.h"
+#include "curve_fit_context.h"
+
+#ifdef CURVE_FIT_FLOAT
+/* Declared in `curve_fit_context.h` (for both precisions). */
+#  define curve_fit_points_decimate_db curve_fit_points_decimate_fl
+#endif
+
+#include "generic_heap.h"
+
+#ifdef USE_PARALLEL
+#  include <omp.h>
+#endif
+
+#ifdef USE_SIMD
+#  include <immintrin.h>
+#endif
 
 #ifdef _MSC_VER
 #  define alloca(size) _alloca(size)
@@ -98,6 +175,33 @@ typedef unsigned int uint;
 #  endif
 #endif
 
+#ifdef USE_PARALLEL
+/** Spans with fewer points than this are always fitted by the current thread. */
+#  define PARALLEL_SPLIT_POINTS_MIN 2048
+/** Number of points each task handles when splitting up a reduction over a large span. */
+#  define PARALLEL_REDUCE_CHUNK 8192
+#endif
+
+#ifdef USE_MULTIRES
+/** Spans with fewer points than this are fitted without using a lower resolution first. */
+#  define MULTIRES_POINTS_MIN 1024
+/** The lower resolution uses every Nth point. */
+#  define MULTIRES_STEP 8
+#endif
+
+#ifdef USE_DIMS_SPECIALIZE
+/* Inline into each switch case of the dimensions being specialized. */
+#  if defined(__GNUC__)
+#    define DIMS_INLINE static inline __attribute__((always_inline))
+#  elif defined(_MSC_VER)
+#    define DIMS_INLINE static __forceinline
+#  else
+#    define DIMS_INLINE static inline
+#  endif
+#else
+#  define DIMS_INLINE static
+#endif
+
 #define SWAP(type, a, b)  {    \
 	type sw_ap;                \
 	sw_ap = (a);               \
@@ -112,8 +216,6 @@ typedef unsigned int uint;
  * \{ */
 
 typedef struct Cubic {
-	/** Single linked lists. */
-	struct Cubic *next;
 #ifdef USE_ORIG_INDEX_DATA
 	uint orig_span;
 #endif
@@ -121,20 +223,20 @@ typedef struct Cubic {
 	 * 0: point_0, 1: handle_0, 2: handle_1, 3: point_1,
 	 * each one is offset by 'dims'.
 	 */
-	double pt_data[0];
+	real pt_data[0];
 } Cubic;
 
 #define CUBIC_PT(cubic, index, dims) \
 	(&(cubic)->pt_data[(index) * (dims)])
 
 #define CUBIC_VARS(c, dims, _p0, _p1, _p2, _p3) \
-	double \
+	real \
 	*_p0 = (c)->pt_data, \
 	*_p1 = _p0 + (dims), \
 	*_p2 = _p1 + (dims), \
 	*_p3 = _p2 + (dims); ((void)0)
 #define CUBIC_VARS_CONST(c, dims, _p0, _p1, _p2, _p3) \
-	const double \
+	const real \
 	*_p0 = (c)->pt_data, \
 	*_p1 = _p0 + (dims), \
 	*_p2 = _p1 + (dims), \
@@ -143,12 +245,7 @@ typedef struct Cubic {
 
 static size_t cubic_alloc_size(const uint dims)
 {
-	return sizeof(Cubic) + (sizeof(double) * 4 * dims);
-}
-
-static Cubic *cubic_alloc(const uint dims)
-{
-	return malloc(cubic_alloc_size(dims));
+	return sizeof(Cubic) + (sizeof(real) * 4 * dims);
 }
 
 static void cubic_copy(Cubic *cubic_dst, const Cubic *cubic_src, const uint dims)
@@ -158,7 +255,7 @@ static void cubic_copy(Cubic *cubic_dst, const Cubic *cubic_src, const uint dims
 
 static void cubic_init(
         Cubic *cubic,
-        const double p0[], const double p1[], const double p2[], const double p3[],
+        const real p0[], const real p1[], const real p2[], const real p3[],
         const uint dims)
 {
 	copy_vnvn(CUBIC_PT(cubic, 0, dims), p0, dims);
@@ -167,103 +264,240 @@ static void cubic_init(
 	copy_vnvn(CUBIC_PT(cubic, 3, dims), p3, dims);
 }
 
-static void cubic_free(Cubic *cubic)
-{
-	free(cubic);
-}
-
 /** \} */
 
 
 /* -------------------------------------------------------------------- */
 
 /** \name CubicList Type & Functions
+ *
+ * Cubics are written directly into the memory used for the resulting array,
+ * since the end-point of each cubic is the start-point of the next,
+ * each cubic only needs to store `[handle_0, handle_1, point_1]`.
+ *
+ * The array is laid out so it can be returned without copying:
+ *
+ * - `2 * dims`: The first handle (calculated at the end) & the first point.
+ * - `3 * dims * len`: Each cubic.
+ * - `dims`: The last handle (calculated at the end).
+ *
+ * When the caller allocates the output (see #curve_fit_context_output_alloc_set),
+ * the array is stored in the context and copied into the output instead.
  * \{ */
 
 typedef struct CubicList {
-	struct Cubic *items;
-	uint          len;
-	uint          dims;
+	real   *array;
+#ifdef USE_ORIG_INDEX_DATA
+	/** `len + 1` items, each cubic stores its span in the next element. */
+	uint   *orig_index;
+#endif
+	uint    len;
+	uint    len_alloc;
+	uint    dims;
+	/** When set, the arrays are owned by this context (the output is allocated by the caller). */
+	struct CurveFitContext *ctx_output;
+	/** Counts the arrays passed to the caller (may be NULL). */
+	struct CurveFitStats *stats;
 } CubicList;
 
-static void cubic_list_prepend(CubicList *clist, Cubic *cubic)
+#define CUBIC_LIST_ARRAY_LEN(len, dims) \
+	(((len) + 1) * 3 * (dims))
+
+static void cubic_list_resize(CubicList *clist)
 {
-	cubic->next = clist->items;
-	clist->items = cubic;
-	clist->len++;
+	const size_t array_size = sizeof(real) * CUBIC_LIST_ARRAY_LEN(clist->len_alloc, clist->dims);
+#ifdef USE_ORIG_INDEX_DATA
+	const size_t orig_index_size = sizeof(uint) * (clist->len_alloc + 1);
+#endif
+	if (clist->ctx_output) {
+		struct CurveFitContext *ctx = clist->ctx_output;
+		clist->array = curve_fit_buffer_resize(ctx, &ctx->output_cubic_array, array_size);
+#ifdef USE_ORIG_INDEX_DATA
+		clist->orig_index = curve_fit_buffer_resize(ctx, &ctx->output_cubic_orig_index, orig_index_size);
+#endif
+	}
+	else {
+		clist->array = realloc(clist->array, array_size);
+#ifdef USE_ORIG_INDEX_DATA
+		clist->orig_index = realloc(clist->orig_index, orig_index_size);
+#endif
+	}
 }
 
-static double *cubic_list_as_array(
-        const CubicList *clist
+/**
+ * \param ctx: When the context allocates the output, its memory is used (may be NULL).
+ */
+static void cubic_list_init(
+        CubicList *clist, const uint len_reserve, const uint dims,
+        struct CurveFitContext *ctx)
+{
+	clist->array = NULL;
 #ifdef USE_ORIG_INDEX_DATA
-        ,
-        const uint index_last,
-        uint *r_orig_index
+	clist->orig_index = NULL;
 #endif
-        )
+	clist->len_alloc = len_reserve ? len_reserve : 1;
+	clist->len = 0;
+	clist->dims = dims;
+	clist->ctx_output = (ctx && ctx->output_alloc_fn) ? ctx : NULL;
+	clist->stats = ctx ? ctx->stats : NULL;
+	cubic_list_resize(clist);
+}
+
+static void cubic_list_reserve(CubicList *clist, const uint len_reserve)
+{
+	if (len_reserve > clist->len_alloc) {
+		clist->len_alloc = len_reserve > (clist->len_alloc * 2) ? len_reserve : (clist->len_alloc * 2);
+		cubic_list_resize(clist);
+	}
+}
+
+static void cubic_list_append(CubicList *clist, const Cubic *cubic)
 {
 	const uint dims = clist->dims;
-	const uint array_flat_len = (clist->len + 1) * 3 * dims;
+	cubic_list_reserve(clist, clist->len + 1);
 
-	double *array = malloc(sizeof(double) * array_flat_len);
-	const double *handle_prev = &((Cubic *)clist->items)->pt_data[dims];
+	if (clist->len == 0) {
+		memcpy(&clist->array[dims], CUBIC_PT(cubic, 0, dims), sizeof(real) * dims);
+	}
+	memcpy(&clist->array[(2 + (clist->len * 3)) * dims], CUBIC_PT(cubic, 1, dims), sizeof(real) * 3 * dims);
 
 #ifdef USE_ORIG_INDEX_DATA
-	uint orig_index_value = index_last;
-	uint orig_index_index = clist->len;
-	bool use_orig_index = (r_orig_index != NULL);
+	clist->orig_index[clist->len + 1] = cubic->orig_span;
 #endif
+	clist->len++;
+}
 
-	/* Fill the array backwards. */
-	const size_t array_chunk = 3 * dims;
-	double *array_iter = array + array_flat_len;
-	for (Cubic *citer = clist->items; citer; citer = citer->next) {
-		array_iter -= array_chunk;
-		memcpy(array_iter, &citer->pt_data[2 * dims], sizeof(double) * 2 * dims);
-		memcpy(&array_iter[2 * dims], &handle_prev[dims], sizeof(double) * dims);
-		handle_prev = citer->pt_data;
-
+static void cubic_list_free(CubicList *clist)
+{
+	assert(clist->ctx_output == NULL);
+	free(clist->array);
 #ifdef USE_ORIG_INDEX_DATA
-		if (use_orig_index) {
-			r_orig_index[orig_index_index--] = orig_index_value;
-			orig_index_value -= citer->orig_span;
-		}
+	free(clist->orig_index);
 #endif
-	}
+}
 
-#ifdef USE_ORIG_INDEX_DATA
-	if (use_orig_index) {
-		assert(orig_index_index == 0);
-		assert(orig_index_value == 0 || index_last == 0);
-		r_orig_index[orig_index_index] = index_last ? orig_index_value : 0;
+/**
+ * Remove all items, keeping the memory for reuse.
+ */
+static void cubic_list_clear(CubicList *clist)
+{
+	clist->len = 0;
+}
+
+/**
+ * Append the first \a src_len items in \a clist_src to \a clist (keeping their order).
+ */
+static void cubic_list_append_list(CubicList *clist, const CubicList *clist_src, const uint src_len)
+{
+	const uint dims = clist->dims;
+	assert(src_len <= clist_src->len);
+	if (src_len == 0) {
+		return;
+	}
+	cubic_list_reserve(clist, clist->len + src_len);
 
+	if (clist->len == 0) {
+		memcpy(&clist->array[dims], &clist_src->array[dims], sizeof(real) * dims);
 	}
+	memcpy(&clist->array[(2 + (clist->len * 3)) * dims],
+	       &clist_src->array[2 * dims],
+	       sizeof(real) * 3 * dims * src_len);
+
+#ifdef USE_ORIG_INDEX_DATA
+	memcpy(&clist->orig_index[clist->len + 1],
+	       &clist_src->orig_index[1],
+	       sizeof(uint) * src_len);
 #endif
+	clist->len += src_len;
+}
+
+/**
+ * Set the first & last handles which aren't part of any cubic.
+ */
+static void cubic_list_calc_end_handles(CubicList *clist)
+{
+	const uint dims = clist->dims;
+	const uint array_flat_len = CUBIC_LIST_ARRAY_LEN(clist->len, dims);
+	real *array = clist->array;
 
 	/* Flip tangent for first and last (we could leave at zero, but set to something useful). */
 
 	/* First. */
-	array_iter -= array_chunk;
-	memcpy(&array_iter[dims], handle_prev, sizeof(double) * 2 * dims);
-	flip_vn_vnvn(&array_iter[0 * dims], &array_iter[1 * dims], &array_iter[2 * dims], dims);
-	assert(array == array_iter);
+	flip_vn_vnvn(&array[0 * dims], &array[1 * dims], &array[2 * dims], dims);
 
 	/* Last. */
-	array_iter += array_flat_len - (3 * dims);
-	flip_vn_vnvn(&array_iter[2 * dims], &array_iter[1 * dims], &array_iter[0 * dims], dims);
-
-	return array;
+	real *array_last = &array[array_flat_len - (3 * dims)];
+	flip_vn_vnvn(&array_last[2 * dims], &array_last[1 * dims], &array_last[0 * dims], dims);
 }
 
-static void cubic_list_clear(CubicList *clist)
+/**
+ * Finish the array, ownership is passed to the caller, \a clist is cleared.
+ *
+ * \param index_first: The index of the first point, used to calculate \a r_orig_index.
+ * \return The array or NULL when the caller's allocation failed (\a r_orig_index may also be NULL).
+ */
+static real *cubic_list_as_array(
+        CubicList *clist
+#ifdef USE_ORIG_INDEX_DATA
+        ,
+        const uint index_first,
+        uint **r_orig_index
+#endif
+        )
 {
-	Cubic *cubic_next;
-	for (Cubic *citer = clist->items; citer; citer = cubic_next) {
-		cubic_next = citer->next;
-		cubic_free(citer);
+	const uint dims = clist->dims;
+	const uint array_flat_len = CUBIC_LIST_ARRAY_LEN(clist->len, dims);
+	real *array = clist->array;
+
+	cubic_list_calc_end_handles(clist);
+
+	if (clist->ctx_output) {
+		array = curve_fit_output_alloc(clist->ctx_output, CURVE_FIT_OUTPUT_CUBIC_ARRAY, sizeof(real) * array_flat_len);
+		if (array) {
+			memcpy(array, clist->array, sizeof(real) * array_flat_len);
+		}
+	}
+	else if (clist->len_alloc != clist->len) {
+		array = realloc(array, sizeof(real) * array_flat_len);
+	}
+
+#ifdef USE_ORIG_INDEX_DATA
+	if (r_orig_index) {
+		/* Convert spans into indices. */
+		uint *orig_index = clist->orig_index;
+		orig_index[0] = index_first;
+		for (uint i = 0; i < clist->len; i++) {
+			orig_index[i + 1] += orig_index[i];
+		}
+		if (clist->ctx_output) {
+			const size_t orig_index_size = sizeof(uint) * (clist->len + 1);
+			orig_index = curve_fit_output_alloc(clist->ctx_output, CURVE_FIT_OUTPUT_CUBIC_ORIG_INDEX, orig_index_size);
+			if (orig_index) {
+				memcpy(orig_index, clist->orig_index, orig_index_size);
+			}
+		}
+		*r_orig_index = orig_index;
+	}
+	else if (clist->ctx_output == NULL) {
+		free(clist->orig_index);
+	}
+	clist->orig_index = NULL;
+#endif
+
+	/* Otherwise these are counted by #curve_fit_output_alloc. */
+	if (clist->stats && (clist->ctx_output == NULL)) {
+		clist->stats->alloc_bytes += sizeof(real) * array_flat_len;
+#ifdef USE_ORIG_INDEX_DATA
+		if (r_orig_index) {
+			clist->stats->alloc_bytes += sizeof(uint) * (clist->len + 1);
+		}
+#endif
 	}
-	clist->items = NULL;
-	clist->len  = 0;
+
+	clist->array = NULL;
+	clist->len = clist->len_alloc = 0;
+
+	return array;
 }
 
 /** \} */
@@ -272,76 +506,369 @@ static void cubic_list_clear(CubicList *clist)
 /* -------------------------------------------------------------------- */
 
 /** \name Cubic Evaluation
+ *
+ * \note Integer constants are used so single precision values aren't promoted to double.
  * \{ */
 
-static void cubic_calc_point(
-        const Cubic *cubic, const double t, const uint dims,
-        double r_v[])
+DIMS_INLINE void cubic_calc_point(
+        const Cubic *cubic, const real t, const uint dims,
+        real r_v[])
 {
 	CUBIC_VARS_CONST(cubic, dims, p0, p1, p2, p3);
-	const double s = 1.0 - t;
+	const real s = 1 - t;
 
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
-		const double p01 = (p0[j] * s) + (p1[j] * t);
-		const double p12 = (p1[j] * s) + (p2[j] * t);
-		const double p23 = (p2[j] * s) + (p3[j] * t);
+		const real p01 = (p0[j] * s) + (p1[j] * t);
+		const real p12 = (p1[j] * s) + (p2[j] * t);
+		const real p23 = (p2[j] * s) + (p3[j] * t);
 		r_v[j] = ((((p01 * s) + (p12 * t))) * s) +
 		         ((((p12 * s) + (p23 * t))) * t);
 	}
 }
 
-static void cubic_calc_speed(
-        const Cubic *cubic, const double t, const uint dims,
-        double r_v[])
+#ifdef USE_SIMD
+
+/** \name SIMD Error Evaluation & Root Finding
+ *
+ * Evaluate the cubic at one `u` value per lane, so each lane handles a different point.
+ * The calculations match #cubic_calc_point, #len_squared_vnvn & #cubic_find_root exactly,
+ * so the results are the same as the scalar code.
+ * \{ */
+
+#if defined(CURVE_FIT_FLOAT) && defined(__AVX__)
+#  define SIMD_LANES 8
+typedef __m256 simd_vec;
+#  define simd_set1(a)         _mm256_set1_ps(a)
+#  define simd_loadu(p)        _mm256_loadu_ps(p)
+#  define simd_add(a, b)       _mm256_add_ps(a, b)
+#  define simd_sub(a, b)       _mm256_sub_ps(a, b)
+#  define simd_mul(a, b)       _mm256_mul_ps(a, b)
+#  define simd_div(a, b)       _mm256_div_ps(a, b)
+#  define simd_cmpge(a, b)     _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+#  define simd_cmpeq(a, b)     _mm256_cmp_ps(a, b, _CMP_EQ_OQ)
+#  define simd_select(m, a, b) _mm256_blendv_ps(b, a, m)
+#  define simd_movemask(m)     _mm256_movemask_ps(m)
+#  define simd_storeu(p, a)    _mm256_storeu_ps(p, a)
+#elif defined(CURVE_FIT_FLOAT)
+#  define SIMD_LANES 4
+typedef __m128 simd_vec;
+#  define simd_set1(a)         _mm_set1_ps(a)
+#  define simd_loadu(p)        _mm_loadu_ps(p)
+#  define simd_add(a, b)       _mm_add_ps(a, b)
+#  define simd_sub(a, b)       _mm_sub_ps(a, b)
+#  define simd_mul(a, b)       _mm_mul_ps(a, b)
+#  define simd_div(a, b)       _mm_div_ps(a, b)
+#  define simd_cmpge(a, b)     _mm_cmpge_ps(a, b)
+#  define simd_cmpeq(a, b)     _mm_cmpeq_ps(a, b)
+#  define simd_select(m, a, b) _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b))
+#  define simd_movemask(m)     _mm_movemask_ps(m)
+#  define simd_storeu(p, a)    _mm_storeu_ps(p, a)
+#elif defined(__AVX__)
+#  define SIMD_LANES 4
+typedef __m256d simd_vec;
+#  define simd_set1(a)         _mm256_set1_pd(a)
+#  define simd_loadu(p)        _mm256_loadu_pd(p)
+#  define simd_add(a, b)       _mm256_add_pd(a, b)
+#  define simd_sub(a, b)       _mm256_sub_pd(a, b)
+#  define simd_mul(a, b)       _mm256_mul_pd(a, b)
+#  define simd_div(a, b)       _mm256_div_pd(a, b)
+#  define simd_cmpge(a, b)     _mm256_cmp_pd(a, b, _CMP_GE_OQ)
+#  define simd_cmpeq(a, b)     _mm256_cmp_pd(a, b, _CMP_EQ_OQ)
+#  define simd_select(m, a, b) _mm256_blendv_pd(b, a, m)
+#  define simd_movemask(m)     _mm256_movemask_pd(m)
+#  define simd_storeu(p, a)    _mm256_storeu_pd(p, a)
+#else  /* SSE2 */
+#  define SIMD_LANES 2
+typedef __m128d simd_vec;
+#  define simd_set1(a)         _mm_set1_pd(a)
+#  define simd_loadu(p)        _mm_loadu_pd(p)
+#  define simd_add(a, b)       _mm_add_pd(a, b)
+#  define simd_sub(a, b)       _mm_sub_pd(a, b)
+#  define simd_mul(a, b)       _mm_mul_pd(a, b)
+#  define simd_div(a, b)       _mm_div_pd(a, b)
+#  define simd_cmpge(a, b)     _mm_cmpge_pd(a, b)
+#  define simd_cmpeq(a, b)     _mm_cmpeq_pd(a, b)
+#  define simd_select(m, a, b) _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b))
+#  define simd_movemask(m)     _mm_movemask_pd(m)
+#  define simd_storeu(p, a)    _mm_storeu_pd(p, a)
+#endif
+
+/** Two vectors are evaluated for each iteration. */
+#define SIMD_STEP (SIMD_LANES * 2)
+
+/** The result of #simd_movemask when all lanes are set. */
+#define SIMD_MASK_ALL ((1 << SIMD_LANES) - 1)
+
+#ifdef CURVE_FIT_FLOAT
+/** The largest range of points where each index can be stored exactly in a lane. */
+#  define SIMD_INDEX_RANGE_MAX (1u << FLT_MANT_DIG)
+#endif
+
+/**
+ * Load one coordinate (\a j) from #SIMD_LANES points.
+ */
+DIMS_INLINE simd_vec simd_load_axis(const real *pt, const uint j, const uint dims)
+{
+	real v[SIMD_LANES];
+	for (uint k = 0; k < SIMD_LANES; k++) {
+		v[k] = pt[(k * dims) + j];
+	}
+	return simd_loadu(v);
+}
+
+/**
+ * One coordinate (\a j) of #cubic_calc_point for each lane.
+ */
+DIMS_INLINE simd_vec simd_cubic_calc_point_axis(
+        const Cubic *cubic, const simd_vec s, const simd_vec t, const uint j, const uint dims)
 {
 	CUBIC_VARS_CONST(cubic, dims, p0, p1, p2, p3);
-	const double s = 1.0 - t;
+	const simd_vec p0_j = simd_set1(p0[j]);
+	const simd_vec p1_j = simd_set1(p1[j]);
+	const simd_vec p2_j = simd_set1(p2[j]);
+	const simd_vec p3_j = simd_set1(p3[j]);
+	const simd_vec p01 = simd_add(simd_mul(p0_j, s), simd_mul(p1_j, t));
+	const simd_vec p12 = simd_add(simd_mul(p1_j, s), simd_mul(p2_j, t));
+	const simd_vec p23 = simd_add(simd_mul(p2_j, s), simd_mul(p3_j, t));
+	return simd_add(
+	        simd_mul(simd_add(simd_mul(p01, s), simd_mul(p12, t)), s),
+	        simd_mul(simd_add(simd_mul(p12, s), simd_mul(p23, t)), t));
+}
+
+/**
+ * Squared distance between #SIMD_LANES points and the cubic evaluated at their \a u values.
+ */
+DIMS_INLINE simd_vec simd_cubic_calc_error_sq(
+        const Cubic *cubic, const real *pt_real, const real *u, const uint dims)
+{
+	const simd_vec t = simd_loadu(u);
+	const simd_vec s = simd_sub(simd_set1(1.0), t);
+	simd_vec err_sq = simd_set1(0.0);
+
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
-		r_v[j] =  3.0 * ((p1[j] - p0[j]) * s * s + 2.0 *
-		                 (p2[j] - p0[j]) * s * t +
-		                 (p3[j] - p2[j]) * t * t);
+		const simd_vec pt_eval = simd_cubic_calc_point_axis(cubic, s, t, j, dims);
+		const simd_vec d = simd_sub(simd_load_axis(pt_real, j, dims), pt_eval);
+		err_sq = simd_add(err_sq, simd_mul(d, d));
+	}
+	return err_sq;
+}
+
+/**
+ * Calculate the maximum error for as many points in `[i_start, i_end)` as fit into whole SIMD steps.
+ *
+ * When values are equal, the last index is used, matching the scalar code.
+ *
+ * \return The index of the first point that hasn't been evaluated.
+ */
+DIMS_INLINE uint simd_cubic_calc_error_range(
+        const Cubic *cubic,
+        const real *points_offset,
+        const uint i_start,
+        const uint i_end,
+        const real *u,
+        const uint dims,
+
+        real *r_error_max_sq, uint *r_error_index)
+{
+	if (i_end - i_start < SIMD_STEP) {
+		return i_start;
+	}
+#ifdef SIMD_INDEX_RANGE_MAX
+	if (i_end - i_start > SIMD_INDEX_RANGE_MAX) {
+		return i_start;
+	}
+#endif
+
+	/* Relative to `i_start`. */
+	real lane_index_init[SIMD_LANES];
+	for (uint k = 0; k < SIMD_LANES; k++) {
+		lane_index_init[k] = (real)k;
+	}
+
+	/* Negative so lanes which are never set (NAN errors) are ignored, as with the scalar code. */
+	simd_vec error_max_sq = simd_set1(-1.0);
+	simd_vec error_index = simd_set1(0.0);
+	simd_vec lane_index = simd_loadu(lane_index_init);
+	const simd_vec lane_step = simd_set1((real)SIMD_LANES);
+
+	uint i = i_start;
+	for (; i + SIMD_STEP <= i_end; i += SIMD_STEP) {
+		const real *pt_real = &points_offset[i * dims];
+		for (uint v = 0; v < 2; v++) {
+			const simd_vec err_sq = simd_cubic_calc_error_sq(
+			        cubic, &pt_real[v * SIMD_LANES * dims], &u[i + (v * SIMD_LANES)], dims);
+			const simd_vec mask = simd_cmpge(err_sq, error_max_sq);
+			error_max_sq = simd_select(mask, err_sq, error_max_sq);
+			error_index = simd_select(mask, lane_index, error_index);
+			lane_index = simd_add(lane_index, lane_step);
+		}
+	}
+
+	real lane_error_max_sq[SIMD_LANES], lane_error_index[SIMD_LANES];
+	simd_storeu(lane_error_max_sq, error_max_sq);
+	simd_storeu(lane_error_index, error_index);
+	for (uint k = 0; k < SIMD_LANES; k++) {
+		const uint index = i_start + (uint)lane_error_index[k];
+		if ((lane_error_max_sq[k] > *r_error_max_sq) ||
+		    ((lane_error_max_sq[k] == *r_error_max_sq) && (index > *r_error_index)))
+		{
+			*r_error_max_sq = lane_error_max_sq[k];
+			*r_error_index = index;
+		}
+	}
+	return i;
+}
+
+#ifdef USE_OFFSET_FALLBACK
+/**
+ * A version of #simd_cubic_calc_error_range for #cubic_calc_error_simple.
+ *
+ * \return The index of the first point that hasn't been evaluated,
+ * or \a i_end when the error exceeds \a error_threshold_sq.
+ */
+DIMS_INLINE uint simd_cubic_calc_error_simple(
+        const Cubic *cubic,
+        const real *points_offset,
+        const uint i_start,
+        const uint i_end,
+        const real *u,
+        const real error_threshold_sq,
+        const uint dims,
+
+        real *r_error_max_sq, bool *r_is_over_threshold)
+{
+	simd_vec error_max_sq = simd_set1(*r_error_max_sq);
+	const simd_vec threshold_sq = simd_set1(error_threshold_sq);
+
+	uint i = i_start;
+	for (; i + SIMD_STEP <= i_end; i += SIMD_STEP) {
+		const real *pt_real = &points_offset[i * dims];
+		const simd_vec err_sq_a = simd_cubic_calc_error_sq(
+		        cubic, pt_real, &u[i], dims);
+		const simd_vec err_sq_b = simd_cubic_calc_error_sq(
+		        cubic, &pt_real[SIMD_LANES * dims], &u[i + SIMD_LANES], dims);
+		if (simd_movemask(simd_cmpge(err_sq_a, threshold_sq)) |
+		    simd_movemask(simd_cmpge(err_sq_b, threshold_sq)))
+		{
+			*r_is_over_threshold = true;
+			return i_end;
+		}
+		/* NAN errors don't exceed the threshold, use an ordered compare so they're ignored
+		 * as with the scalar code (a maximum instruction may return NAN). */
+		error_max_sq = simd_select(simd_cmpge(err_sq_a, error_max_sq), err_sq_a, error_max_sq);
+		error_max_sq = simd_select(simd_cmpge(err_sq_b, error_max_sq), err_sq_b, error_max_sq);
+	}
+
+	real lane_error_max_sq[SIMD_LANES];
+	simd_storeu(lane_error_max_sq, error_max_sq);
+	for (uint k = 0; k < SIMD_LANES; k++) {
+		*r_error_max_sq = max(*r_error_max_sq, lane_error_max_sq[k]);
 	}
+	*r_is_over_threshold = false;
+	return i;
 }
+#endif  /* USE_OFFSET_FALLBACK */
 
-static void cubic_calc_acceleration(
-        const Cubic *cubic, const double t, const uint dims,
-        double r_v[])
+/**
+ * #cubic_find_root for #SIMD_LANES points.
+ */
+DIMS_INLINE simd_vec simd_cubic_find_root(
+        const Cubic *cubic, const real *pt_real, const real *u, const uint dims)
 {
 	CUBIC_VARS_CONST(cubic, dims, p0, p1, p2, p3);
-	const double s = 1.0 - t;
+	const simd_vec t = simd_loadu(u);
+	const simd_vec s = simd_sub(simd_set1(1.0), t);
+	simd_vec q0_dot_q1 = simd_set1(0.0);
+	simd_vec q1_len_sq = simd_set1(0.0);
+	simd_vec q0_dot_q2 = simd_set1(0.0);
+
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
-		r_v[j] = 6.0 * ((p2[j] - 2.0 * p1[j] + p0[j]) * s +
-		                (p3[j] - 2.0 * p2[j] + p1[j]) * t);
+		const simd_vec q0 = simd_sub(
+		        simd_cubic_calc_point_axis(cubic, s, t, j, dims),
+		        simd_load_axis(pt_real, j, dims));
+		const simd_vec q1 = simd_mul(simd_set1(3), simd_add(simd_add(
+		        simd_mul(simd_mul(simd_set1(p1[j] - p0[j]), s), s),
+		        simd_mul(simd_mul(simd_set1(2 * (p2[j] - p0[j])), s), t)),
+		        simd_mul(simd_mul(simd_set1(p3[j] - p2[j]), t), t)));
+		const simd_vec q2 = simd_mul(simd_set1(6), simd_add(
+		        simd_mul(simd_set1(p2[j] - 2 * p1[j] + p0[j]), s),
+		        simd_mul(simd_set1(p3[j] - 2 * p2[j] + p1[j]), t)));
+		q0_dot_q1 = simd_add(q0_dot_q1, simd_mul(q0, q1));
+		q1_len_sq = simd_add(q1_len_sq, simd_mul(q1, q1));
+		q0_dot_q2 = simd_add(q0_dot_q2, simd_mul(q0, q2));
 	}
+	return simd_sub(t, simd_div(q0_dot_q1, simd_add(q1_len_sq, q0_dot_q2)));
 }
 
 /**
- * Returns a 'measure' of the maximum distance (squared) of the points specified
- * by points_offset from the corresponding cubic(u[]) points.
+ * Calculate #cubic_find_root for as many points in `[i_start, i_end)` as fit into whole SIMD vectors.
+ *
+ * \return The index of the first point that hasn't been calculated,
+ * or \a i_end when any of the values aren't finite.
  */
-static double cubic_calc_error(
+DIMS_INLINE uint simd_cubic_find_roots(
         const Cubic *cubic,
-        const double *points_offset,
-        const uint points_offset_len,
-        const double *u,
+        const real *points_offset,
+        const uint i_start,
+        const uint i_end,
+        const real *u,
+        const uint dims,
+
+        real *r_u_prime, bool *r_is_finite)
+{
+	const simd_vec zero = simd_set1(0.0);
+	uint i = i_start;
+	for (; i + SIMD_LANES <= i_end; i += SIMD_LANES) {
+		const simd_vec u_prime = simd_cubic_find_root(cubic, &points_offset[i * dims], &u[i], dims);
+		/* Subtracting infinite & NAN values from themselves gives NAN. */
+		if (simd_movemask(simd_cmpeq(simd_sub(u_prime, u_prime), zero)) != SIMD_MASK_ALL) {
+			*r_is_finite = false;
+			return i_end;
+		}
+		simd_storeu(&r_u_prime[i], u_prime);
+	}
+	*r_is_finite = true;
+	return i;
+}
+
+/** \} */
+
+#endif  /* USE_SIMD */
+
+DIMS_INLINE real cubic_calc_error_range_impl(
+        const Cubic *cubic,
+        const real *points_offset,
+        const uint i_start,
+        const uint i_end,
+        const real *u,
         const uint dims,
 
         uint *r_error_index)
 {
-	double error_max_sq = 0.0;
+	real   error_max_sq = 0.0;
 	uint   error_index = 0;
+	uint   i = i_start;
 
-	const double *pt_real = points_offset + dims;
+#ifdef USE_SIMD
+	i = simd_cubic_calc_error_range(
+	        cubic, points_offset, i, i_end, u, dims,
+	        &error_max_sq, &error_index);
+#endif
+
+	const real *pt_real = points_offset + (i * dims);
 #ifdef USE_VLA
-	double        pt_eval[dims];
+	real        pt_eval[dims];
 #else
-	double       *pt_eval = alloca(sizeof(double) * dims);
+	real       *pt_eval = alloca(sizeof(real) * dims);
 #endif
 
-	for (uint i = 1; i < points_offset_len - 1; i++, pt_real += dims) {
+	for (; i < i_end; i++, pt_real += dims) {
 		cubic_calc_point(cubic, u[i], dims, pt_eval);
 
-		const double err_sq = len_squared_vnvn(pt_real, pt_eval, dims);
+		const real err_sq = len_squared_vnvn(pt_real, pt_eval, dims);
 		if (err_sq >= error_max_sq) {
 			error_max_sq = err_sq;
 			error_index = i;
@@ -352,93 +879,254 @@ static double cubic_calc_error(
 	return error_max_sq;
 }
 
-#ifdef USE_OFFSET_FALLBACK
 /**
- * A version #cubic_calc_error where we don't need the split-index and can exit early when over the limit.
+ * Calculate the maximum error for the points in `[i_start, i_end)`,
+ * see #cubic_calc_error.
  */
-static double cubic_calc_error_simple(
+static real cubic_calc_error_range(
         const Cubic *cubic,
-        const double *points_offset,
-        const uint points_offset_len,
-        const double *u,
-        const double error_threshold_sq,
-        const uint dims)
+        const real *points_offset,
+        const uint i_start,
+        const uint i_end,
+        const real *u,
+        const uint dims,
 
+        uint *r_error_index)
 {
-	double error_max_sq = 0.0;
+#ifdef USE_DIMS_SPECIALIZE
+	switch (dims) {
+		case 2: return cubic_calc_error_range_impl(cubic, points_offset, i_start, i_end, u, 2, r_error_index);
+		case 3: return cubic_calc_error_range_impl(cubic, points_offset, i_start, i_end, u, 3, r_error_index);
+		case 4: return cubic_calc_error_range_impl(cubic, points_offset, i_start, i_end, u, 4, r_error_index);
+	}
+#endif
+	return cubic_calc_error_range_impl(cubic, points_offset, i_start, i_end, u, dims, r_error_index);
+}
+
+#ifdef USE_PARALLEL
+/**
+ * A version of #cubic_calc_error_range which splits the points into tasks.
+ *
+ * Chunks are combined in order, so the result matches the single threaded version exactly.
+ */
+static real cubic_calc_error_range_parallel(
+        const Cubic *cubic,
+        const real *points_offset,
+        const uint i_start,
+        const uint i_end,
+        const real *u,
+        const uint dims,
 
-	const double *pt_real = points_offset + dims;
+        uint *r_error_index)
+{
+	const uint chunk_len = ((i_end - i_start) + (PARALLEL_REDUCE_CHUNK - 1)) / PARALLEL_REDUCE_CHUNK;
 #ifdef USE_VLA
-	double        pt_eval[dims];
+	real   chunk_error_sq[chunk_len];
+	uint   chunk_error_index[chunk_len];
 #else
-	double       *pt_eval = alloca(sizeof(double) * dims);
+	real   *chunk_error_sq    = alloca(sizeof(real) * chunk_len);
+	uint   *chunk_error_index = alloca(sizeof(uint) * chunk_len);
 #endif
 
-	for (uint i = 1; i < points_offset_len - 1; i++, pt_real += dims) {
-		cubic_calc_point(cubic, u[i], dims, pt_eval);
+#pragma omp taskloop grainsize(1) shared(chunk_error_sq, chunk_error_index)
+	for (uint chunk = 0; chunk < chunk_len; chunk++) {
+		const uint i_chunk_start = i_start + (chunk * PARALLEL_REDUCE_CHUNK);
+		const uint i_chunk_end = (i_end - i_chunk_start > PARALLEL_REDUCE_CHUNK) ?
+		        i_chunk_start + PARALLEL_REDUCE_CHUNK : i_end;
+		chunk_error_sq[chunk] = cubic_calc_error_range(
+		        cubic, points_offset, i_chunk_start, i_chunk_end, u, dims,
+		        &chunk_error_index[chunk]);
+	}
 
-		const double err_sq = len_squared_vnvn(pt_real, pt_eval, dims);
-		if (err_sq >= error_threshold_sq) {
-			return error_threshold_sq;
-		}
-		else if (err_sq >= error_max_sq) {
-			error_max_sq = err_sq;
+	real   error_max_sq = 0.0;
+	uint   error_index = 0;
+	for (uint chunk = 0; chunk < chunk_len; chunk++) {
+		if (chunk_error_sq[chunk] >= error_max_sq) {
+			error_max_sq = chunk_error_sq[chunk];
+			error_index = chunk_error_index[chunk];
 		}
 	}
 
+	*r_error_index = error_index;
 	return error_max_sq;
 }
-#endif
+#endif  /* USE_PARALLEL */
 
 /**
- * Bezier multipliers
+ * Returns a 'measure' of the maximum distance (squared) of the points specified
+ * by points_offset from the corresponding cubic(u[]) points.
  */
+static real cubic_calc_error(
+        const Cubic *cubic,
+        const real *points_offset,
+        const uint points_offset_len,
+        const real *u,
+        const bool use_parallel,
+        const uint dims,
 
-static double B1(double u)
+        uint *r_error_index)
 {
-	double tmp = 1.0 - u;
-	return 3.0 * u * tmp * tmp;
+#ifdef USE_PARALLEL
+	if (use_parallel && (points_offset_len >= PARALLEL_REDUCE_CHUNK * 2)) {
+		return cubic_calc_error_range_parallel(
+		        cubic, points_offset, 1, points_offset_len - 1, u, dims,
+		        r_error_index);
+	}
+#else
+	(void)use_parallel;
+#endif
+	return cubic_calc_error_range(
+	        cubic, points_offset, 1, points_offset_len - 1, u, dims,
+	        r_error_index);
 }
 
-static double B2(double u)
+#ifdef USE_OFFSET_FALLBACK
+DIMS_INLINE real cubic_calc_error_simple_impl(
+        const Cubic *cubic,
+        const real *points_offset,
+        const uint points_offset_len,
+        const real *u,
+        const real error_threshold_sq,
+        const uint dims)
+
+{
+	real   error_max_sq = 0.0;
+	uint   i = 1;
+
+#ifdef USE_SIMD
+	{
+		bool is_over_threshold;
+		i = simd_cubic_calc_error_simple(
+		        cubic, points_offset, i, points_offset_len - 1, u, error_threshold_sq, dims,
+		        &error_max_sq, &is_over_threshold);
+		if (is_over_threshold) {
+			return error_threshold_sq;
+		}
+	}
+#endif
+
+	const real *pt_real = points_offset + (i * dims);
+#ifdef USE_VLA
+	real        pt_eval[dims];
+#else
+	real       *pt_eval = alloca(sizeof(real) * dims);
+#endif
+
+	for (; i < points_offset_len - 1; i++, pt_real += dims) {
+		cubic_calc_point(cubic, u[i], dims, pt_eval);
+
+		const real err_sq = len_squared_vnvn(pt_real, pt_eval, dims);
+		if (err_sq >= error_threshold_sq) {
+			return error_threshold_sq;
+		}
+		else if (err_sq >= error_max_sq) {
+			error_max_sq = err_sq;
+		}
+	}
+
+	return error_max_sq;
+}
+
+/**
+ * A version #cubic_calc_error where we don't need the split-index and can exit early when over the limit.
+ */
+static real cubic_calc_error_simple(
+        const Cubic *cubic,
+        const real *points_offset,
+        const uint points_offset_len,
+        const real *u,
+        const real error_threshold_sq,
+        const uint dims)
+{
+#ifdef USE_DIMS_SPECIALIZE
+	switch (dims) {
+		case 2: return cubic_calc_error_simple_impl(cubic, points_offset, points_offset_len, u, error_threshold_sq, 2);
+		case 3: return cubic_calc_error_simple_impl(cubic, points_offset, points_offset_len, u, error_threshold_sq, 3);
+		case 4: return cubic_calc_error_simple_impl(cubic, points_offset, points_offset_len, u, error_threshold_sq, 4);
+	}
+#endif
+	return cubic_calc_error_simple_impl(cubic, points_offset, points_offset_len, u, error_threshold_sq, dims);
+}
+#endif
+
+/**
+ * Bezier multipliers
+ */
+
+static real B1(real u)
 {
-	return 3.0 * u * u * (1.0 - u);
+	real tmp = 1 - u;
+	return 3 * u * tmp * tmp;
 }
 
-static double B0plusB1(double u)
+static real B2(real u)
 {
-    double tmp = 1.0 - u;
-    return tmp * tmp * (1.0 + 2.0 * u);
+	return 3 * u * u * (1 - u);
 }
 
-static double B2plusB3(double u)
+static real B0plusB1(real u)
 {
-    return u * u * (3.0 - 2.0 * u);
+    real tmp = 1 - u;
+    return tmp * tmp * (1 + 2 * u);
 }
 
-static void points_calc_center_weighted(
-        const double *points_offset,
+static real B2plusB3(real u)
+{
+    return u * u * (3 - 2 * u);
+}
+
+DIMS_INLINE void points_calc_center_weighted_impl(
+        const real   *points_offset,
         const uint    points_offset_len,
+#ifdef USE_LENGTH_CACHE
+        const double *points_length_cache,
+#endif
         const uint    dims,
 
-        double r_center[])
+        real r_center[])
 {
 	/*
 	 * Calculate a center that compensates for point spacing.
 	 */
 
-	const double *pt_prev = &points_offset[(points_offset_len - 2) * dims];
-	const double *pt_curr = pt_prev + dims;
-	const double *pt_next = points_offset;
+#ifdef USE_LENGTH_CACHE
+	/* The same as the loop below, except the lengths of the edges either side of each point
+	 * are known (besides the edge between the end-points). */
+	const real *pt_first = points_offset;
+	const real *pt_last = &points_offset[(points_offset_len - 1) * dims];
+	const uint i_last = points_offset_len - 1;
+	const real w_end = len_vnvn(pt_last, pt_first, dims);
+
+	real w_tot = 0.0;
+	real w;
+
+	w = w_end + (real)(points_length_cache[1] - points_length_cache[0]);
+	w_tot += w;
+	mul_vnvn_fl(r_center, pt_first, w, dims);
+
+	const real *pt_curr = pt_first + dims;
+	for (uint i = 1; i < i_last; i++, pt_curr += dims) {
+		w = (real)(points_length_cache[i + 1] - points_length_cache[i - 1]);
+		w_tot += w;
+		miadd_vn_vn_fl(r_center, pt_curr, w, dims);
+	}
+
+	w = (real)(points_length_cache[i_last] - points_length_cache[i_last - 1]) + w_end;
+	w_tot += w;
+	miadd_vn_vn_fl(r_center, pt_last, w, dims);
+#else
+	const real *pt_prev = &points_offset[(points_offset_len - 2) * dims];
+	const real *pt_curr = pt_prev + dims;
+	const real *pt_next = points_offset;
 
-	double w_prev = len_vnvn(pt_prev, pt_curr, dims);
+	real w_prev = len_vnvn(pt_prev, pt_curr, dims);
 
 	zero_vn(r_center, dims);
-	double w_tot = 0.0;
+	real w_tot = 0.0;
 
 	for (uint i_next = 0; i_next < points_offset_len; i_next++) {
-		const double w_next = len_vnvn(pt_curr, pt_next, dims);
-		const double w = w_prev + w_next;
+		const real w_next = len_vnvn(pt_curr, pt_next, dims);
+		const real w = w_prev + w_next;
 		w_tot += w;
 
 		miadd_vn_vn_fl(r_center, pt_curr, w, dims);
@@ -449,12 +1137,55 @@ static void points_calc_center_weighted(
 		pt_curr = pt_next;
 		pt_next += dims;
 	}
+#endif  /* USE_LENGTH_CACHE */
 
 	if (w_tot != 0.0) {
 		imul_vn_fl(r_center, 1.0 / w_tot, dims);
 	}
 }
 
+static void points_calc_center_weighted(
+        const real   *points_offset,
+        const uint    points_offset_len,
+#ifdef USE_LENGTH_CACHE
+        const double *points_length_cache,
+#  define LENGTH_CACHE_ARG points_length_cache,
+#else
+#  define LENGTH_CACHE_ARG
+#endif
+        const uint    dims,
+
+        real r_center[])
+{
+#ifdef USE_DIMS_SPECIALIZE
+	switch (dims) {
+		case 2: points_calc_center_weighted_impl(
+		        points_offset, points_offset_len, LENGTH_CACHE_ARG 2, r_center); return;
+		case 3: points_calc_center_weighted_impl(
+		        points_offset, points_offset_len, LENGTH_CACHE_ARG 3, r_center); return;
+		case 4: points_calc_center_weighted_impl(
+		        points_offset, points_offset_len, LENGTH_CACHE_ARG 4, r_center); return;
+	}
+#endif
+	points_calc_center_weighted_impl(
+	        points_offset, points_offset_len, LENGTH_CACHE_ARG dims, r_center);
+#undef LENGTH_CACHE_ARG
+}
+
+/**
+ * \return The squared distance (scaled by \a clamp_scale) of \a pt from \a center,
+ * used to find the radius handles are clamped to.
+ */
+static real points_calc_clamp_dist_sq(
+        const real center[], const real pt[], const real clamp_scale, const uint dims)
+{
+	real dist_sq = 0.0;
+	for (uint j = 0; j < dims; j++) {
+		dist_sq += sq((pt[j] - center[j]) * clamp_scale);
+	}
+	return dist_sq;
+}
+
 #ifdef USE_CIRCULAR_FALLBACK
 
 /**
@@ -466,21 +1197,21 @@ static void points_calc_center_weighted(
  *
  * Return the scale representing how much larger the distance around the circle is.
  */
-static double points_calc_circumference_factor(
-        const double  tan_l[],
-        const double  tan_r[],
+static real points_calc_circumference_factor(
+        const real  tan_l[],
+        const real  tan_r[],
         const uint dims)
 {
-	const double dot = dot_vnvn(tan_l, tan_r, dims);
-	const double len_tangent = dot < 0.0 ? len_vnvn(tan_l, tan_r, dims) : len_negated_vnvn(tan_l, tan_r, dims);
-	if (len_tangent > DBL_EPSILON) {
+	const real dot = dot_vnvn(tan_l, tan_r, dims);
+	const real len_tangent = dot < 0.0 ? len_vnvn(tan_l, tan_r, dims) : len_negated_vnvn(tan_l, tan_r, dims);
+	if (len_tangent > REAL_EPSILON) {
 		/* Only clamp to avoid precision error. */
-		double angle = acos(max(-fabs(dot), -1.0));
+		real angle = acos(max(-fabs(dot), -1.0));
 		/* Angle may be less than the length when the tangents define >180 degrees of the circle,
 		 * (tangents that point away from each other).
 		 * We could try support this but will likely cause extreme >1 scales which could cause other issues. */
 		// assert(angle >= len_tangent);
-		double factor = (angle / len_tangent);
+		real factor = (angle / len_tangent);
 		assert(factor < (M_PI / 2) + 1e-6);
 		return factor;
 	}
@@ -496,13 +1227,13 @@ static double points_calc_circumference_factor(
  *
  * \note the return value will need to be multiplied by 1.3... for correct results.
  */
-static double points_calc_circle_tangent_factor(
-        const double  tan_l[],
-        const double  tan_r[],
+static real points_calc_circle_tangent_factor(
+        const real  tan_l[],
+        const real  tan_r[],
         const uint dims)
 {
-	const double eps = 1e-8;
-	const double tan_dot = dot_vnvn(tan_l, tan_r, dims);
+	const real eps = 1e-8;
+	const real tan_dot = dot_vnvn(tan_l, tan_r, dims);
 	if (tan_dot > 1.0 - eps) {
 		/* No angle difference (use fallback, length won't make any difference). */
 		return (1.0 / 3.0) * 0.75;
@@ -513,11 +1244,11 @@ static double points_calc_circle_tangent_factor(
 	}
 	else {
 		/* Non-aligned tangents, calculate handle length. */
-		const double angle = acos(tan_dot) / 2.0;
+		const real angle = acos(tan_dot) / 2.0;
 
 		/* Could also use `angle_sin = len_vnvn(tan_l, tan_r, dims) / 2.0`. */
-		const double angle_sin = sin(angle);
-		const double angle_cos = cos(angle);
+		const real angle_sin = sin(angle);
+		const real angle_cos = cos(angle);
 		return ((1.0 - angle_cos) / (angle_sin * 2.0)) / angle_sin;
 	}
 }
@@ -526,21 +1257,21 @@ static double points_calc_circle_tangent_factor(
  * Calculate the scale the handles, which serves as a best-guess
  * used as a fallback when the least-square solution fails.
  */
-static double points_calc_cubic_scale(
-        const double v_l[], const double v_r[],
-        const double  tan_l[],
-        const double  tan_r[],
-        const double coords_length, uint dims)
+static real points_calc_cubic_scale(
+        const real v_l[], const real v_r[],
+        const real  tan_l[],
+        const real  tan_r[],
+        const real coords_length, uint dims)
 {
-	const double len_direct = len_vnvn(v_l, v_r, dims);
-	const double len_circle_factor = points_calc_circle_tangent_factor(tan_l, tan_r, dims);
+	const real len_direct = len_vnvn(v_l, v_r, dims);
+	const real len_circle_factor = points_calc_circle_tangent_factor(tan_l, tan_r, dims);
 
 	/* If this curve is a circle, this value doesn't need modification. */
-	const double len_circle_handle = (len_direct * (len_circle_factor / 0.75));
+	const real len_circle_handle = (len_direct * (len_circle_factor / 0.75));
 
 	/* Scale by the difference from the circumference distance. */
-	const double len_circle = len_direct * points_calc_circumference_factor(tan_l, tan_r, dims);
-	double scale_handle = (coords_length / len_circle);
+	const real len_circle = len_direct * points_calc_circumference_factor(tan_l, tan_r, dims);
+	real scale_handle = (coords_length / len_circle);
 
 	/* Could investigate an accurate calculation here,
 	 * though this gives close results. */
@@ -550,21 +1281,21 @@ static double points_calc_cubic_scale(
 }
 
 static void cubic_from_points_fallback(
-        const double *points_offset,
+        const real   *points_offset,
         const uint    points_offset_len,
-        const double  tan_l[],
-        const double  tan_r[],
+        const real    tan_l[],
+        const real    tan_r[],
         const uint dims,
 
         Cubic *r_cubic)
 {
-	const double *p0 = &points_offset[0];
-	const double *p3 = &points_offset[(points_offset_len - 1) * dims];
+	const real *p0 = &points_offset[0];
+	const real *p3 = &points_offset[(points_offset_len - 1) * dims];
 
-	double alpha = len_vnvn(p0, p3, dims) / 3.0;
+	real alpha = len_vnvn(p0, p3, dims) / 3.0;
 
-	double *p1 = CUBIC_PT(r_cubic, 1, dims);
-	double *p2 = CUBIC_PT(r_cubic, 2, dims);
+	real *p1 = CUBIC_PT(r_cubic, 1, dims);
+	real *p2 = CUBIC_PT(r_cubic, 2, dims);
 
 	copy_vnvn(CUBIC_PT(r_cubic, 0, dims), p0, dims);
 	copy_vnvn(CUBIC_PT(r_cubic, 3, dims), p3, dims);
@@ -584,31 +1315,31 @@ static void cubic_from_points_fallback(
 #ifdef USE_OFFSET_FALLBACK
 
 static void cubic_from_points_offset_fallback(
-        const double *points_offset,
+        const real   *points_offset,
         const uint    points_offset_len,
-        const double  tan_l[],
-        const double  tan_r[],
+        const real    tan_l[],
+        const real    tan_r[],
         const uint dims,
 
         Cubic *r_cubic)
 {
-	const double *p0 = &points_offset[0];
-	const double *p3 = &points_offset[(points_offset_len - 1) * dims];
+	const real *p0 = &points_offset[0];
+	const real *p3 = &points_offset[(points_offset_len - 1) * dims];
 
 #ifdef USE_VLA
-	double dir_unit[dims];
-	double a[2][dims];
-	double tmp[dims];
+	real dir_unit[dims];
+	real a[2][dims];
+	real tmp[dims];
 #else
-	double *dir_unit = alloca(sizeof(double) * dims);
-	double *a[2] = {
-	    alloca(sizeof(double) * dims),
-	    alloca(sizeof(double) * dims),
+	real *dir_unit = alloca(sizeof(real) * dims);
+	real *a[2] = {
+	    alloca(sizeof(real) * dims),
+	    alloca(sizeof(real) * dims),
 	};
-	double *tmp = alloca(sizeof(double) * dims);
+	real *tmp = alloca(sizeof(real) * dims);
 #endif
 
-	const double dir_dist = normalize_vn_vnvn(dir_unit, p3, p0, dims);
+	const real dir_dist = normalize_vn_vnvn(dir_unit, p3, p0, dims);
 	project_plane_vn_vnvn_normalized(a[0], tan_l, dir_unit, dims);
 	project_plane_vn_vnvn_normalized(a[1], tan_r, dir_unit, dims);
 
@@ -618,9 +1349,9 @@ static void cubic_from_points_offset_fallback(
 
 	mul_vnvn_fl(a[1], a[1], -1, dims);
 
-	double dists[2] = {0, 0};
+	real dists[2] = {0, 0};
 
-	const double *pt = &points_offset[dims];
+	const real *pt = &points_offset[dims];
 	for (uint i = 1; i < points_offset_len - 1; i++, pt += dims) {
 		for (uint k = 0; k < 2; k++) {
 			sub_vn_vnvn(tmp, p0, pt, dims);
@@ -642,13 +1373,13 @@ static void cubic_from_points_offset_fallback(
 	 * so there is no need to be too precise when checking if limits have been exceeded. */
 
 #ifndef HAS_UBSAN
-	double alpha_l = (dists[0] / 0.75) / fabs(dot_vnvn(tan_l, a[0], dims));
-	double alpha_r = (dists[1] / 0.75) / fabs(dot_vnvn(tan_r, a[1], dims));
+	real alpha_l = (dists[0] / 0.75) / fabs(dot_vnvn(tan_l, a[0], dims));
+	real alpha_r = (dists[1] / 0.75) / fabs(dot_vnvn(tan_r, a[1], dims));
 #else /* Suppress harmless division by zero warnings. */
-	const double alpha_l_div = fabs(dot_vnvn(tan_l, a[0], dims));
-	const double alpha_r_div = fabs(dot_vnvn(tan_r, a[1], dims));
-	double alpha_l = alpha_l_div > 0.0 ? ((dists[0] / 0.75) / alpha_l_div) : INFINITY;
-	double alpha_r = alpha_r_div > 0.0 ? ((dists[1] / 0.75) / alpha_r_div) : INFINITY;
+	const real alpha_l_div = fabs(dot_vnvn(tan_l, a[0], dims));
+	const real alpha_r_div = fabs(dot_vnvn(tan_r, a[1], dims));
+	real alpha_l = alpha_l_div > 0.0 ? ((dists[0] / 0.75) / alpha_l_div) : INFINITY;
+	real alpha_r = alpha_r_div > 0.0 ? ((dists[1] / 0.75) / alpha_r_div) : INFINITY;
 #endif /* HAS_UBSAN */
 
 
@@ -659,8 +1390,8 @@ static void cubic_from_points_offset_fallback(
 		alpha_r = dir_dist / 3.0;
 	}
 
-	double *p1 = CUBIC_PT(r_cubic, 1, dims);
-	double *p2 = CUBIC_PT(r_cubic, 2, dims);
+	real *p1 = CUBIC_PT(r_cubic, 1, dims);
+	real *p2 = CUBIC_PT(r_cubic, 2, dims);
 
 	copy_vnvn(CUBIC_PT(r_cubic, 0, dims), p0, dims);
 	copy_vnvn(CUBIC_PT(r_cubic, 3, dims), p3, dims);
@@ -678,61 +1409,192 @@ static void cubic_from_points_offset_fallback(
 #endif  /* USE_OFFSET_FALLBACK */
 
 
+DIMS_INLINE void cubic_from_points_accumulate_impl(
+        const real   *points_offset,
+        const uint    i_start,
+        const uint    i_end,
+        const real   *p0,
+        const real   *p3,
+        const real   *u_prime,
+        const real    tan_l[],
+        const real    tan_r[],
+        const uint dims,
+
+        double r_x[2], double r_c[2][2])
+{
+#ifdef USE_VLA
+	real a[2][dims];
+#else
+	real *a[2] = {
+	    alloca(sizeof(real) * dims),
+	    alloca(sizeof(real) * dims),
+	};
+#endif
+
+	/* Always accumulate in double precision, since the result is sensitive to precision loss. */
+	double x[2] = {0.0}, c[2][2] = {{0.0}};
+	const real *pt = &points_offset[i_start * dims];
+
+	for (uint i = i_start; i < i_end; i++, pt += dims) {
+		mul_vnvn_fl(a[0], tan_l, B1(u_prime[i]), dims);
+		mul_vnvn_fl(a[1], tan_r, B2(u_prime[i]), dims);
+
+		const real b0_plus_b1 = B0plusB1(u_prime[i]);
+		const real b2_plus_b3 = B2plusB3(u_prime[i]);
+
+		/* Inline dot product. */
+		DIMS_UNROLL
+		for (uint j = 0; j < dims; j++) {
+			const real tmp = (pt[j] - (p0[j] * b0_plus_b1)) + (p3[j] * b2_plus_b3);
+
+			x[0] += (double)a[0][j] * tmp;
+			x[1] += (double)a[1][j] * tmp;
+
+			c[0][0] += (double)a[0][j] * a[0][j];
+			c[0][1] += (double)a[0][j] * a[1][j];
+			c[1][1] += (double)a[1][j] * a[1][j];
+		}
+
+		c[1][0] = c[0][1];
+	}
+
+	memcpy(r_x, x, sizeof(x));
+	memcpy(r_c, c, sizeof(c));
+}
+
+/**
+ * Accumulate the least-squares system used by #cubic_from_points
+ * for the points in `[i_start, i_end)`.
+ */
+static void cubic_from_points_accumulate(
+        const real   *points_offset,
+        const uint    i_start,
+        const uint    i_end,
+        const real   *p0,
+        const real   *p3,
+        const real   *u_prime,
+        const real    tan_l[],
+        const real    tan_r[],
+        const uint dims,
+
+        double r_x[2], double r_c[2][2])
+{
+#ifdef USE_DIMS_SPECIALIZE
+	switch (dims) {
+		case 2: cubic_from_points_accumulate_impl(
+		        points_offset, i_start, i_end, p0, p3, u_prime, tan_l, tan_r, 2, r_x, r_c); return;
+		case 3: cubic_from_points_accumulate_impl(
+		        points_offset, i_start, i_end, p0, p3, u_prime, tan_l, tan_r, 3, r_x, r_c); return;
+		case 4: cubic_from_points_accumulate_impl(
+		        points_offset, i_start, i_end, p0, p3, u_prime, tan_l, tan_r, 4, r_x, r_c); return;
+	}
+#endif
+	cubic_from_points_accumulate_impl(
+	        points_offset, i_start, i_end, p0, p3, u_prime, tan_l, tan_r, dims, r_x, r_c);
+}
+
+#ifdef USE_PARALLEL
+/**
+ * A version of #cubic_from_points_accumulate which splits the points into tasks.
+ *
+ * Chunks are summed in order, so the result doesn't depend on the number of threads,
+ * although it may differ slightly from the single threaded version.
+ */
+static void cubic_from_points_accumulate_parallel(
+        const real   *points_offset,
+        const uint    i_start,
+        const uint    i_end,
+        const real   *p0,
+        const real   *p3,
+        const real   *u_prime,
+        const real    tan_l[],
+        const real    tan_r[],
+        const uint dims,
+
+        double r_x[2], double r_c[2][2])
+{
+	const uint chunk_len = ((i_end - i_start) + (PARALLEL_REDUCE_CHUNK - 1)) / PARALLEL_REDUCE_CHUNK;
+#ifdef USE_VLA
+	double chunk_x[chunk_len][2];
+	double chunk_c[chunk_len][2][2];
+#else
+	double (*chunk_x)[2]    = alloca(sizeof(*chunk_x) * chunk_len);
+	double (*chunk_c)[2][2] = alloca(sizeof(*chunk_c) * chunk_len);
+#endif
+
+#pragma omp taskloop grainsize(1) shared(chunk_x, chunk_c)
+	for (uint chunk = 0; chunk < chunk_len; chunk++) {
+		const uint i_chunk_start = i_start + (chunk * PARALLEL_REDUCE_CHUNK);
+		const uint i_chunk_end = (i_end - i_chunk_start > PARALLEL_REDUCE_CHUNK) ?
+		        i_chunk_start + PARALLEL_REDUCE_CHUNK : i_end;
+		cubic_from_points_accumulate(
+		        points_offset, i_chunk_start, i_chunk_end, p0, p3, u_prime, tan_l, tan_r, dims,
+		        chunk_x[chunk], chunk_c[chunk]);
+	}
+
+	double x[2] = {0.0}, c[2][2] = {{0.0}};
+	for (uint chunk = 0; chunk < chunk_len; chunk++) {
+		x[0] += chunk_x[chunk][0];
+		x[1] += chunk_x[chunk][1];
+		c[0][0] += chunk_c[chunk][0][0];
+		c[0][1] += chunk_c[chunk][0][1];
+		c[1][1] += chunk_c[chunk][1][1];
+	}
+	c[1][0] = c[0][1];
+
+	memcpy(r_x, x, sizeof(x));
+	memcpy(r_c, c, sizeof(c));
+}
+#endif  /* USE_PARALLEL */
+
 /**
  * Use least-squares method to find Bezier control points for region.
+ *
+ * \param center, center_is_calc: The weighted center of the points,
+ * only calculated when it's needed for clamping (reused when the same points are fitted again).
  */
 static void cubic_from_points(
-        const double *points_offset,
+        const real   *points_offset,
         const uint    points_offset_len,
+#ifdef USE_LENGTH_CACHE
+        const double *points_length_cache,
+#endif
 #ifdef USE_CIRCULAR_FALLBACK
-        const double  points_offset_coords_length,
+        const real    points_offset_coords_length,
 #endif
-        const double *u_prime,
-        const double  tan_l[],
-        const double  tan_r[],
+        const real   *u_prime,
+        const real    tan_l[],
+        const real    tan_r[],
+        const bool use_parallel,
         const uint dims,
+        real center[], bool *center_is_calc,
 
         Cubic *r_cubic)
 {
 
-	const double *p0 = &points_offset[0];
-	const double *p3 = &points_offset[(points_offset_len - 1) * dims];
+	const real *p0 = &points_offset[0];
+	const real *p3 = &points_offset[(points_offset_len - 1) * dims];
 
 	/* Point Pairs. */
 	double alpha_l, alpha_r;
-#ifdef USE_VLA
-	double a[2][dims];
-#else
-	double *a[2] = {
-	    alloca(sizeof(double) * dims),
-	    alloca(sizeof(double) * dims),
-	};
-#endif
 
 	{
-		double x[2] = {0.0}, c[2][2] = {{0.0}};
-		const double *pt = points_offset;
-
-		for (uint i = 0; i < points_offset_len; i++, pt += dims) {
-			mul_vnvn_fl(a[0], tan_l, B1(u_prime[i]), dims);
-			mul_vnvn_fl(a[1], tan_r, B2(u_prime[i]), dims);
-
-			const double b0_plus_b1 = B0plusB1(u_prime[i]);
-			const double b2_plus_b3 = B2plusB3(u_prime[i]);
-
-			/* Inline dot product. */
-			for (uint j = 0; j < dims; j++) {
-				const double tmp = (pt[j] - (p0[j] * b0_plus_b1)) + (p3[j] * b2_plus_b3);
+		double x[2], c[2][2];
 
-				x[0] += a[0][j] * tmp;
-				x[1] += a[1][j] * tmp;
-
-				c[0][0] += a[0][j] * a[0][j];
-				c[0][1] += a[0][j] * a[1][j];
-				c[1][1] += a[1][j] * a[1][j];
-			}
-
-			c[1][0] = c[0][1];
+#ifdef USE_PARALLEL
+		if (use_parallel && (points_offset_len >= PARALLEL_REDUCE_CHUNK * 2)) {
+			cubic_from_points_accumulate_parallel(
+			        points_offset, 0, points_offset_len, p0, p3, u_prime, tan_l, tan_r, dims,
+			        x, c);
+		}
+		else
+#else
+		(void)use_parallel;
+#endif
+		{
+			cubic_from_points_accumulate(
+			        points_offset, 0, points_offset_len, p0, p3, u_prime, tan_l, tan_r, dims,
+			        x, c);
 		}
 
 		double det_C0_C1 = c[0][0] * c[1][1] - c[0][1] * c[1][0];
@@ -765,7 +1627,7 @@ static void cubic_from_points(
 	    !(alpha_r >= 0.0))
 	{
 #ifdef USE_CIRCULAR_FALLBACK
-		double alpha_test = points_calc_cubic_scale(p0, p3, tan_l, tan_r, points_offset_coords_length, dims);
+		real alpha_test = points_calc_cubic_scale(p0, p3, tan_l, tan_r, points_offset_coords_length, dims);
 		if (!isfinite(alpha_test)) {
 			alpha_test = len_vnvn(p0, p3, dims) / 3.0;
 		}
@@ -778,8 +1640,8 @@ static void cubic_from_points(
 		use_clamp = false;
 	}
 
-	double *p1 = CUBIC_PT(r_cubic, 1, dims);
-	double *p2 = CUBIC_PT(r_cubic, 2, dims);
+	real *p1 = CUBIC_PT(r_cubic, 1, dims);
+	real *p2 = CUBIC_PT(r_cubic, 2, dims);
 
 	copy_vnvn(CUBIC_PT(r_cubic, 0, dims), p0, dims);
 	copy_vnvn(CUBIC_PT(r_cubic, 3, dims), p3, dims);
@@ -797,40 +1659,41 @@ static void cubic_from_points(
 	 * Clamping (we could make it optional)
 	 */
 	if (use_clamp) {
-#ifdef USE_VLA
-		double center[dims];
-#else
-		double *center = alloca(sizeof(double) * dims);
+		if (*center_is_calc == false) {
+			points_calc_center_weighted(
+			        points_offset, points_offset_len,
+#ifdef USE_LENGTH_CACHE
+			        points_length_cache,
 #endif
-		points_calc_center_weighted(points_offset, points_offset_len, dims, center);
+			        dims, center);
+			*center_is_calc = true;
+		}
+
+		const real clamp_scale = 3.0;  /* Clamp to 3x. */
 
-		const double clamp_scale = 3.0;  /* Clamp to 3x. */
-		double dist_sq_max = 0.0;
+		/* The end-points give a lower bound for the clamp radius,
+		 * only check all points when a handle is outside it. */
+		real dist_sq_max = max(
+		        points_calc_clamp_dist_sq(center, p0, clamp_scale, dims),
+		        points_calc_clamp_dist_sq(center, p3, clamp_scale, dims));
 
+		real p1_dist_sq = len_squared_vnvn(center, p1, dims);
+		real p2_dist_sq = len_squared_vnvn(center, p2, dims);
+
+		if (p1_dist_sq > dist_sq_max ||
+		    p2_dist_sq > dist_sq_max)
 		{
-			const double *pt = points_offset;
-			for (uint i = 0; i < points_offset_len; i++, pt += dims) {
-#if 0
-				double dist_sq_test = sq(len_vnvn(center, pt, dims) * clamp_scale);
-#else
-				/* Do inline. */
-				double dist_sq_test = 0.0;
-				for (uint j = 0; j < dims; j++) {
-					dist_sq_test += sq((pt[j] - center[j]) * clamp_scale);
-				}
-#endif
-				dist_sq_max = max(dist_sq_max, dist_sq_test);
+			const real *pt = &points_offset[dims];
+			for (uint i = 1; i < points_offset_len - 1; i++, pt += dims) {
+				dist_sq_max = max(dist_sq_max, points_calc_clamp_dist_sq(center, pt, clamp_scale, dims));
 			}
 		}
 
-		double p1_dist_sq = len_squared_vnvn(center, p1, dims);
-		double p2_dist_sq = len_squared_vnvn(center, p2, dims);
-
 		if (p1_dist_sq > dist_sq_max ||
 		    p2_dist_sq > dist_sq_max)
 		{
 #ifdef USE_CIRCULAR_FALLBACK
-			double alpha_test = points_calc_cubic_scale(p0, p3, tan_l, tan_r, points_offset_coords_length, dims);
+			real alpha_test = points_calc_cubic_scale(p0, p3, tan_l, tan_r, points_offset_coords_length, dims);
 			if (!isfinite(alpha_test)) {
 				alpha_test = len_vnvn(p0, p3, dims) / 3.0;
 			}
@@ -866,18 +1729,26 @@ static void cubic_from_points(
 }
 
 #ifdef USE_LENGTH_CACHE
+/**
+ * Store the accumulated length at each point.
+ *
+ * \note Double precision is used (even for single precision points),
+ * since the parameterization of a small part of a long span is calculated from the difference of two values.
+ */
 static void points_calc_coord_length_cache(
-        const double *points_offset,
+        const real   *points_offset,
         const uint    points_offset_len,
         const uint    dims,
 
-        double     *r_points_length_cache)
+        double       *r_points_length_cache)
 {
-	const double *pt_prev = points_offset;
-	const double *pt = pt_prev + dims;
+	const real *pt_prev = points_offset;
+	const real *pt = pt_prev + dims;
+	double length_accum = 0.0;
 	r_points_length_cache[0] = 0.0;
 	for (uint i = 1; i < points_offset_len; i++) {
-		r_points_length_cache[i] = len_vnvn(pt, pt_prev, dims);
+		length_accum += len_vnvn(pt, pt_prev, dims);
+		r_points_length_cache[i] = length_accum;
 		pt_prev = pt;
 		pt += dims;
 	}
@@ -887,39 +1758,46 @@ static void points_calc_coord_length_cache(
 /**
  * \return the accumulated length of \a points_offset.
  */
-static double points_calc_coord_length(
-        const double *points_offset,
+static real points_calc_coord_length(
+        const real   *points_offset,
         const uint    points_offset_len,
         const uint    dims,
 #ifdef USE_LENGTH_CACHE
         const double *points_length_cache,
 #endif
-        double *r_u)
+        real *r_u)
 {
-	const double *pt_prev = points_offset;
-	const double *pt = pt_prev + dims;
-	r_u[0] = 0.0;
-	for (uint i = 1, i_prev = 0; i < points_offset_len; i++) {
-		double length;
-
 #ifdef USE_LENGTH_CACHE
-		length = points_length_cache[i];
-		assert(len_vnvn(pt, pt_prev, dims) == points_length_cache[i]);
+	/* The accumulated lengths are known, each value only needs to be offset & scaled. */
+	(void)points_offset;
+	(void)dims;
+	const double length_first = points_length_cache[0];
+	const double w = points_length_cache[points_offset_len - 1] - length_first;
+	assert(!is_almost_zero((real)w));
+	r_u[0] = 0.0;
+	for (uint i = 1; i < points_offset_len; i++) {
+		r_u[i] = (real)((points_length_cache[i] - length_first) / w);
+	}
+	return (real)w;
 #else
-		length = len_vnvn(pt, pt_prev, dims);
-#endif
-
-		r_u[i] = r_u[i_prev] + length;
-		i_prev = i;
+	const real *pt_prev = points_offset;
+	const real *pt = pt_prev + dims;
+	/* Accumulate in double precision, so long spans of single precision points don't drift. */
+	double length_accum = 0.0;
+	r_u[0] = 0.0;
+	for (uint i = 1; i < points_offset_len; i++) {
+		length_accum += len_vnvn(pt, pt_prev, dims);
+		r_u[i] = (real)length_accum;
 		pt_prev = pt;
 		pt += dims;
 	}
 	assert(!is_almost_zero(r_u[points_offset_len - 1]));
-	const double w = r_u[points_offset_len - 1];
+	const real w = r_u[points_offset_len - 1];
 	for (uint i = 1; i < points_offset_len; i++) {
 		r_u[i] /= w;
 	}
 	return w;
+#endif  /* USE_LENGTH_CACHE */
 }
 
 /**
@@ -931,42 +1809,163 @@ static double points_calc_coord_length(
  *
  * \note Return value may be `nan` caller must check for this.
  */
-static double cubic_find_root(
+DIMS_INLINE real cubic_find_root(
         const Cubic *cubic,
-        const double p[],
-        const double u,
+        const real p[],
+        const real u,
         const uint dims)
 {
 	/* Newton-Raphson Method. */
-	/* All vectors. */
-#ifdef USE_VLA
-	double q0_u[dims];
-	double q1_u[dims];
-	double q2_u[dims];
-#else
-	double *q0_u = alloca(sizeof(double) * dims);
-	double *q1_u = alloca(sizeof(double) * dims);
-	double *q2_u = alloca(sizeof(double) * dims);
-#endif
+	CUBIC_VARS_CONST(cubic, dims, p0, p1, p2, p3);
+	const real t = u;
+	const real s = 1 - t;
 
-	cubic_calc_point(cubic, u, dims, q0_u);
-	cubic_calc_speed(cubic, u, dims, q1_u);
-	cubic_calc_acceleration(cubic, u, dims, q2_u);
+	/* The point (see #cubic_calc_point), speed & acceleration are calculated together for each axis,
+	 * accumulating the products as they're calculated. */
+	real q0_dot_q1 = 0.0;
+	real q1_len_sq = 0.0;
+	real q0_dot_q2 = 0.0;
+
+	DIMS_UNROLL
+	for (uint j = 0; j < dims; j++) {
+		const real p01 = (p0[j] * s) + (p1[j] * t);
+		const real p12 = (p1[j] * s) + (p2[j] * t);
+		const real p23 = (p2[j] * s) + (p3[j] * t);
+		const real q0 = (((((p01 * s) + (p12 * t))) * s) +
+		                 ((((p12 * s) + (p23 * t))) * t)) - p[j];
+		const real q1 = 3 * ((p1[j] - p0[j]) * s * s + 2 *
+		                     (p2[j] - p0[j]) * s * t +
+		                     (p3[j] - p2[j]) * t * t);
+		const real q2 = 6 * ((p2[j] - 2 * p1[j] + p0[j]) * s +
+		                     (p3[j] - 2 * p2[j] + p1[j]) * t);
+		q0_dot_q1 += q0 * q1;
+		q1_len_sq += sq(q1);
+		q0_dot_q2 += q0 * q2;
+	}
 
 	/* May divide-by-zero, caller must check for that case. */
 	/* `u - ((q0_u - p) * q1_u) / (q1_u.length_squared() + (q0_u - p) * q2_u)` */
-	isub_vnvn(q0_u, p, dims);
-	return u - dot_vnvn(q0_u, q1_u, dims) /
-	       (len_squared_vn(q1_u, dims) + dot_vnvn(q0_u, q2_u, dims));
+	return u - q0_dot_q1 / (q1_len_sq + q0_dot_q2);
+}
+
+static void sort_reals_heap_sift_down(real *values, uint i, const uint values_len)
+{
+	const real v = values[i];
+	uint child;
+	while ((child = (i * 2) + 1) < values_len) {
+		if (child + 1 < values_len) {
+			child += (values[child + 1] > values[child]);
+		}
+		if (!(values[child] > v)) {
+			break;
+		}
+		values[i] = values[child];
+		i = child;
+	}
+	values[i] = v;
+}
+
+static void sort_reals_heap(real *values, const uint values_len)
+{
+	for (uint i = values_len / 2; i-- != 0; ) {
+		sort_reals_heap_sift_down(values, i, values_len);
+	}
+	for (uint i_end = values_len - 1; i_end != 0; i_end--) {
+		SWAP(real, values[0], values[i_end]);
+		sort_reals_heap_sift_down(values, 0, i_end);
+	}
+}
+
+/**
+ * Sort values in ascending order,
+ * optimized for values which are sorted or only need to move a short distance
+ * (as is the case for roots calculated from sorted values).
+ *
+ * Use insertion sort, falling back to heap-sort when too many values need to be moved.
+ *
+ * \note Values must not be NAN.
+ */
+static void sort_reals_nearly_sorted(real *values, const uint values_len)
+{
+	uint i = 1;
+
+	/* Skip values which are already sorted (often all of them). */
+	while ((i < values_len) && (values[i - 1] <= values[i])) {
+		i++;
+	}
+
+	/* Limit the number of moves, so this doesn't degrade to `O(n^2)`. */
+	uint moves_remaining = values_len;
+	for (; i < values_len; i++) {
+		const real v = values[i];
+		uint j = i;
+		while ((j != 0) && (values[j - 1] > v)) {
+			if (moves_remaining == 0) {
+				values[j] = v;
+				sort_reals_heap(values, values_len);
+				return;
+			}
+			moves_remaining--;
+			values[j] = values[j - 1];
+			j--;
+		}
+		values[j] = v;
+	}
+}
+
+DIMS_INLINE bool cubic_find_roots_impl(
+        const Cubic *cubic,
+        const real   *points_offset,
+        const uint    points_offset_len,
+        const real   *u,
+        const uint    dims,
+
+        real       *r_u_prime)
+{
+	uint i = 0;
+
+#ifdef USE_SIMD
+	bool is_finite;
+	i = simd_cubic_find_roots(
+	        cubic, points_offset, i, points_offset_len, u, dims,
+	        r_u_prime, &is_finite);
+	if (!is_finite) {
+		return false;
+	}
+#endif
+
+	const real *pt = &points_offset[i * dims];
+	for (; i < points_offset_len; i++, pt += dims) {
+		r_u_prime[i] = cubic_find_root(cubic, pt, u[i], dims);
+		if (!isfinite(r_u_prime[i])) {
+			return false;
+		}
+	}
+	return true;
 }
 
-static int compare_double_fn(const void *a_, const void *b_)
+/**
+ * Calculate #cubic_find_root for each point.
+ *
+ * \return false when any of the values aren't finite.
+ */
+static bool cubic_find_roots(
+        const Cubic *cubic,
+        const real   *points_offset,
+        const uint    points_offset_len,
+        const real   *u,
+        const uint    dims,
+
+        real       *r_u_prime)
 {
-	const double *a = a_;
-	const double *b = b_;
-	if      (*a > *b) return  1;
-	else if (*a < *b) return -1;
-	else              return  0;
+#ifdef USE_DIMS_SPECIALIZE
+	switch (dims) {
+		case 2: return cubic_find_roots_impl(cubic, points_offset, points_offset_len, u, 2, r_u_prime);
+		case 3: return cubic_find_roots_impl(cubic, points_offset, points_offset_len, u, 3, r_u_prime);
+		case 4: return cubic_find_roots_impl(cubic, points_offset, points_offset_len, u, 4, r_u_prime);
+	}
+#endif
+	return cubic_find_roots_impl(cubic, points_offset, points_offset_len, u, dims, r_u_prime);
 }
 
 /**
@@ -974,26 +1973,22 @@ static int compare_double_fn(const void *a_, const void *b_)
  */
 static bool cubic_reparameterize(
         const Cubic *cubic,
-        const double *points_offset,
+        const real   *points_offset,
         const uint    points_offset_len,
-        const double *u,
+        const real   *u,
         const uint    dims,
 
-        double       *r_u_prime)
+        real       *r_u_prime)
 {
 	/*
 	 * Recalculate the values of u[] based on the Newton Raphson method
 	 */
 
-	const double *pt = points_offset;
-	for (uint i = 0; i < points_offset_len; i++, pt += dims) {
-		r_u_prime[i] = cubic_find_root(cubic, pt, u[i], dims);
-		if (!isfinite(r_u_prime[i])) {
-			return false;
-		}
+	if (!cubic_find_roots(cubic, points_offset, points_offset_len, u, dims, r_u_prime)) {
+		return false;
 	}
 
-	qsort(r_u_prime, points_offset_len, sizeof(double), compare_double_fn);
+	sort_reals_nearly_sorted(r_u_prime, points_offset_len);
 
 	if ((r_u_prime[0] < 0.0) ||
 	    (r_u_prime[points_offset_len - 1] > 1.0))
@@ -1008,19 +2003,34 @@ static bool cubic_reparameterize(
 
 
 static bool fit_cubic_to_points(
-        const double *points_offset,
+        const real   *points_offset,
         const uint    points_offset_len,
 #ifdef USE_LENGTH_CACHE
         const double *points_length_cache,
 #endif
-        const double  tan_l[],
-        const double  tan_r[],
-        const double  error_threshold_sq,
+        const real    tan_l[],
+        const real    tan_r[],
+        const real    error_threshold_sq,
+        const uint    calc_flag,
         const uint    dims,
+        struct CurveFitContext *ctx,
 
-        Cubic *r_cubic, double *r_error_max_sq, uint *r_split_index)
+        Cubic *r_cubic, real *r_error_max_sq, uint *r_split_index)
 {
-	const uint iteration_max = 4;
+#ifdef USE_PARALLEL
+	const bool use_parallel = (calc_flag & CURVE_FIT_CALC_PARALLEL) != 0;
+#else
+	const bool use_parallel = false;
+#endif
+	const uint iteration_max =
+	        (calc_flag & CURVE_FIT_CALC_NO_REPARAMETERIZE) ? 0 :
+	        (calc_flag & CURVE_FIT_CALC_REPARAMETERIZE_EXTRA) ? REPARAMETERIZE_ITER_EXTRA :
+	        REPARAMETERIZE_ITER_DEFAULT;
+
+	struct CurveFitStats *stats = ctx->stats;
+	if (stats) {
+		stats->fit_count += 1;
+	}
 
 	if (points_offset_len == 2) {
 		CUBIC_VARS(r_cubic, dims, p0, p1, p2, p3);
@@ -1028,7 +2038,7 @@ static bool fit_cubic_to_points(
 		copy_vnvn(p0, &points_offset[0 * dims], dims);
 		copy_vnvn(p3, &points_offset[1 * dims], dims);
 
-		const double dist = len_vnvn(p0, p3, dims) / 3.0;
+		const real dist = len_vnvn(p0, p3, dims) / 3.0;
 		msub_vn_vnvn_fl(p1, p0, tan_l, dist, dims);
 		madd_vn_vnvn_fl(p2, p3, tan_r, dist, dims);
 
@@ -1038,10 +2048,11 @@ static bool fit_cubic_to_points(
 		return true;
 	}
 
-	double *u = malloc(sizeof(double) * points_offset_len);
+	/* Both `u` & `u_prime`. */
+	real *u = curve_fit_buffer_ensure(ctx, &ctx->u, sizeof(real) * points_offset_len * 2);
 
 #ifdef USE_CIRCULAR_FALLBACK
-	const double points_offset_coords_length  =
+	const real points_offset_coords_length  =
 #endif
 	points_calc_coord_length(
 	        points_offset, points_offset_len, dims,
@@ -1050,20 +2061,31 @@ static bool fit_cubic_to_points(
 #endif
 	        u);
 
-	double error_max_sq;
+	real error_max_sq;
 	uint split_index;
 
+	/* Only calculated when clamping handles (shared by each attempt to fit these points). */
+#ifdef USE_VLA
+	real center[dims];
+#else
+	real *center = alloca(sizeof(real) * dims);
+#endif
+	bool center_is_calc = false;
+
 	/* Parameterize points, and attempt to fit curve. */
 	cubic_from_points(
 	        points_offset, points_offset_len,
+#ifdef USE_LENGTH_CACHE
+	        points_length_cache,
+#endif
 #ifdef USE_CIRCULAR_FALLBACK
 	        points_offset_coords_length,
 #endif
-	        u, tan_l, tan_r, dims, r_cubic);
+	        u, tan_l, tan_r, use_parallel, dims, center, &center_is_calc, r_cubic);
 
 	/* Find max deviation of points to fitted curve. */
 	error_max_sq = cubic_calc_error(
-	        r_cubic, points_offset, points_offset_len, u, dims,
+	        r_cubic, points_offset, points_offset_len, u, use_parallel, dims,
 	        &split_index);
 
 	Cubic *cubic_test = alloca(cubic_alloc_size(dims));
@@ -1071,7 +2093,9 @@ static bool fit_cubic_to_points(
 	/* Run this so we use the non-circular calculation when the circular-fallback
 	 * in 'cubic_from_points' failed to give a close enough result. */
 #ifdef USE_CIRCULAR_FALLBACK
-	if (!(error_max_sq < error_threshold_sq)) {
+	if (!(error_max_sq < error_threshold_sq) &&
+	    !(calc_flag & CURVE_FIT_CALC_NO_FALLBACK_CIRCULAR))
+	{
 		/* Don't use the cubic calculated above, instead calculate a new fallback cubic,
 		 * since this tends to give more balanced split_index along the curve.
 		 * This is because the attempt to calcualte the cubic may contain spikes
@@ -1079,8 +2103,8 @@ static bool fit_cubic_to_points(
 		cubic_from_points_fallback(
 		        points_offset, points_offset_len,
 		        tan_l, tan_r, dims, cubic_test);
-		const double error_max_sq_test = cubic_calc_error(
-		        cubic_test, points_offset, points_offset_len, u, dims,
+		const real error_max_sq_test = cubic_calc_error(
+		        cubic_test, points_offset, points_offset_len, u, use_parallel, dims,
 		        &split_index);
 
 		/* Intentionally use the newly calculated 'split_index',
@@ -1088,24 +2112,32 @@ static bool fit_cubic_to_points(
 		if (error_max_sq > error_max_sq_test) {
 			error_max_sq = error_max_sq_test;
 			cubic_copy(r_cubic, cubic_test, dims);
+			if (stats) {
+				stats->fallback_circular_count += 1;
+			}
 		}
 	}
 #endif
 
 	/* Test the offset fallback. */
 #ifdef USE_OFFSET_FALLBACK
-	if (!(error_max_sq < error_threshold_sq)) {
+	if (!(error_max_sq < error_threshold_sq) &&
+	    !(calc_flag & CURVE_FIT_CALC_NO_FALLBACK_OFFSET))
+	{
 		/* Using the offset from the curve to calculate cubic handle length may give better results
 		 * try this as a second fallback. */
 		cubic_from_points_offset_fallback(
 		        points_offset, points_offset_len,
 		        tan_l, tan_r, dims, cubic_test);
-		const double error_max_sq_test = cubic_calc_error_simple(
+		const real error_max_sq_test = cubic_calc_error_simple(
 		        cubic_test, points_offset, points_offset_len, u, error_max_sq, dims);
 
 		if (error_max_sq > error_max_sq_test) {
 			error_max_sq = error_max_sq_test;
 			cubic_copy(r_cubic, cubic_test, dims);
+			if (stats) {
+				stats->fallback_offset_count += 1;
+			}
 		}
 	}
 #endif
@@ -1117,7 +2149,7 @@ static bool fit_cubic_to_points(
 		cubic_copy(cubic_test, r_cubic, dims);
 
 		/* If error not too large, try some re-parameterization and iteration. */
-		double *u_prime = malloc(sizeof(double) * points_offset_len);
+		real *u_prime = u + points_offset_len;
 		for (uint iter = 0; iter < iteration_max; iter++) {
 			if (!cubic_reparameterize(
 			        cubic_test, points_offset, points_offset_len, u, dims, u_prime))
@@ -1125,15 +2157,22 @@ static bool fit_cubic_to_points(
 				break;
 			}
 
+			if (stats) {
+				stats->reparameterize_count += 1;
+			}
+
 			cubic_from_points(
 			        points_offset, points_offset_len,
+#ifdef USE_LENGTH_CACHE
+			        points_length_cache,
+#endif
 #ifdef USE_CIRCULAR_FALLBACK
 			        points_offset_coords_length,
 #endif
-			        u_prime, tan_l, tan_r, dims, cubic_test);
+			        u_prime, tan_l, tan_r, use_parallel, dims, center, &center_is_calc, cubic_test);
 
-			const double error_max_sq_test = cubic_calc_error(
-			        cubic_test, points_offset, points_offset_len, u_prime, dims,
+			const real error_max_sq_test = cubic_calc_error(
+			        cubic_test, points_offset, points_offset_len, u_prime, use_parallel, dims,
 			        &split_index);
 
 			if (error_max_sq > error_max_sq_test) {
@@ -1148,113 +2187,889 @@ static bool fit_cubic_to_points(
 			}
 			else {
 				assert((error_max_sq < error_threshold_sq));
-				free(u_prime);
-				free(u);
 				return true;
 			}
 
-			SWAP(double *, u, u_prime);
+			SWAP(real *, u, u_prime);
 		}
-		free(u_prime);
-		free(u);
 
 		return false;
 	}
 	else {
-		free(u);
 		return true;
 	}
 }
 
-static void fit_cubic_to_points_recursive(
-        const double *points_offset,
-        const uint    points_offset_len,
-#ifdef USE_LENGTH_CACHE
+/**
+ * Calculate the tangent at \a split_index where a curve is split in two,
+ * (the end tangent of the left side & the start tangent of the right side).
+ */
+static void points_calc_split_tangent(
+        const real *points_offset, const uint split_index, const uint dims,
+        real r_tan_center[])
+{
+#ifdef USE_VLA
+	real tan_center_a[dims];
+	real tan_center_b[dims];
+#else
+	real *tan_center_a = alloca(sizeof(real) * dims);
+	real *tan_center_b = alloca(sizeof(real) * dims);
+#endif
+
+	const real *pt_a = &points_offset[(split_index - 1) * dims];
+	const real *pt_b = &points_offset[(split_index + 1) * dims];
+	const real *pt   = &points_offset[split_index * dims];
+
+	if (equals_vnvn(pt_a, pt_b, dims)) {
+		pt_a += dims;
+	}
+
+	/* `tan_center = ((pt_a - pt).normalized() + (pt - pt_b).normalized()).normalized()`. */
+	normalize_vn_vnvn(tan_center_a, pt_a, pt, dims);
+	normalize_vn_vnvn(tan_center_b, pt, pt_b, dims);
+	add_vn_vnvn(r_tan_center, tan_center_a, tan_center_b, dims);
+	normalize_vn(r_tan_center, dims);
+}
+
+#ifdef USE_MULTIRES
+
+static void fit_cubic_to_points_subdivide(
+        const real   *points_offset,
+        const uint    points_offset_len,
+#ifdef USE_LENGTH_CACHE
         const double *points_length_cache,
 #endif
-        const double  tan_l[],
-        const double  tan_r[],
-        const double  error_threshold_sq,
+        const real    tan_l[],
+        const real    tan_r[],
+        const real    error_threshold_sq,
         const uint    calc_flag,
         const uint    dims,
+        struct CurveFitContext *ctx,
         /* Fill in the list. */
-        CubicList *clist)
+        CubicList *clist);
+
+/**
+ * Fit cubics to every #MULTIRES_STEP point of the span to find where it needs to be split,
+ * so spans which are too long to fit a single cubic can be split
+ * without evaluating all of their points first.
+ *
+ * \return The number of spans, their end indices are written to `ctx->fit_stack`
+ * (the last span first, see #fit_cubic_to_points_subdivide).
+ */
+static uint fit_cubic_to_points_multires_seed(
+        const real   *points_offset,
+        const uint    points_offset_len,
+        const real    tan_l[],
+        const real    tan_r[],
+        const real    error_threshold_sq,
+        const uint    calc_flag,
+        const uint    dims,
+        struct CurveFitContext *ctx)
 {
-	Cubic *cubic = cubic_alloc(dims);
-	uint split_index;
-	double error_max_sq;
+	const uint coarse_len = ((points_offset_len - 1 + (MULTIRES_STEP - 1)) / MULTIRES_STEP) + 1;
+	real *coarse_points = curve_fit_buffer_ensure(
+	        ctx, &ctx->multires_points, sizeof(real) * coarse_len * dims);
+	for (uint i = 0; i < coarse_len - 1; i++) {
+		copy_vnvn(&coarse_points[i * dims], &points_offset[i * MULTIRES_STEP * dims], dims);
+	}
+	copy_vnvn(&coarse_points[(coarse_len - 1) * dims], &points_offset[(points_offset_len - 1) * dims], dims);
 
-	if (fit_cubic_to_points(
-	        points_offset, points_offset_len,
 #ifdef USE_LENGTH_CACHE
-	        points_length_cache,
+	double *coarse_length_cache = curve_fit_buffer_ensure(
+	        ctx, &ctx->multires_length_cache, sizeof(double) * coarse_len);
+	points_calc_coord_length_cache(coarse_points, coarse_len, dims, coarse_length_cache);
 #endif
-	        tan_l, tan_r,
-	        (calc_flag & CURVE_FIT_CALC_HIGH_QUALIY) ? DBL_EPSILON : error_threshold_sq,
-	        dims,
-	        cubic, &error_max_sq, &split_index) ||
-	    (error_max_sq < error_threshold_sq))
-	{
-		cubic_list_prepend(clist, cubic);
-		return;
+
+	/* Only the spans of the cubics are needed. */
+	CubicList clist;
+	cubic_list_init(&clist, 0, dims, NULL);
+	fit_cubic_to_points_subdivide(
+	        coarse_points, coarse_len,
+#ifdef USE_LENGTH_CACHE
+	        coarse_length_cache,
+#endif
+	        tan_l, tan_r, error_threshold_sq,
+	        calc_flag & ~(CURVE_FIT_CALC_MULTIRES | CURVE_FIT_CALC_PARALLEL),
+	        dims, ctx, &clist);
+
+	const uint spans_len = clist.len;
+	uint *stack = curve_fit_buffer_ensure(ctx, &ctx->fit_stack, sizeof(uint) * spans_len);
+	uint coarse_index = 0;
+	for (uint i = 0; i < spans_len; i++) {
+		coarse_index += clist.orig_index[i + 1];
+		stack[spans_len - (i + 1)] = (coarse_index == coarse_len - 1) ?
+		        (points_offset_len - 1) : (coarse_index * MULTIRES_STEP);
 	}
-	cubic_free(cubic);
+	assert(coarse_index == coarse_len - 1);
+	assert(stack[0] == points_offset_len - 1);
 
+	cubic_list_free(&clist);
 
-	/* Fitting failed -- split at max error point and fit recursively. */
+	return spans_len;
+}
 
-	/* Check splinePoint is not an endpoint?
-	 *
-	 * This assert happens sometimes...
-	 * Look into it but disable for now. Campbell! */
+#endif  /* USE_MULTIRES */
 
-	// assert(split_index > 1)
+/**
+ * Fit cubics to the points, splitting at the point with the largest error
+ * until each cubic is within the error threshold.
+ *
+ * Spans are fitted in order using a stack instead of recursion,
+ * since noisy input may only remove a few points from the span on each split
+ * (recursing close to once per point).
+ *
+ * The stack only stores the end index of each span which hasn't been fitted yet,
+ * the tangent at each end is calculated again from the points once the span is reached.
+ * Since the indices are unique & increasing, the stack never exceeds `points_offset_len - 1` items.
+ */
+static void fit_cubic_to_points_subdivide(
+        const real   *points_offset,
+        const uint    points_offset_len,
+#ifdef USE_LENGTH_CACHE
+        const double *points_length_cache,
+#endif
+        const real    tan_l[],
+        const real    tan_r[],
+        const real    error_threshold_sq,
+        const uint    calc_flag,
+        const uint    dims,
+        struct CurveFitContext *ctx,
+        /* Fill in the list. */
+        CubicList *clist)
+{
+	Cubic *cubic = alloca(cubic_alloc_size(dims));
+	uint split_index;
+	real error_max_sq;
+
+#ifdef USE_PARALLEL
+	const bool use_parallel = (calc_flag & CURVE_FIT_CALC_PARALLEL) != 0;
+#endif
+
+	/* Tangents at the end-points of the current span & the split,
+	 * each uses a buffer which isn't used by the others. */
 #ifdef USE_VLA
-	double tan_center[dims];
+	real tan_buf_a[dims];
+	real tan_buf_b[dims];
+	real tan_buf_c[dims];
 #else
-	double *tan_center = alloca(sizeof(double) * dims);
+	real *tan_buf_a = alloca(sizeof(real) * dims);
+	real *tan_buf_b = alloca(sizeof(real) * dims);
+	real *tan_buf_c = alloca(sizeof(real) * dims);
+#endif
+	const real *span_tan_l = tan_l;
+	const real *span_tan_r = tan_r;
+
+	uint  stack_len = 0;
+#ifdef USE_MULTIRES
+	if ((calc_flag & CURVE_FIT_CALC_MULTIRES) && (points_offset_len >= MULTIRES_POINTS_MIN)) {
+		stack_len = fit_cubic_to_points_multires_seed(
+		        points_offset, points_offset_len, tan_l, tan_r, error_threshold_sq, calc_flag, dims, ctx);
+	}
+#endif
+	uint *stack = ctx->fit_stack.data;
+	uint  stack_len_max = stack_len;
+	uint  stack_alloc = (uint)(ctx->fit_stack.size / sizeof(uint));
+
+	/* The span being fitted. */
+	uint index_l = 0;
+	uint index_r = points_offset_len - 1;
+
+#ifdef USE_MULTIRES
+	if (stack_len != 0) {
+		index_r = stack[--stack_len];
+		if (index_r != points_offset_len - 1) {
+			points_calc_split_tangent(points_offset, index_r, dims, tan_buf_a);
+			span_tan_r = tan_buf_a;
+		}
+	}
 #endif
 
-	const double *pt_a = &points_offset[(split_index - 1) * dims];
-	const double *pt_b = &points_offset[(split_index + 1) * dims];
+	while (true) {
+		const real *span_points = &points_offset[index_l * dims];
+		const uint  span_points_len = index_r - index_l + 1;
 
-	assert(split_index < points_offset_len);
-	if (equals_vnvn(pt_a, pt_b, dims)) {
-		pt_a += dims;
+		if (fit_cubic_to_points(
+		        span_points, span_points_len,
+#ifdef USE_LENGTH_CACHE
+		        points_length_cache + index_l,
+#endif
+		        span_tan_l, span_tan_r,
+		        (calc_flag & CURVE_FIT_CALC_HIGH_QUALIY) ? REAL_EPSILON : error_threshold_sq,
+		        calc_flag,
+		        dims, ctx,
+		        cubic, &error_max_sq, &split_index) ||
+		    (error_max_sq < error_threshold_sq))
+		{
+			cubic_list_append(clist, cubic);
+		}
+		else {
+			/* Fitting failed -- split at max error point. */
+
+			/* Check splinePoint is not an endpoint?
+			 *
+			 * This assert happens sometimes...
+			 * Look into it but disable for now. Campbell! */
+
+			// assert(split_index > 1)
+			assert(split_index < span_points_len);
+			const uint index_split = index_l + split_index;
+
+			/* Both end tangents are still needed when fitting the sides as tasks. */
+			real *tan_center =
+			        ((span_tan_l != tan_buf_a) && (span_tan_r != tan_buf_a)) ? tan_buf_a :
+			        ((span_tan_l != tan_buf_b) && (span_tan_r != tan_buf_b)) ? tan_buf_b : tan_buf_c;
+			points_calc_split_tangent(points_offset, index_split, dims, tan_center);
+
+#ifdef USE_PARALLEL
+			if (use_parallel && (span_points_len >= PARALLEL_SPLIT_POINTS_MIN)) {
+				/* Fit both sides as tasks, each side fills its own list,
+				 * then append them in the same order as the serial code.
+				 * The tasks can't share the context which holds this stack.
+				 *
+				 * Multi-resolution splits are only found once for the whole span (as with the serial code). */
+				const uint calc_flag_task = calc_flag & ~CURVE_FIT_CALC_MULTIRES;
+				CubicList clist_l, clist_r;
+				cubic_list_init(&clist_l, 0, dims, NULL);
+				cubic_list_init(&clist_r, 0, dims, NULL);
+
+#pragma omp task shared(clist_l)
+				{
+					struct CurveFitContext ctx_task;
+					struct CurveFitStats stats_task;
+					curve_fit_context_task_begin(&ctx_task, ctx, &stats_task);
+					fit_cubic_to_points_subdivide(
+					        span_points, split_index + 1,
+#ifdef USE_LENGTH_CACHE
+					        points_length_cache + index_l,
+#endif
+					        span_tan_l, tan_center, error_threshold_sq, calc_flag_task, dims,
+					        &ctx_task, &clist_l);
+					curve_fit_context_task_end(&ctx_task, ctx);
+				}
+
+#pragma omp task shared(clist_r)
+				{
+					struct CurveFitContext ctx_task;
+					struct CurveFitStats stats_task;
+					curve_fit_context_task_begin(&ctx_task, ctx, &stats_task);
+					fit_cubic_to_points_subdivide(
+					        &points_offset[index_split * dims], span_points_len - split_index,
+#ifdef USE_LENGTH_CACHE
+					        points_length_cache + index_split,
+#endif
+					        tan_center, span_tan_r, error_threshold_sq, calc_flag_task, dims,
+					        &ctx_task, &clist_r);
+					curve_fit_context_task_end(&ctx_task, ctx);
+				}
+
+#pragma omp taskwait
+
+				cubic_list_append_list(clist, &clist_l, clist_l.len);
+				cubic_list_append_list(clist, &clist_r, clist_r.len);
+				cubic_list_free(&clist_l);
+				cubic_list_free(&clist_r);
+			}
+			else
+#endif  /* USE_PARALLEL */
+			{
+				/* Fit the left side next, the right side once the left side is done. */
+				if (stack_len == stack_alloc) {
+					stack_alloc = stack_alloc ? (stack_alloc * 2) : 64;
+					stack = curve_fit_buffer_resize(ctx, &ctx->fit_stack, sizeof(uint) * stack_alloc);
+				}
+				assert(stack_len < points_offset_len - 1);
+				stack[stack_len++] = index_r;
+				if (stack_len_max < stack_len) {
+					stack_len_max = stack_len;
+				}
+
+				index_r = index_split;
+				span_tan_r = tan_center;
+				continue;
+			}
+		}
+
+		/* The span is done, move onto the next span. */
+		if (stack_len == 0) {
+			break;
+		}
+
+		index_l = index_r;
+		index_r = stack[--stack_len];
+		span_tan_l = span_tan_r;
+		if (index_r == points_offset_len - 1) {
+			span_tan_r = tan_r;
+		}
+		else {
+			real *tan_next = (span_tan_l == tan_buf_a) ? tan_buf_b : tan_buf_a;
+			points_calc_split_tangent(points_offset, index_r, dims, tan_next);
+			span_tan_r = tan_next;
+		}
 	}
 
-	{
+	if (ctx->stats && (ctx->stats->fit_stack_max < stack_len_max)) {
+		ctx->stats->fit_stack_max = stack_len_max;
+	}
+}
+
+/**
+ * Fit the points between two corners,
+ * the tangents are calculated from the end-points of the span.
+ */
+static void fit_cubic_to_points_span(
+        const real   *points_offset,
+        const uint    points_offset_len,
+#ifdef USE_LENGTH_CACHE
+        double       *points_length_cache,
+#endif
+        const real    error_threshold_sq,
+        const uint    calc_flag,
+        const uint    dims,
+        struct CurveFitContext *ctx,
+        /* Fill in the list. */
+        CubicList *clist)
+{
 #ifdef USE_VLA
-		double tan_center_a[dims];
-		double tan_center_b[dims];
+	real tan_l[dims];
+	real tan_r[dims];
 #else
-		double *tan_center_a = alloca(sizeof(double) * dims);
-		double *tan_center_b = alloca(sizeof(double) * dims);
+	real *tan_l = alloca(sizeof(real) * dims);
+	real *tan_r = alloca(sizeof(real) * dims);
+#endif
+
+	const real *pt_l = &points_offset[0];
+	const real *pt_r = &points_offset[(points_offset_len - 1) * dims];
+	const real *pt_l_next = pt_l + dims;
+	const real *pt_r_prev = pt_r - dims;
+
+	/* `tan_l = (pt_l - pt_l_next).normalized();`
+	 * `tan_r = (pt_r_prev - pt_r).normalized();` */
+	normalize_vn_vnvn(tan_l, pt_l, pt_l_next, dims);
+	normalize_vn_vnvn(tan_r, pt_r_prev, pt_r, dims);
+
+#ifdef USE_LENGTH_CACHE
+	points_calc_coord_length_cache(
+	        points_offset, points_offset_len, dims,
+	        points_length_cache);
 #endif
-		const double *pt   = &points_offset[split_index * dims];
 
-		/* `tan_center = ((pt_a - pt).normalized() + (pt - pt_b).normalized()).normalized()`. */
-		normalize_vn_vnvn(tan_center_a, pt_a, pt, dims);
-		normalize_vn_vnvn(tan_center_b, pt, pt_b, dims);
-		add_vn_vnvn(tan_center, tan_center_a, tan_center_b, dims);
-		normalize_vn(tan_center, dims);
+#ifdef USE_PARALLEL
+	/* Threads are only used once a split creates tasks,
+	 * when called from a task, these run in the existing team of threads. */
+	if ((calc_flag & CURVE_FIT_CALC_PARALLEL) &&
+	    (points_offset_len >= PARALLEL_SPLIT_POINTS_MIN) &&
+	    (omp_in_parallel() == 0))
+	{
+#pragma omp parallel
+#pragma omp single
+		fit_cubic_to_points_subdivide(
+		        points_offset, points_offset_len,
+#ifdef USE_LENGTH_CACHE
+		        points_length_cache,
+#endif
+		        tan_l, tan_r, error_threshold_sq, calc_flag, dims, ctx, clist);
+		return;
 	}
+#endif
 
-	fit_cubic_to_points_recursive(
-	        points_offset, split_index + 1,
+	fit_cubic_to_points_subdivide(
+	        points_offset, points_offset_len,
 #ifdef USE_LENGTH_CACHE
 	        points_length_cache,
 #endif
-	        tan_l, tan_center, error_threshold_sq, calc_flag, dims, clist);
-	fit_cubic_to_points_recursive(
-	        &points_offset[split_index * dims], points_offset_len - split_index,
+	        tan_l, tan_r, error_threshold_sq, calc_flag, dims, ctx, clist);
+}
+
+#ifdef USE_PARALLEL
+/**
+ * A version of the loop over corners in #curve_fit_cubic_to_points_db,
+ * where each span between corners is fitted as a task (they don't depend on each other).
+ *
+ * \param ctx: Only used for statistics (each task uses its own context).
+ * \param r_span_clist: A list for each span, to be joined by the caller.
+ */
+static void fit_cubic_to_points_span_parallel(
+        const real   *points,
+        const uint   *corners,
+        const uint    corners_len,
+        const real    error_threshold_sq,
+        const uint    calc_flag,
+        const uint    dims,
+        struct CurveFitContext *ctx,
+
+        CubicList *r_span_clist)
+{
+#pragma omp parallel
+#pragma omp single
+	for (uint i = 1; i < corners_len; i++) {
+		const uint points_offset_len = corners[i] - corners[i - 1] + 1;
+		const uint first_point = corners[i - 1];
+
+		assert(points_offset_len >= 1);
+		if (points_offset_len > 1) {
+#pragma omp task firstprivate(points_offset_len, first_point, i)
+			{
+				struct CurveFitContext ctx_task;
+				struct CurveFitStats stats_task;
+				curve_fit_context_task_begin(&ctx_task, ctx, &stats_task);
+#ifdef USE_LENGTH_CACHE
+				double *points_length_cache = curve_fit_buffer_ensure(
+				        &ctx_task, &ctx_task.length_cache, sizeof(double) * points_offset_len);
+#endif
+				fit_cubic_to_points_span(
+				        &points[first_point * dims], points_offset_len,
+#ifdef USE_LENGTH_CACHE
+				        points_length_cache,
+#endif
+				        error_threshold_sq, calc_flag, dims, &ctx_task, &r_span_clist[i - 1]);
+				curve_fit_context_task_end(&ctx_task, ctx);
+			}
+		}
+	}
+}
+#endif  /* USE_PARALLEL */
+
+/** \} */
+
+
+/* -------------------------------------------------------------------- */
+
+/** \name Budgeted Curve-Fitting
+ *
+ * Fit all spans between corners, then split the span with the largest error
+ * until the spans are within the error threshold or the budget runs out.
+ *
+ * With an unlimited budget the result matches #fit_cubic_to_points_subdivide,
+ * since each span is fitted the same way, only the order spans are split in differs.
+ * \{ */
+
+/** Marks the end of the #FitSpan list. */
+#define FIT_SPAN_NONE ((uint)-1)
+
+/**
+ * A span of points which has been fitted (stored in order along the curve as a linked list),
+ * its tangents & cubic are stored in separate arrays.
+ */
+typedef struct FitSpan {
+	/** The next span along the curve (or #FIT_SPAN_NONE). */
+	uint next;
+	/** Points this span starts & ends at. */
+	uint index_l, index_r;
+	/**
+	 * Index of the span between corners this is a part of,
+	 * each has its own length cache, stored after the previous (see #fit_budget_span_calc).
+	 */
+	uint corner_span;
+	/** From #fit_cubic_to_points (when the span needs to be split). */
+	uint split_index;
+	real error_max_sq;
+} FitSpan;
+
+typedef struct FitBudget {
+	const real   *points;
+#ifdef USE_LENGTH_CACHE
+	const double *length_cache;
+#endif
+	real          error_threshold_sq;
+	uint          calc_flag;
+	uint          dims;
+	struct CurveFitContext *ctx;
+
+	FitSpan *spans;
+	uint     spans_len;
+#ifndef NDEBUG
+	uint     spans_max;
+#endif
+	/** Stride #cubic_alloc_size. */
+	char    *span_cubics;
+	/** `tan_l` & `tan_r` for each span. */
+	real    *span_tangents;
+
+	/** Spans outside the error threshold, the largest error first. */
+	Heap    *heap;
+	/** The number of points cubics have been fitted to (the cost of fitting). */
+	size_t   fit_points;
+} FitBudget;
+
+#define FIT_BUDGET_SPAN_CUBIC(fb, span_index) \
+	((Cubic *)&(fb)->span_cubics[(size_t)(span_index) * cubic_alloc_size((fb)->dims)])
+#define FIT_BUDGET_SPAN_TAN_L(fb, span_index) \
+	(&(fb)->span_tangents[(size_t)(span_index) * 2 * (fb)->dims])
+#define FIT_BUDGET_SPAN_TAN_R(fb, span_index) \
+	(FIT_BUDGET_SPAN_TAN_L(fb, span_index) + (fb)->dims)
+
+/**
+ * Fit the span (its points & tangents must be set),
+ * adding it to the heap when it needs to be split.
+ */
+static void fit_budget_span_calc(FitBudget *fb, const uint span_index)
+{
+	const uint dims = fb->dims;
+	FitSpan *span = &fb->spans[span_index];
+	const uint span_points_len = span->index_r - span->index_l + 1;
+
+	const bool is_fit = fit_cubic_to_points(
+	        &fb->points[span->index_l * dims], span_points_len,
 #ifdef USE_LENGTH_CACHE
-	        points_length_cache + split_index,
+	        &fb->length_cache[span->index_l + span->corner_span],
 #endif
-	        tan_center, tan_r, error_threshold_sq, calc_flag, dims, clist);
+	        FIT_BUDGET_SPAN_TAN_L(fb, span_index), FIT_BUDGET_SPAN_TAN_R(fb, span_index),
+	        (fb->calc_flag & CURVE_FIT_CALC_HIGH_QUALIY) ? REAL_EPSILON : fb->error_threshold_sq,
+	        fb->calc_flag,
+	        dims, fb->ctx,
+	        FIT_BUDGET_SPAN_CUBIC(fb, span_index), &span->error_max_sq, &span->split_index);
+
+	if (!(is_fit || (span->error_max_sq < fb->error_threshold_sq))) {
+		/* Negate so the largest error is split first. */
+		HEAP_insert(fb->heap, -span->error_max_sq, span);
+	}
+	fb->fit_points += span_points_len;
+}
+
+/**
+ * Split the span with the largest error, fitting both sides.
+ *
+ * \return false when the budget doesn't allow for it.
+ */
+static bool fit_budget_span_split(FitBudget *fb, const size_t fit_points_budget)
+{
+	const uint dims = fb->dims;
+	FitSpan *span_l = HEAP_node_ptr(HEAP_top(fb->heap));
+
+	/* Both sides include the point at the split. */
+	if (fb->fit_points + (span_l->index_r - span_l->index_l + 2) > fit_points_budget) {
+		return false;
+	}
+	HEAP_popmin(fb->heap);
+
+	const uint span_l_index = (uint)(span_l - fb->spans);
+	const uint span_r_index = fb->spans_len++;
+	FitSpan *span_r = &fb->spans[span_r_index];
+	assert(span_r_index < fb->spans_max);
+
+	const uint index_split = span_l->index_l + span_l->split_index;
+	assert(index_split < span_l->index_r);
+
+	span_r->next = span_l->next;
+	span_r->index_l = index_split;
+	span_r->index_r = span_l->index_r;
+	span_r->corner_span = span_l->corner_span;
+
+	span_l->next = span_r_index;
+	span_l->index_r = index_split;
+
+	real *tan_center = FIT_BUDGET_SPAN_TAN_L(fb, span_r_index);
+	points_calc_split_tangent(fb->points, index_split, dims, tan_center);
+	copy_vnvn(FIT_BUDGET_SPAN_TAN_R(fb, span_r_index), FIT_BUDGET_SPAN_TAN_R(fb, span_l_index), dims);
+	copy_vnvn(FIT_BUDGET_SPAN_TAN_R(fb, span_l_index), tan_center, dims);
+
+	fit_budget_span_calc(fb, span_l_index);
+	fit_budget_span_calc(fb, span_r_index);
+	return true;
+}
+
+/**
+ * A version of the loop over corners in #curve_fit_cubic_to_points_db
+ * which stops splitting once cubics have been fitted to \a fit_points_budget points.
+ *
+ * \return true when all cubics are within the error threshold.
+ */
+static bool fit_cubic_to_points_budget(
+        const real   *points,
+        const uint    points_len,
+        const uint   *corners,
+        const uint    corners_len,
+        const real    error_threshold_sq,
+        const uint    calc_flag,
+        const uint    fit_points_budget,
+        const uint    dims,
+        struct CurveFitContext *ctx,
+        /* Fill in the list. */
+        CubicList *clist,
+        uint *corner_index_array, uint *r_corner_index)
+{
+	/* Each split adds one span, fitting at least 4 points (a span of 3 points split in two). */
+	const uint corner_spans_len = corners_len - 1;
+	uint spans_max = corner_spans_len + (fit_points_budget / 4);
+	if (spans_max > points_len - 1) {
+		spans_max = points_len - 1;
+	}
+
+	/* Kept in the context since it's always empty between calls. */
+	if (ctx->budget_heap == NULL) {
+		ctx->budget_heap = HEAP_new(0);
+	}
+
+	FitBudget fb = {
+		.points = points,
+		.error_threshold_sq = error_threshold_sq,
+		/* Splitting doesn't use tasks. */
+		.calc_flag = calc_flag & ~CURVE_FIT_CALC_PARALLEL,
+		.dims = dims,
+		.ctx = ctx,
+		.spans = curve_fit_buffer_ensure(ctx, &ctx->budget_spans, sizeof(FitSpan) * spans_max),
+		.spans_len = 0,
+#ifndef NDEBUG
+		.spans_max = spans_max,
+#endif
+		.span_cubics = curve_fit_buffer_ensure(
+		        ctx, &ctx->budget_span_cubics, cubic_alloc_size(dims) * spans_max),
+		.span_tangents = curve_fit_buffer_ensure(
+		        ctx, &ctx->budget_span_tangents, sizeof(real) * 2 * dims * spans_max),
+		.heap = ctx->budget_heap,
+		.fit_points = 0,
+	};
+
+#ifdef USE_LENGTH_CACHE
+	/* Each span between corners has its own lengths, since they start at zero. */
+	double *length_cache = curve_fit_buffer_ensure(
+	        ctx, &ctx->length_cache, sizeof(double) * (points_len + corner_spans_len));
+	fb.length_cache = length_cache;
+#endif
+
+	/* Fit each span between corners, this is done irrespective of the budget. */
+	uint span_prev = FIT_SPAN_NONE;
+	uint span_first = FIT_SPAN_NONE;
+	for (uint i = 1; i < corners_len; i++) {
+		const uint points_offset_len = corners[i] - corners[i - 1] + 1;
+		const uint first_point = corners[i - 1];
+
+		assert(points_offset_len >= 1);
+		if (points_offset_len > 1) {
+			const real *pt_l = &points[first_point * dims];
+			const real *pt_r = &points[corners[i] * dims];
+			const uint span_index = fb.spans_len++;
+			FitSpan *span = &fb.spans[span_index];
+			span->next = FIT_SPAN_NONE;
+			span->index_l = first_point;
+			span->index_r = corners[i];
+			span->corner_span = i - 1;
+
+			/* Matches #fit_cubic_to_points_span. */
+			normalize_vn_vnvn(FIT_BUDGET_SPAN_TAN_L(&fb, span_index), pt_l, pt_l + dims, dims);
+			normalize_vn_vnvn(FIT_BUDGET_SPAN_TAN_R(&fb, span_index), pt_r - dims, pt_r, dims);
+
+#ifdef USE_LENGTH_CACHE
+			points_calc_coord_length_cache(
+			        pt_l, points_offset_len, dims,
+			        &length_cache[first_point + span->corner_span]);
+#endif
+
+			if (span_prev != FIT_SPAN_NONE) {
+				fb.spans[span_prev].next = span_index;
+			}
+			else {
+				span_first = span_index;
+			}
+			span_prev = span_index;
+
+			fit_budget_span_calc(&fb, span_index);
+		}
+	}
+
+	/* Split the largest error first. */
+	while (HEAP_is_empty(fb.heap) == false) {
+		if (!fit_budget_span_split(&fb, fit_points_budget)) {
+			break;
+		}
+	}
+
+	const bool is_complete = HEAP_is_empty(fb.heap);
+	HEAP_clear(fb.heap, NULL);
+
+	/* Add the cubics in order. */
+	uint span_index = span_first;
+	for (uint i = 1; i < corners_len; i++) {
+		while ((span_index != FIT_SPAN_NONE) && (fb.spans[span_index].index_r <= corners[i])) {
+			cubic_list_append(clist, FIT_BUDGET_SPAN_CUBIC(&fb, span_index));
+			span_index = fb.spans[span_index].next;
+		}
+		if (corner_index_array) {
+			corner_index_array[(*r_corner_index)++] = clist->len;
+		}
+	}
+	assert(span_index == FIT_SPAN_NONE);
+
+	return is_complete;
+}
+
+#undef FIT_BUDGET_SPAN_CUBIC
+#undef FIT_BUDGET_SPAN_TAN_L
+#undef FIT_BUDGET_SPAN_TAN_R
+
+/** \} */
+
+
+/* -------------------------------------------------------------------- */
+
+/** \name Point Decimation
+ *
+ * Remove points before fitting for #CURVE_FIT_CALC_DECIMATE.
+ *
+ * This runs in two passes, each using half the error threshold:
+ *
+ * - Points close to the previously kept point are removed (radial distance).
+ * - Points close to the line between the points either side of them are removed
+ *   (similar to Douglas-Peucker, extending the line from each kept point until a point is too far from it).
+ *
+ * So removed points are within the error threshold of the lines between the kept points.
+ * \{ */
+
+/**
+ * Limit the number of points a line may span in the second pass,
+ * since all points along the line are checked each time it's extended
+ * (keeping the cost linear).
+ */
+#define DECIMATE_SPAN_LEN_MAX 32
+
+static real dist_squared_to_line_segment_vn(
+        const real p[], const real l0[], const real l1[],
+        const uint dims)
+{
+	real l_len_sq = 0.0;
+	real l_dot = 0.0;
+	for (uint j = 0; j < dims; j++) {
+		const real l_d = l1[j] - l0[j];
+		l_len_sq += l_d * l_d;
+		l_dot += l_d * (p[j] - l0[j]);
+	}
+
+	if ((l_dot <= 0.0) || (l_len_sq == 0.0)) {
+		return len_squared_vnvn(p, l0, dims);
+	}
+	else if (l_dot >= l_len_sq) {
+		return len_squared_vnvn(p, l1, dims);
+	}
+
+	const real fac = l_dot / l_len_sq;
+	real dist_sq = 0.0;
+	for (uint j = 0; j < dims; j++) {
+		dist_sq += sq((p[j] - l0[j]) - ((l1[j] - l0[j]) * fac));
+	}
+	return dist_sq;
+}
+
+/**
+ * Check the points between \a index[span_l] & \a index[span_r]
+ * are within the error threshold of the line between them.
+ */
+static bool decimate_span_is_within(
+        const real *points, const uint *index,
+        const uint span_l, const uint span_r,
+        const real error_threshold_sq,
+        const uint dims)
+{
+	const real *p_l = &points[index[span_l] * dims];
+	const real *p_r = &points[index[span_r] * dims];
+	for (uint i = span_l + 1; i < span_r; i++) {
+		if (dist_squared_to_line_segment_vn(&points[index[i] * dims], p_l, p_r, dims) > error_threshold_sq) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Remove points which are within \a error_threshold of the lines between the remaining points.
+ *
+ * \param corners, corners_len: Points which are always kept (in ascending order, may be NULL),
+ * the first & last points are always kept.
+ *
+ * \param r_points, r_points_len: The remaining points.
+ * \param r_corners: \a corners as indices into \a r_points (when \a corners isn't NULL).
+ * \return the index of each remaining point in \a points.
+ *
+ * \note The resulting arrays are stored in the context.
+ */
+const uint *curve_fit_points_decimate_db(
+        struct CurveFitContext *ctx,
+        const real   *points,
+        const uint    points_len,
+        const uint    dims,
+        const real    error_threshold,
+        const uint   *corners,
+        const uint    corners_len,
+        const real  **r_points, uint *r_points_len,
+        const uint  **r_corners)
+{
+	assert(points_len != 0);
+
+	uint *index = curve_fit_buffer_ensure(ctx, &ctx->decimate_index, sizeof(uint) * points_len);
+	uint *corners_index = NULL;
+	if (corners) {
+		corners_index = curve_fit_buffer_ensure(ctx, &ctx->decimate_corners, sizeof(uint) * corners_len);
+	}
+	const real error_threshold_sq = sq(error_threshold / 2);
+
+	/* Remove points close to the previous point. */
+	uint index_len = 0;
+	{
+		uint corner_i = 0;
+		for (uint i = 0; i < points_len; i++) {
+			bool is_keep = (i == 0) || (i == points_len - 1);
+			while ((corner_i < corners_len) && (corners[corner_i] == i)) {
+				corners_index[corner_i++] = index_len;
+				is_keep = true;
+			}
+			if (is_keep ||
+			    (len_squared_vnvn(&points[i * dims], &points[index[index_len - 1] * dims], dims) > error_threshold_sq))
+			{
+				index[index_len++] = i;
+			}
+		}
+		assert(corner_i == corners_len);
+	}
+
+	/* Remove points close to the line between the points either side,
+	 * writing the points which are kept back into `index` (which is never ahead of `span_l`). */
+	if (index_len > 2) {
+		uint corner_i = 0;
+		while ((corner_i < corners_len) && (corners_index[corner_i] == 0)) {
+			corner_i++;
+		}
 
+		uint index_len_new = 1;
+		uint span_l = 0;
+		while (span_l != index_len - 1) {
+			uint span_r_max = span_l + DECIMATE_SPAN_LEN_MAX;
+			if (span_r_max > index_len - 1) {
+				span_r_max = index_len - 1;
+			}
+			if ((corner_i < corners_len) && (span_r_max > corners_index[corner_i])) {
+				span_r_max = corners_index[corner_i];
+			}
+
+			uint span_r = span_l + 1;
+			while ((span_r < span_r_max) &&
+			       decimate_span_is_within(points, index, span_l, span_r + 1, error_threshold_sq, dims))
+			{
+				span_r++;
+			}
+
+			while ((corner_i < corners_len) && (corners_index[corner_i] == span_r)) {
+				corners_index[corner_i++] = index_len_new;
+			}
+			index[index_len_new++] = index[span_r];
+			span_l = span_r;
+		}
+		assert(corner_i == corners_len);
+		index_len = index_len_new;
+	}
+
+	real *points_decimate = curve_fit_buffer_ensure(
+	        ctx, &ctx->decimate_points, sizeof(real) * index_len * dims);
+	for (uint i = 0; i < index_len; i++) {
+		copy_vnvn(&points_decimate[i * dims], &points[index[i] * dims], dims);
+	}
+
+	*r_points = points_decimate;
+	*r_points_len = index_len;
+	*r_corners = corners_index;
+	return index;
 }
 
+#undef DECIMATE_SPAN_LEN_MAX
+
 /** \} */
 
 
@@ -1268,20 +3083,42 @@ static void fit_cubic_to_points_recursive(
  *
  * Take an array of 3d points.
  * return the cubic splines
+ *
+ * \param use_fit_budget, fit_points_budget, r_is_complete: Limit the work done fitting cubics,
+ * see #curve_fit_cubic_to_points_budget_db.
  */
-int curve_fit_cubic_to_points_db(
-        const double *points,
-        const uint    points_len,
+static int cubic_to_points(
+        const real   *points,
+        uint          points_len,
         const uint    dims,
-        const double  error_threshold,
+        real          error_threshold,
         const uint    calc_flag,
         const uint   *corners,
         uint          corners_len,
+        const bool    use_fit_budget,
+        const uint    fit_points_budget,
 
-        double **r_cubic_array, uint *r_cubic_array_len,
+        real **r_cubic_array, uint *r_cubic_array_len,
         uint **r_cubic_orig_index,
-        uint **r_corner_index_array, uint *r_corner_index_len)
+        uint **r_corner_index_array, uint *r_corner_index_len,
+        int *r_is_complete,
+        struct CurveFitContext *ctx)
 {
+	struct CurveFitContext ctx_local;
+	if (ctx == NULL) {
+		ctx = curve_fit_context_init(&ctx_local);
+	}
+
+	/* Maps the decimated points back to the input points. */
+	const uint *decimate_index = NULL;
+	if ((calc_flag & CURVE_FIT_CALC_DECIMATE) && (points_len > 2)) {
+		const real error_threshold_decimate = error_threshold * (real)ctx->decimate_factor;
+		decimate_index = curve_fit_points_decimate_db(
+		        ctx, points, points_len, dims, error_threshold_decimate, corners, corners_len,
+		        &points, &points_len, &corners);
+		error_threshold -= error_threshold_decimate;
+	}
+
 	uint corners_buf[2];
 	if (corners == NULL) {
 		assert(corners_len == 0);
@@ -1291,283 +3128,514 @@ int curve_fit_cubic_to_points_db(
 		corners_len = 2;
 	}
 
-	CubicList clist = {0};
-	clist.dims = dims;
-
-#ifdef USE_VLA
-	double tan_l[dims];
-	double tan_r[dims];
-#else
-	double *tan_l = alloca(sizeof(double) * dims);
-	double *tan_r = alloca(sizeof(double) * dims);
-#endif
-
-#ifdef USE_LENGTH_CACHE
-	double *points_length_cache = NULL;
-	uint    points_length_cache_len_alloc = 0;
-#endif
+	CubicList clist;
+	cubic_list_init(&clist, corners_len - 1, dims, ctx);
 
 	uint *corner_index_array = NULL;
 	uint  corner_index = 0;
-	if (r_corner_index_array && (corners != corners_buf)) {
-		corner_index_array = malloc(sizeof(uint) * corners_len);
-		corner_index_array[corner_index++] = corners[0];
+	const bool use_corner_index = r_corner_index_array && (corners != corners_buf);
+	if (use_corner_index) {
+		corner_index_array = curve_fit_output_alloc(ctx, CURVE_FIT_OUTPUT_CORNER_INDEX, sizeof(uint) * corners_len);
+		if (corner_index_array) {
+			corner_index_array[corner_index++] = corners[0];
+		}
 	}
 
-	const double error_threshold_sq = sq(error_threshold);
+	const real error_threshold_sq = sq(error_threshold);
+	bool is_complete = true;
 
-	for (uint i = 1; i < corners_len; i++) {
-		const uint points_offset_len = corners[i] - corners[i - 1] + 1;
-		const uint first_point = corners[i - 1];
+	if (use_fit_budget && (points_len > 1)) {
+		is_complete = fit_cubic_to_points_budget(
+		        points, points_len, corners, corners_len, error_threshold_sq, calc_flag, fit_points_budget, dims, ctx,
+		        &clist, corner_index_array, &corner_index);
+	}
+	else
+#ifdef USE_PARALLEL
+	if ((calc_flag & CURVE_FIT_CALC_PARALLEL) && (corners_len > 2)) {
+		CubicList *span_clist = malloc(sizeof(*span_clist) * (corners_len - 1));
+		for (uint i = 1; i < corners_len; i++) {
+			cubic_list_init(&span_clist[i - 1], 0, dims, NULL);
+		}
 
-		assert(points_offset_len >= 1);
-		if (points_offset_len > 1) {
-			const double *pt_l = &points[first_point * dims];
-			const double *pt_r = &points[(first_point + points_offset_len - 1) * dims];
-			const double *pt_l_next = pt_l + dims;
-			const double *pt_r_prev = pt_r - dims;
+		fit_cubic_to_points_span_parallel(
+		        points, corners, corners_len, error_threshold_sq, calc_flag, dims, ctx,
+		        span_clist);
 
-			/* `tan_l = (pt_l - pt_l_next).normalized();`
-			 * `tan_r = (pt_r_prev - pt_r).normalized();` */
-			normalize_vn_vnvn(tan_l, pt_l, pt_l_next, dims);
-			normalize_vn_vnvn(tan_r, pt_r_prev, pt_r, dims);
+		/* Join the lists in order. */
+		for (uint i = 1; i < corners_len; i++) {
+			cubic_list_append_list(&clist, &span_clist[i - 1], span_clist[i - 1].len);
+			cubic_list_free(&span_clist[i - 1]);
+			if (corner_index_array) {
+				corner_index_array[corner_index++] = clist.len;
+			}
+		}
+		free(span_clist);
+	}
+	else
+#endif  /* USE_PARALLEL */
+	{
+		for (uint i = 1; i < corners_len; i++) {
+			const uint points_offset_len = corners[i] - corners[i - 1] + 1;
+			const uint first_point = corners[i - 1];
 
+			assert(points_offset_len >= 1);
+			if (points_offset_len > 1) {
 #ifdef USE_LENGTH_CACHE
-			if (points_length_cache_len_alloc < points_offset_len) {
-				if (points_length_cache) {
-					free(points_length_cache);
-				}
-				points_length_cache = malloc(sizeof(double) * points_offset_len);
-			}
-			points_calc_coord_length_cache(
-			        &points[first_point * dims], points_offset_len, dims,
-			        points_length_cache);
+				double *points_length_cache = curve_fit_buffer_ensure(
+				        ctx, &ctx->length_cache, sizeof(double) * points_offset_len);
 #endif
-
-			fit_cubic_to_points_recursive(
-			        &points[first_point * dims], points_offset_len,
+				fit_cubic_to_points_span(
+				        &points[first_point * dims], points_offset_len,
 #ifdef USE_LENGTH_CACHE
-			        points_length_cache,
+				        points_length_cache,
 #endif
-			        tan_l, tan_r, error_threshold_sq, calc_flag, dims, &clist);
-		}
-		else if (points_len == 1) {
-			assert(points_offset_len == 1);
-			assert(corners_len == 2);
-			assert(corners[0] == 0);
-			assert(corners[1] == 0);
-			const double *pt = &points[0];
-			Cubic *cubic = cubic_alloc(dims);
-			cubic_init(cubic, pt, pt, pt, pt, dims);
-			cubic_list_prepend(&clist, cubic);
-		}
+				        error_threshold_sq, calc_flag, dims, ctx, &clist);
+			}
+			else if (points_len == 1) {
+				assert(points_offset_len == 1);
+				assert(corners_len == 2);
+				assert(corners[0] == 0);
+				assert(corners[1] == 0);
+				const real *pt = &points[0];
+				Cubic *cubic = alloca(cubic_alloc_size(dims));
+				cubic_init(cubic, pt, pt, pt, pt, dims);
+#ifdef USE_ORIG_INDEX_DATA
+				cubic->orig_span = 0;
+#endif
+				cubic_list_append(&clist, cubic);
+			}
 
-		if (corner_index_array) {
-			corner_index_array[corner_index++] = clist.len;
+			if (corner_index_array) {
+				corner_index_array[corner_index++] = clist.len;
+			}
 		}
 	}
 
-#ifdef USE_LENGTH_CACHE
-	if (points_length_cache) {
-		free(points_length_cache);
-	}
-#endif
-
-#ifdef USE_ORIG_INDEX_DATA
-	uint *cubic_orig_index = NULL;
-	if (r_cubic_orig_index) {
-		cubic_orig_index = malloc(sizeof(uint) * (clist.len + 1));
-	}
-#else
+#ifndef USE_ORIG_INDEX_DATA
 	*r_cubic_orig_index = NULL;
 #endif
 
-	/* Allocate a contiguous array and free the linked list. */
+	/* The cubics are already stored contiguously, pass ownership of the array. */
+	*r_cubic_array_len = clist.len + 1;
 	*r_cubic_array = cubic_list_as_array(
 	        &clist
 #ifdef USE_ORIG_INDEX_DATA
-	        , corners[corners_len - 1], cubic_orig_index
+	        , corners[0], r_cubic_orig_index
 #endif
 	        );
-	*r_cubic_array_len = clist.len + 1;
-
-	cubic_list_clear(&clist);
 
+	bool is_output_alloc_fail = (*r_cubic_array == NULL);
 #ifdef USE_ORIG_INDEX_DATA
-	if (cubic_orig_index) {
-		*r_cubic_orig_index = cubic_orig_index;
+	if (r_cubic_orig_index && (*r_cubic_orig_index == NULL)) {
+		is_output_alloc_fail = true;
+	}
+	else if (r_cubic_orig_index && decimate_index) {
+		uint *cubic_orig_index = *r_cubic_orig_index;
+		for (uint i = 0; i < *r_cubic_array_len; i++) {
+			cubic_orig_index[i] = decimate_index[cubic_orig_index[i]];
+		}
 	}
 #endif
 
-	if (corner_index_array) {
-		assert(corner_index == corners_len);
+	if (use_corner_index) {
+		if (corner_index_array) {
+			assert(corner_index == corners_len);
+		}
+		else {
+			is_output_alloc_fail = true;
+		}
 		*r_corner_index_array = corner_index_array;
-		*r_corner_index_len = corner_index;
+		*r_corner_index_len = corners_len;
 	}
 
-	return 0;
+	if (r_is_complete) {
+		*r_is_complete = is_complete;
+	}
+
+	if (ctx == &ctx_local) {
+		curve_fit_context_clear(&ctx_local);
+	}
+
+	return is_output_alloc_fail ? 1 : 0;
 }
 
-/**
- * A version of #curve_fit_cubic_to_points_db to handle floats
- */
-int curve_fit_cubic_to_points_fl(
-        const float  *points,
+int curve_fit_cubic_to_points_db(
+        const real   *points,
         const uint    points_len,
         const uint    dims,
-        const float   error_threshold,
+        const real    error_threshold,
         const uint    calc_flag,
         const uint   *corners,
-        const uint    corners_len,
+        uint          corners_len,
 
-        float **r_cubic_array, uint *r_cubic_array_len,
+        real **r_cubic_array, uint *r_cubic_array_len,
         uint **r_cubic_orig_index,
-        uint **r_corner_index_array, uint *r_corner_index_len)
+        uint **r_corner_index_array, uint *r_corner_index_len,
+        struct CurveFitContext *ctx)
 {
-	const uint points_flat_len = points_len * dims;
-	double *points_db = malloc(sizeof(double) * points_flat_len);
-
-	copy_vndb_vnfl(points_db, points, points_flat_len);
-
-	double *cubic_array_db = NULL;
-	float  *cubic_array_fl = NULL;
-	uint    cubic_array_len = 0;
-
-	int result = curve_fit_cubic_to_points_db(
-	        points_db, points_len, dims, error_threshold, calc_flag, corners, corners_len,
-	        &cubic_array_db, &cubic_array_len,
+	return cubic_to_points(
+	        points, points_len, dims, error_threshold, calc_flag, corners, corners_len,
+	        false, 0,
+	        r_cubic_array, r_cubic_array_len,
 	        r_cubic_orig_index,
-	        r_corner_index_array, r_corner_index_len);
-	free(points_db);
-
-	if (!result) {
-		uint cubic_array_flat_len = cubic_array_len * 3 * dims;
-		cubic_array_fl = malloc(sizeof(float) * cubic_array_flat_len);
-		for (uint i = 0; i < cubic_array_flat_len; i++) {
-			cubic_array_fl[i] = (float)cubic_array_db[i];
-		}
-		free(cubic_array_db);
-	}
+	        r_corner_index_array, r_corner_index_len,
+	        NULL,
+	        ctx);
+}
 
-	*r_cubic_array = cubic_array_fl;
-	*r_cubic_array_len = cubic_array_len;
+int curve_fit_cubic_to_points_budget_db(
+        const real   *points,
+        const uint    points_len,
+        const uint    dims,
+        const real    error_threshold,
+        const uint    calc_flag,
+        const uint   *corners,
+        uint          corners_len,
+        const uint    fit_points_budget,
 
-	return result;
+        real **r_cubic_array, uint *r_cubic_array_len,
+        uint **r_cubic_orig_index,
+        uint **r_corner_index_array, uint *r_corner_index_len,
+        int *r_is_complete,
+        struct CurveFitContext *ctx)
+{
+	return cubic_to_points(
+	        points, points_len, dims, error_threshold, calc_flag, corners, corners_len,
+	        true, fit_points_budget,
+	        r_cubic_array, r_cubic_array_len,
+	        r_cubic_orig_index,
+	        r_corner_index_array, r_corner_index_len,
+	        r_is_complete,
+	        ctx);
 }
 
 /**
  * Fit a single cubic to points.
  */
 int curve_fit_cubic_to_points_single_db(
-        const double *points,
+        const real   *points,
         const uint    points_len,
-        const double *points_length_cache,
+        const real   *points_length_cache,
         const uint    dims,
-        const double  error_threshold,
-        const double tan_l[],
-        const double tan_r[],
-
-        double  r_handle_l[],
-        double  r_handle_r[],
-        double *r_error_max_sq,
-        uint   *r_error_index)
+        const real    error_threshold,
+        const uint    calc_flag,
+        const real tan_l[],
+        const real tan_r[],
+
+        real    r_handle_l[],
+        real    r_handle_r[],
+        real   *r_error_max_sq,
+        uint   *r_error_index,
+        struct CurveFitContext *ctx)
 {
+	struct CurveFitContext ctx_local;
+	if (ctx == NULL) {
+		ctx = curve_fit_context_init(&ctx_local);
+	}
+
 	Cubic *cubic = alloca(cubic_alloc_size(dims));
 
+	if (ctx->stats) {
+		ctx->stats->fit_single_count += 1;
+	}
+
 	/* In this instance there are no advantage in using length cache,
 	 * since we're not recursively calculating values. */
 #ifdef USE_LENGTH_CACHE
-	double *points_length_cache_alloc = NULL;
+	double *points_length_accum = curve_fit_buffer_ensure(
+	        ctx, &ctx->length_cache, sizeof(double) * points_len);
 	if (points_length_cache == NULL) {
-		points_length_cache_alloc = malloc(sizeof(double) * points_len);
 		points_calc_coord_length_cache(
 		        points, points_len, dims,
-		        points_length_cache_alloc);
-		points_length_cache = points_length_cache_alloc;
+		        points_length_accum);
 	}
+	else {
+		/* Accumulate the caller's lengths between points. */
+		double length_accum = 0.0;
+		points_length_accum[0] = 0.0;
+		for (uint i = 1; i < points_len; i++) {
+			length_accum += points_length_cache[i];
+			points_length_accum[i] = length_accum;
+		}
+	}
+#else
+	(void)points_length_cache;
 #endif
 
 	fit_cubic_to_points(
 	        points, points_len,
 #ifdef USE_LENGTH_CACHE
-	        points_length_cache,
+	        points_length_accum,
 #endif
-	        tan_l, tan_r, error_threshold, dims,
+	        tan_l, tan_r, error_threshold, calc_flag & ~CURVE_FIT_CALC_PARALLEL, dims, ctx,
 
 	        cubic, r_error_max_sq, r_error_index);
 
-#ifdef USE_LENGTH_CACHE
-	if (points_length_cache_alloc) {
-		free(points_length_cache_alloc);
-	}
-#endif
-
 	copy_vnvn(r_handle_l, CUBIC_PT(cubic, 1, dims), dims);
 	copy_vnvn(r_handle_r, CUBIC_PT(cubic, 2, dims), dims);
 
+	if (ctx == &ctx_local) {
+		curve_fit_context_clear(&ctx_local);
+	}
+
 	return 0;
 }
 
-int curve_fit_cubic_to_points_single_fl(
-        const float  *points,
-        const uint    points_len,
-        const float  *points_length_cache,
+/** \} */
+
+
+/* -------------------------------------------------------------------- */
+
+/** \name External API for Streaming Curve-Fitting
+ *
+ * Points are fitted as they're added, only the open tail
+ * (the points after the last committed split) is re-fitted each time.
+ *
+ * Once the tail is split into more than #STREAM_TAIL_CUBICS cubics, the others are committed,
+ * they only depend on points up to their end-point & the tangent there, so can no longer change.
+ * The end-point of the last committed cubic becomes the start of the tail.
+ *
+ * Smooth strokes may not need to be split at all,
+ * so the tail is also committed once it exceeds #STREAM_TAIL_POINTS_MAX points.
+ * \{ */
+
+#ifndef USE_ORIG_INDEX_DATA
+#  error "Streaming uses the spans of each cubic to find where the tail is split"
+#endif
+
+/**
+ * The number of cubics to keep in the tail.
+ *
+ * Only the last cubic depends on points which are yet to be added,
+ * however committing all others splits the curve more often than fitting all points at once,
+ * since each split is chosen without knowing about the points which follow.
+ * Keeping an extra cubic allows the previous split to be chosen again.
+ */
+#define STREAM_TAIL_CUBICS 2
+
+/**
+ * The number of points in the tail before committing all but the last cubic,
+ * splitting the tail when it's a single cubic.
+ *
+ * Without this, the cost of adding points would increase with the length of smooth strokes.
+ */
+#define STREAM_TAIL_POINTS_MAX 1024
+
+struct CurveFitStream {
+	uint dims;
+	uint calc_flag;
+	real error_threshold_sq;
+
+	/**
+	 * Points which haven't been committed,
+	 * the first point is the end-point of the last committed cubic.
+	 */
+	real *points;
+	uint  points_len;
+	uint  points_len_alloc;
+
+	/** Cubics which can no longer change. */
+	CubicList clist;
+	/** Cubics fitted to the tail (reused each time points are added). */
+	CubicList clist_tail;
+
+	struct CurveFitContext ctx;
+
+	/** The tangent at the start of the tail. */
+	real tan_l[0];
+};
+
+/**
+ * Fit the points which haven't been committed into \a stream->clist_tail.
+ *
+ * \param points_len: The number of points to fit,
+ * when less than all points, the end tangent is calculated as if the points were split there.
+ */
+static void stream_fit_tail(struct CurveFitStream *stream, const uint points_len)
+{
+	const uint dims = stream->dims;
+	const real *points = stream->points;
+
+#ifdef USE_VLA
+	real tan_r[dims];
+#else
+	real *tan_r = alloca(sizeof(real) * dims);
+#endif
+
+	assert(points_len >= 2);
+
+	if (stream->clist.len == 0) {
+		/* Nothing is committed, calculate the start tangent as #fit_cubic_to_points_span does. */
+		normalize_vn_vnvn(stream->tan_l, &points[0], &points[dims], dims);
+	}
+	if (points_len == stream->points_len) {
+		normalize_vn_vnvn(tan_r, &points[(points_len - 2) * dims], &points[(points_len - 1) * dims], dims);
+	}
+	else {
+		points_calc_split_tangent(points, points_len - 1, dims, tan_r);
+	}
+
+#ifdef USE_LENGTH_CACHE
+	double *points_length_cache = curve_fit_buffer_ensure(
+	        &stream->ctx, &stream->ctx.length_cache, sizeof(double) * points_len);
+	points_calc_coord_length_cache(
+	        points, points_len, dims,
+	        points_length_cache);
+#endif
+
+	cubic_list_clear(&stream->clist_tail);
+	fit_cubic_to_points_subdivide(
+	        points, points_len,
+#ifdef USE_LENGTH_CACHE
+	        points_length_cache,
+#endif
+	        stream->tan_l, tan_r, stream->error_threshold_sq, stream->calc_flag, dims,
+	        &stream->ctx, &stream->clist_tail);
+}
+
+struct CurveFitStream *curve_fit_stream_begin_db(
         const uint    dims,
-        const float   error_threshold,
-        const float   tan_l[],
-        const float   tan_r[],
+        const real    error_threshold,
+        const uint    calc_flag)
+{
+	struct CurveFitStream *stream = malloc(sizeof(*stream) + (sizeof(real) * dims));
+	stream->dims = dims;
+	/* The tail is small, there is nothing to gain from threads or a lower resolution. */
+	stream->calc_flag = calc_flag & ~(CURVE_FIT_CALC_PARALLEL | CURVE_FIT_CALC_MULTIRES);
+	stream->error_threshold_sq = sq(error_threshold);
+
+	stream->points = NULL;
+	stream->points_len = 0;
+	stream->points_len_alloc = 0;
+
+	cubic_list_init(&stream->clist, 0, dims, NULL);
+	cubic_list_init(&stream->clist_tail, 0, dims, NULL);
+	curve_fit_context_init(&stream->ctx);
+	zero_vn(stream->tan_l, dims);
+	return stream;
+}
 
-        float   r_handle_l[],
-        float   r_handle_r[],
-        float  *r_error_sq,
-        uint   *r_error_index)
+void curve_fit_stream_append_db(
+        struct CurveFitStream *stream,
+        const real   *points,
+        const uint    points_len)
 {
-	const uint points_flat_len = points_len * dims;
-	double *points_db = malloc(sizeof(double) * points_flat_len);
-	double *points_length_cache_db = NULL;
+	const uint dims = stream->dims;
 
-	copy_vndb_vnfl(points_db, points, points_flat_len);
+	if (points_len == 0) {
+		return;
+	}
 
-	if (points_length_cache) {
-		points_length_cache_db = malloc(sizeof(double) * points_len);
-		copy_vndb_vnfl(points_length_cache_db, points_length_cache, points_len);
+	const uint points_len_new = stream->points_len + points_len;
+	if (points_len_new > stream->points_len_alloc) {
+		stream->points_len_alloc = points_len_new > (stream->points_len_alloc * 2) ?
+		                           points_len_new : (stream->points_len_alloc * 2);
+		stream->points = realloc(stream->points, sizeof(real) * dims * stream->points_len_alloc);
 	}
+	memcpy(&stream->points[stream->points_len * dims], points, sizeof(real) * dims * points_len);
+	stream->points_len = points_len_new;
 
-#ifdef USE_VLA
-	double tan_l_db[dims];
-	double tan_r_db[dims];
-	double r_handle_l_db[dims];
-	double r_handle_r_db[dims];
-#else
-	double *tan_l_db = alloca(sizeof(double) * dims);
-	double *tan_r_db = alloca(sizeof(double) * dims);
-	double *r_handle_l_db = alloca(sizeof(double) * dims);
-	double *r_handle_r_db = alloca(sizeof(double) * dims);
-#endif
-	double r_error_sq_db;
-
-	copy_vndb_vnfl(tan_l_db, tan_l, dims);
-	copy_vndb_vnfl(tan_r_db, tan_r, dims);
-
-	int result = curve_fit_cubic_to_points_single_db(
-	        points_db, points_len, points_length_cache_db, dims,
-	        (double)error_threshold,
-	        tan_l_db, tan_r_db,
-	        r_handle_l_db, r_handle_r_db,
-	        &r_error_sq_db,
-	        r_error_index);
+	if (stream->points_len < 2) {
+		return;
+	}
+
+	stream_fit_tail(stream, stream->points_len);
+
+	CubicList *clist_tail = &stream->clist_tail;
+	uint commit_len = 0;
+	if (clist_tail->len > STREAM_TAIL_CUBICS) {
+		commit_len = clist_tail->len - STREAM_TAIL_CUBICS;
+	}
+	else if (stream->points_len > STREAM_TAIL_POINTS_MAX) {
+		if (clist_tail->len > 1) {
+			commit_len = clist_tail->len - 1;
+		}
+		else {
+			/* Split the tail, keeping enough points for the next split to be chosen. */
+			stream_fit_tail(stream, (stream->points_len - (STREAM_TAIL_POINTS_MAX / 2)) + 1);
+			commit_len = clist_tail->len;
+		}
+	}
+
+	if (commit_len != 0) {
+		uint split_index = 0;
+		for (uint i = 0; i < commit_len; i++) {
+			split_index += clist_tail->orig_index[i + 1];
+		}
+		cubic_list_append_list(&stream->clist, clist_tail, commit_len);
+
+		/* Use the same tangent the last cubic was fitted with. */
+		points_calc_split_tangent(stream->points, split_index, dims, stream->tan_l);
+
+		stream->points_len -= split_index;
+		memmove(stream->points,
+		        &stream->points[split_index * dims],
+		        sizeof(real) * dims * stream->points_len);
+	}
+}
+
+void curve_fit_stream_stable_db(
+        struct CurveFitStream *stream,
+        const real **r_cubic_array, uint *r_cubic_array_len)
+{
+	CubicList *clist = &stream->clist;
 
-	free(points_db);
+	if (clist->len == 0) {
+		*r_cubic_array = NULL;
+		*r_cubic_array_len = 0;
+		return;
+	}
+
+	/* The last handle is overwritten when the next cubic is committed. */
+	cubic_list_calc_end_handles(clist);
+
+	*r_cubic_array = clist->array;
+	*r_cubic_array_len = clist->len + 1;
+}
+
+int curve_fit_stream_finish_db(
+        struct CurveFitStream *stream,
+        real **r_cubic_array, uint *r_cubic_array_len,
+        uint **r_cubic_orig_index)
+{
+	const uint dims = stream->dims;
+	CubicList *clist = &stream->clist;
 
-	if (points_length_cache_db) {
-		free(points_length_cache_db);
+	if (r_cubic_array) {
+		if (stream->points_len >= 2) {
+			stream_fit_tail(stream, stream->points_len);
+			cubic_list_append_list(clist, &stream->clist_tail, stream->clist_tail.len);
+		}
+		else if (stream->points_len == 1) {
+			/* Once a cubic is committed, the tail always has at least 2 points. */
+			assert(clist->len == 0);
+			const real *pt = &stream->points[0];
+			Cubic *cubic = alloca(cubic_alloc_size(dims));
+			cubic_init(cubic, pt, pt, pt, pt, dims);
+			cubic->orig_span = 0;
+			cubic_list_append(clist, cubic);
+		}
+
+		if (clist->len != 0) {
+			*r_cubic_array_len = clist->len + 1;
+			*r_cubic_array = cubic_list_as_array(clist, 0, r_cubic_orig_index);
+		}
+		else {
+			*r_cubic_array = NULL;
+			*r_cubic_array_len = 0;
+			if (r_cubic_orig_index) {
+				*r_cubic_orig_index = NULL;
+			}
+		}
 	}
 
-	copy_vnfl_vndb(r_handle_l, r_handle_l_db, dims);
-	copy_vnfl_vndb(r_handle_r, r_handle_r_db, dims);
-	*r_error_sq = (float)r_error_sq_db;
+	cubic_list_free(clist);
+	cubic_list_free(&stream->clist_tail);
+	curve_fit_context_clear(&stream->ctx);
+	free(stream->points);
+	free(stream);
 
-	return result;
+	return 0;
 }
 
 /** \} */
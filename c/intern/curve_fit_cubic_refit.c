@@ -56,8 +56,10 @@
 #include <stdlib.h>
 
 typedef unsigned int uint;
+typedef double real;
 
 #include "curve_fit_inline.h"
+#include "curve_fit_context.h"
 #include "../curve_fit_nd.h"
 
 #include "generic_heap.h"
@@ -90,9 +92,28 @@ typedef unsigned int uint;
 #define USE_LENGTH_CACHE
 /* use pool allocator */
 #define USE_TPOOL
+/* avoid fitting the same span between knots multiple times */
+#define USE_SPAN_CACHE
+
+/**
+ * Calculate the initial heap values of each pass using multiple threads,
+ * see #CURVE_FIT_CALC_PARALLEL.
+ */
+#if defined(_OPENMP) && (_OPENMP >= 201511)
+#  define USE_PARALLEL
+#endif
 
 
 #define SPLIT_POINT_INVALID ((uint)-1)
+/** No previous/next knot (at the ends of non-cyclic curves & for removed knots). */
+#define KNOT_INDEX_NONE ((uint)-1)
+
+#ifdef USE_PARALLEL
+/** Passes over fewer knots than this are always calculated by the current thread. */
+#  define PARALLEL_SEED_KNOTS_MIN 1024
+/** Number of knots each thread takes at once (the cost of each varies a lot). */
+#  define PARALLEL_SEED_CHUNK 64
+#endif
 
 #define MAX2(x, y) ((x) > (y) ? (x) : (y))
 
@@ -104,16 +125,57 @@ typedef unsigned int uint;
 #  define UNLIKELY(x)     (x)
 #endif
 
+#ifdef USE_SPAN_CACHE
+/**
+ * The result of fitting a cubic between two knots.
+ *
+ * Tangents are identified by their index (which is re-assigned when creating corners),
+ * their values don't change once initialized.
+ */
+struct SpanCacheEntry {
+	uint tan_l, tan_r;
+	/** #SPLIT_POINT_INVALID when unused. */
+	uint index_l;
+	uint index_r;
+	/** Relative to \a index_l. */
+	uint error_index;
+	double error_sq;
+	double handles[2];
+};
+#endif
+
 struct PointData {
 	const double *points;
 	uint          points_len;
 #ifdef USE_LENGTH_CACHE
 	const double *points_length_cache;
 #endif
+	/** Linked by index, see #Knot.next & #Knot.prev. */
+	struct Knot    *knots;
+	struct KnotFit *knots_fit;
+	/** Unit length tangents (referenced by #Knot.tan). */
+	const double   *tangents;
+#ifdef USE_SPAN_CACHE
+	/**
+	 * Direct mapped (entries are replaced on collision),
+	 * may be NULL (when calculating in parallel for e.g.).
+	 */
+	struct SpanCacheEntry *span_cache;
+	uint                   span_cache_mask;
+#endif
+	/** Memory reused when fitting (not thread safe). */
+	struct CurveFitContext *ctx;
+	/** Passed to #curve_fit_cubic_to_points_single_db. */
+	uint calc_flag;
 };
 
+/**
+ * Data accessed while searching for knots to remove
+ * (kept small, #KnotFit stores the values calculated for each knot).
+ */
 struct Knot {
-	struct Knot *next, *prev;
+	/** Indices of the linked knots (#KNOT_INDEX_NONE when there is no knot). */
+	uint next, prev;
 
 	HeapNode *heap_node;
 
@@ -127,6 +189,15 @@ struct Knot {
 	uint is_removed : 1;
 	uint is_corner  : 1;
 
+	/**
+	 * Index of each tangent in #PointData.tangents.
+	 * Initially both sides share the knots own tangent (unless it's a corner),
+	 * however we may re-assign.
+	 */
+	uint tan[2];
+};
+
+struct KnotFit {
 	double handles[2];
 	/**
 	 * Store the error value, to see if we can improve on it
@@ -134,11 +205,14 @@ struct Knot {
 	 *
 	 * This is the error between this knot and the next */
 	double error_sq_next;
-
-	/* Initially point to contiguous memory, however we may re-assign */
-	double *tan[2];
 };
 
+static inline const double *knot_tan(
+        const struct PointData *pd, const struct Knot *k, const uint side, const uint dims)
+{
+	return &pd->tangents[k->tan[side] * dims];
+}
+
 
 struct KnotRemoveState {
 	uint index;
@@ -205,6 +279,148 @@ struct KnotCornerState {
 #endif  /* USE_CORNER_DETECT */
 
 
+/**
+ * Memory for each pass, kept in the #CurveFitContext for reuse.
+ *
+ * The heap is always empty between passes,
+ * elements are all freed back into their pools.
+ */
+struct CurveFitRefitCache {
+	Heap *heap;
+#ifdef USE_TPOOL
+	struct ElemPool_KnotRemoveState rstate_pool;
+#ifdef USE_KNOT_REFIT
+	struct ElemPool_KnotRefitState  refit_pool;
+#endif
+#ifdef USE_CORNER_DETECT
+	struct ElemPool_KnotCornerState corner_pool;
+#endif
+#endif  /* USE_TPOOL */
+};
+
+static struct CurveFitRefitCache *refit_cache_ensure(struct CurveFitContext *ctx)
+{
+	if (ctx->refit_cache == NULL) {
+		struct CurveFitRefitCache *cache = malloc(sizeof(*cache));
+		cache->heap = HEAP_new(0);
+#ifdef USE_TPOOL
+		rstate_pool_create(&cache->rstate_pool, 0);
+#ifdef USE_KNOT_REFIT
+		refit_pool_create(&cache->refit_pool, 0);
+#endif
+#ifdef USE_CORNER_DETECT
+		corner_pool_create(&cache->corner_pool, 0);
+#endif
+#endif  /* USE_TPOOL */
+		ctx->refit_cache = cache;
+	}
+	return ctx->refit_cache;
+}
+
+void curve_fit_refit_cache_free(struct CurveFitRefitCache *cache)
+{
+	assert(HEAP_is_empty(cache->heap));
+	HEAP_free(cache->heap, NULL);
+#ifdef USE_TPOOL
+	rstate_pool_destroy(&cache->rstate_pool);
+#ifdef USE_KNOT_REFIT
+	refit_pool_destroy(&cache->refit_pool);
+#endif
+#ifdef USE_CORNER_DETECT
+	corner_pool_destroy(&cache->corner_pool);
+#endif
+#endif  /* USE_TPOOL */
+	free(cache);
+}
+
+/* Heap functions which count operations for #CurveFitStats. */
+
+static void refit_heap_insert_or_update(
+        const struct PointData *pd, Heap *heap, HeapNode **node_p, double value, void *ptr)
+{
+	struct CurveFitStats *stats = pd->ctx->stats;
+	if (stats) {
+		if (*node_p) {
+			stats->heap_update_count += 1;
+		}
+		else {
+			stats->heap_insert_count += 1;
+		}
+	}
+	HEAP_insert_or_update(heap, node_p, value, ptr);
+}
+
+static void refit_heap_remove(
+        const struct PointData *pd, Heap *heap, HeapNode *node)
+{
+	if (pd->ctx->stats) {
+		pd->ctx->stats->heap_remove_count += 1;
+	}
+	HEAP_remove(heap, node);
+}
+
+static void *refit_heap_popmin(
+        const struct PointData *pd, Heap *heap)
+{
+	if (pd->ctx->stats) {
+		pd->ctx->stats->heap_pop_count += 1;
+	}
+	return HEAP_popmin(heap);
+}
+
+
+/**
+ * \return An array of \a knots_len states (\a state_size each), with their heap values in \a r_values.
+ */
+static void *refit_seed_buffer_ensure(
+        const struct PointData *pd, const uint knots_len, const size_t state_size,
+        double **r_values)
+{
+	struct CurveFitContext *ctx = pd->ctx;
+	double *values = curve_fit_buffer_ensure(
+	        ctx, &ctx->refit_seed, (sizeof(double) + state_size) * knots_len);
+	*r_values = values;
+	return &values[knots_len];
+}
+
+#ifdef USE_PARALLEL
+
+/**
+ * The first step of each pass calculates the heap value of every knot,
+ * for large inputs this is done by multiple threads, storing the result for each knot.
+ * The heap is then filled in order, so the result matches the single threaded code.
+ */
+static bool refit_seed_use_parallel(const struct PointData *pd, const uint knots_len)
+{
+	return (pd->calc_flag & CURVE_FIT_CALC_PARALLEL) && (knots_len >= PARALLEL_SEED_KNOTS_MIN);
+}
+
+/**
+ * Each thread needs its own context, see #curve_fit_context_task_begin.
+ */
+static void refit_seed_task_begin(
+        struct PointData *pd_task, struct CurveFitContext *ctx_task, struct CurveFitStats *stats_task,
+        const struct PointData *pd)
+{
+	*pd_task = *pd;
+	pd_task->ctx = curve_fit_context_task_begin(ctx_task, pd->ctx, stats_task);
+	/* Already running in parallel. */
+	pd_task->calc_flag &= ~CURVE_FIT_CALC_PARALLEL;
+#ifdef USE_SPAN_CACHE
+	/* Not thread safe. */
+	pd_task->span_cache = NULL;
+#endif
+}
+
+static void refit_seed_task_end(
+        struct PointData *pd_task, const struct PointData *pd)
+{
+	curve_fit_context_task_end(pd_task->ctx, pd->ctx);
+}
+
+#endif  /* USE_PARALLEL */
+
+
 /* Utility functions */
 
 #if defined(USE_KNOT_REFIT) && !defined(USE_KNOT_REFIT_REMOVE)
@@ -321,6 +537,8 @@ static double knot_remove_error_value(
         const double *points_offset, const uint points_offset_len,
         const double *points_offset_length_cache,
         const uint dims,
+        const uint calc_flag,
+        struct CurveFitContext *ctx,
         /* Avoid having to re-calculate again */
         double r_handle_factors[2], uint *r_error_index)
 {
@@ -335,10 +553,11 @@ static double knot_remove_error_value(
 #endif
 
 	curve_fit_cubic_to_points_single_db(
-	        points_offset, points_offset_len, points_offset_length_cache, dims, 0.0,
+	        points_offset, points_offset_len, points_offset_length_cache, dims, 0.0, calc_flag,
 	        tan_l, tan_r,
 	        handle_factor_l, handle_factor_r,
-	        &error_sq, r_error_index);
+	        &error_sq, r_error_index,
+	        ctx);
 
 	assert(error_sq != DBL_MAX);
 
@@ -351,10 +570,152 @@ static double knot_remove_error_value(
 	return error_sq;
 }
 
+#ifdef USE_SPAN_CACHE
+static struct SpanCacheEntry *span_cache_entry(
+        const struct PointData *pd,
+        const uint index_l, const uint index_r,
+        const uint tan_l, const uint tan_r)
+{
+	const uint hash = ((index_l * 0x9e3779b1u) ^ (index_r * 0x85ebca6bu) ^ (tan_l - tan_r));
+	return &pd->span_cache[(hash ^ (hash >> 15)) & pd->span_cache_mask];
+}
+#endif  /* USE_SPAN_CACHE */
+
+/**
+ * Re-fitting checks spans which were already fitted
+ * (when removing knots or moving a knot back & forth between the same points).
+ */
+static void span_cache_init(struct PointData *pd, const uint knots_len)
+{
+	struct CurveFitContext *ctx = pd->ctx;
+	/* A power of two, at least as large as the number of knots. */
+	uint span_cache_len = 64;
+	while (span_cache_len < knots_len) {
+		span_cache_len *= 2;
+	}
+	struct SpanCacheEntry *span_cache = curve_fit_buffer_ensure(
+	        ctx, &ctx->refit_span_cache, sizeof(*span_cache) * span_cache_len);
+	for (uint i = 0; i < span_cache_len; i++) {
+		span_cache[i].index_l = SPLIT_POINT_INVALID;
+	}
+	pd->span_cache = span_cache;
+	pd->span_cache_mask = span_cache_len - 1;
+}
+
+/**
+ * Copy the points of a span which wraps around the start of a cyclic curve into contiguous memory,
+ * since fitting a cubic expects its points to be in a single array.
+ *
+ * This is only needed for spans over the start point,
+ * other spans use the points passed in.
+ */
+static void span_wrap_points(
+        const struct PointData *pd,
+        const uint index_l, const uint points_offset_len,
+        const uint dims,
+        const double **r_points_offset, const double **r_points_offset_length_cache)
+{
+	struct CurveFitContext *ctx = pd->ctx;
+	const uint points_head_len = pd->points_len - index_l;
+	const uint points_tail_len = points_offset_len - points_head_len;
+	assert(points_offset_len > points_head_len && points_tail_len <= pd->points_len);
+
+#ifdef USE_LENGTH_CACHE
+	double *points_wrap = curve_fit_buffer_ensure(
+	        ctx, &ctx->refit_span_wrap, sizeof(double) * points_offset_len * (dims + 1));
+	double *points_wrap_length_cache = &points_wrap[points_offset_len * dims];
+
+	memcpy(points_wrap_length_cache,
+	       &pd->points_length_cache[index_l], sizeof(double) * points_head_len);
+	memcpy(&points_wrap_length_cache[points_head_len],
+	       pd->points_length_cache, sizeof(double) * points_tail_len);
+	*r_points_offset_length_cache = points_wrap_length_cache;
+#else
+	double *points_wrap = curve_fit_buffer_ensure(
+	        ctx, &ctx->refit_span_wrap, sizeof(double) * points_offset_len * dims);
+	(void)r_points_offset_length_cache;
+#endif
+
+	memcpy(points_wrap,
+	       &pd->points[index_l * dims], sizeof(double) * points_head_len * dims);
+	memcpy(&points_wrap[points_head_len * dims],
+	       pd->points, sizeof(double) * points_tail_len * dims);
+	*r_points_offset = points_wrap;
+}
+
+/**
+ * Fit a cubic between two knots (which have points between them),
+ * re-using the result of an earlier fit when possible.
+ *
+ * \param r_error_index: The index of the point with the largest error (relative to \a knot_l).
+ */
+static double knot_calc_span_error_value(
+        const struct PointData *pd,
+        const struct Knot *knot_l, const struct Knot *knot_r,
+        const uint tan_l, const uint tan_r,
+        const uint points_offset_len,
+        const uint dims,
+        double r_handle_factors[2], uint *r_error_index)
+{
+#ifdef USE_SPAN_CACHE
+	struct SpanCacheEntry *entry = NULL;
+	if (pd->span_cache) {
+		entry = span_cache_entry(pd, knot_l->index, knot_r->index, tan_l, tan_r);
+		if ((entry->index_l == knot_l->index) &&
+		    (entry->index_r == knot_r->index) &&
+		    (entry->tan_l == tan_l) &&
+		    (entry->tan_r == tan_r))
+		{
+			if (pd->ctx->stats) {
+				pd->ctx->stats->span_cache_hit_count += 1;
+			}
+			r_handle_factors[0] = entry->handles[0];
+			r_handle_factors[1] = entry->handles[1];
+			*r_error_index = entry->error_index;
+			return entry->error_sq;
+		}
+	}
+#endif
+
+	const double *points_offset = &pd->points[knot_l->index * dims];
+#ifdef USE_LENGTH_CACHE
+	const double *points_offset_length_cache = &pd->points_length_cache[knot_l->index];
+#else
+	const double *points_offset_length_cache = NULL;
+#endif
+	if (knot_l->index + points_offset_len > pd->points_len) {
+		span_wrap_points(
+		        pd, knot_l->index, points_offset_len, dims,
+		        &points_offset, &points_offset_length_cache);
+	}
+
+	const double error_sq = knot_remove_error_value(
+	        &pd->tangents[tan_l * dims], &pd->tangents[tan_r * dims],
+	        points_offset, points_offset_len,
+	        points_offset_length_cache,
+	        dims, pd->calc_flag, pd->ctx,
+	        r_handle_factors, r_error_index);
+
+#ifdef USE_SPAN_CACHE
+	if (entry) {
+		entry->tan_l = tan_l;
+		entry->tan_r = tan_r;
+		entry->index_l = knot_l->index;
+		entry->index_r = knot_r->index;
+		entry->error_index = *r_error_index;
+		entry->error_sq = error_sq;
+		entry->handles[0] = r_handle_factors[0];
+		entry->handles[1] = r_handle_factors[1];
+	}
+#endif
+
+	return error_sq;
+}
+
 static double knot_calc_curve_error_value(
         const struct PointData *pd,
         const struct Knot *knot_l, const struct Knot *knot_r,
-        const double *tan_l, const double *tan_r,
+        const uint tan_l, const uint tan_r,
         const uint dims,
         double r_handle_factors[2])
 {
@@ -364,15 +725,8 @@ static double knot_calc_curve_error_value(
 
 	if (points_offset_len != 2) {
 		uint error_index_dummy;
-		return knot_remove_error_value(
-		        tan_l, tan_r,
-		        &pd->points[knot_l->index * dims], points_offset_len,
-#ifdef USE_LENGTH_CACHE
-		        &pd->points_length_cache[knot_l->index],
-#else
-		        NULL,
-#endif
-		        dims,
+		return knot_calc_span_error_value(
+		        pd, knot_l, knot_r, tan_l, tan_r, points_offset_len, dims,
 		        r_handle_factors, &error_index_dummy);
 	}
 	else {
@@ -382,8 +736,8 @@ static double knot_calc_curve_error_value(
 		r_handle_factors[0] = r_handle_factors[1] = pd->points_length_cache[knot_l->index] / 3.0;
 #else
 		r_handle_factors[0] = r_handle_factors[1] = len_vnvn(
-		        &pd->points[(knot_l->index + 0) * dims],
-		        &pd->points[(knot_l->index + 1) * dims], dims) / 3.0;
+		        &pd->points[knot_l->index * dims],
+		        &pd->points[knot_r->index * dims], dims) / 3.0;
 #endif
 		return 0.0;
 	}
@@ -394,7 +748,7 @@ static double knot_calc_curve_error_value(
 static double knot_calc_curve_error_value_and_index(
         const struct PointData *pd,
         const struct Knot *knot_l, const struct Knot *knot_r,
-        const double *tan_l, const double *tan_r,
+        const uint tan_l, const uint tan_r,
         const uint dims,
         double r_handle_factors[2],
         uint *r_error_index)
@@ -404,15 +758,8 @@ static double knot_calc_curve_error_value_and_index(
 	        ((knot_r->index + pd->points_len) - knot_l->index)) + 1;
 
 	if (points_offset_len != 2) {
-		const double error_sq = knot_remove_error_value(
-		        tan_l, tan_r,
-		        &pd->points[knot_l->index * dims], points_offset_len,
-#ifdef USE_LENGTH_CACHE
-		        &pd->points_length_cache[knot_l->index],
-#else
-		        NULL,
-#endif
-		        dims,
+		const double error_sq = knot_calc_span_error_value(
+		        pd, knot_l, knot_r, tan_l, tan_r, points_offset_len, dims,
 		        r_handle_factors, r_error_index);
 
 		/* Adjust the offset index to the global index & wrap if needed. */
@@ -430,8 +777,8 @@ static double knot_calc_curve_error_value_and_index(
 		r_handle_factors[0] = r_handle_factors[1] = pd->points_length_cache[knot_l->index] / 3.0;
 #else
 		r_handle_factors[0] = r_handle_factors[1] = len_vnvn(
-		        &pd->points[(knot_l->index + 0) * dims],
-		        &pd->points[(knot_l->index + 1) * dims], dims) / 3.0;
+		        &pd->points[knot_l->index * dims],
+		        &pd->points[knot_r->index * dims], dims) / 3.0;
 #endif
 		*r_error_index = 0;
 		return 0.0;
@@ -447,21 +794,48 @@ struct KnotRemove_Params {
 #endif
 };
 
-static void knot_remove_error_recalculate(
-        struct KnotRemove_Params *p,
-        struct Knot *k, const double error_sq_max,
-        const uint dims)
+/**
+ * Calculate the state for removing \a k (doesn't change the heap).
+ *
+ * \return false when removing \a k exceeds \a error_sq_max.
+ */
+static bool knot_remove_error_calc(
+        const struct PointData *pd,
+        const struct Knot *k, const double error_sq_max,
+        const uint dims,
+        struct KnotRemoveState *r_state, double *r_value)
 {
 	assert(k->can_remove);
 	double handles[2];
 
+	const struct Knot *k_prev = &pd->knots[k->prev];
+	const struct Knot *k_next = &pd->knots[k->next];
+
 	const double cost_sq = knot_calc_curve_error_value(
-	        p->pd, k->prev, k->next,
-	        k->prev->tan[1], k->next->tan[0],
+	        pd, k_prev, k_next,
+	        k_prev->tan[1], k_next->tan[0],
 	        dims,
 	        handles);
 
 	if (cost_sq < error_sq_max) {
+		r_state->index = k->index;
+		r_state->handles[0] = handles[0];
+		r_state->handles[1] = handles[1];
+		*r_value = cost_sq;
+		return true;
+	}
+	return false;
+}
+
+static void knot_remove_error_recalculate(
+        struct KnotRemove_Params *p,
+        struct Knot *k, const double error_sq_max,
+        const uint dims)
+{
+	struct KnotRemoveState r_calc;
+	double cost_sq;
+
+	if (knot_remove_error_calc(p->pd, k, error_sq_max, dims, &r_calc, &cost_sq)) {
 		struct KnotRemoveState *r;
 		if (k->heap_node) {
 			r = HEAP_node_ptr(k->heap_node);
@@ -472,19 +846,17 @@ static void knot_remove_error_recalculate(
 #else
 			r = malloc(sizeof(*r));
 #endif
-			r->index = k->index;
 		}
 
-		r->handles[0] = handles[0];
-		r->handles[1] = handles[1];
+		*r = r_calc;
 
-		HEAP_insert_or_update(p->heap, &k->heap_node, cost_sq, r);
+		refit_heap_insert_or_update(p->pd, p->heap, &k->heap_node, cost_sq, r);
 	}
 	else {
 		if (k->heap_node) {
 			struct KnotRemoveState *r;
 			r = HEAP_node_ptr(k->heap_node);
-			HEAP_remove(p->heap, k->heap_node);
+			refit_heap_remove(p->pd, p->heap, k->heap_node);
 
 #ifdef USE_TPOOL
 			rstate_pool_elem_free(p->epool, r);
@@ -506,44 +878,90 @@ static uint curve_incremental_simplify(
         double error_sq_max, const uint dims)
 {
 
+	struct CurveFitRefitCache *cache = refit_cache_ensure(pd->ctx);
+
 #ifdef USE_TPOOL
-	struct ElemPool_KnotRemoveState epool;
+	struct ElemPool_KnotRemoveState *epool = &cache->rstate_pool;
 
-	rstate_pool_create(&epool, 0);
+	rstate_pool_clear(epool);
 #endif
 
-	Heap *heap = HEAP_new(knots_len_remaining);
+	Heap *heap = cache->heap;
 
 	struct KnotRemove_Params params = {
 	    .pd = pd,
 	    .heap = heap,
 #ifdef USE_TPOOL
-	    .epool = &epool,
+	    .epool = epool,
 #endif
 	};
 
-	for (uint i = 0; i < knots_len; i++) {
-		struct Knot *k = &knots[i];
-		if (k->can_remove && (k->is_removed == false) && (k->is_corner == false)) {
-			knot_remove_error_recalculate(&params, k, error_sq_max, dims);
+#ifdef USE_PARALLEL
+	if (refit_seed_use_parallel(pd, knots_len)) {
+		double *seed_values;
+		struct KnotRemoveState *seed_states = refit_seed_buffer_ensure(
+		        pd, knots_len, sizeof(*seed_states), &seed_values);
+
+#pragma omp parallel
+		{
+			struct PointData pd_task;
+			struct CurveFitContext ctx_task;
+			struct CurveFitStats stats_task;
+			refit_seed_task_begin(&pd_task, &ctx_task, &stats_task, pd);
+
+#pragma omp for schedule(dynamic, PARALLEL_SEED_CHUNK)
+			for (uint i = 0; i < knots_len; i++) {
+				const struct Knot *k = &knots[i];
+				if (!(k->can_remove && (k->is_removed == false) && (k->is_corner == false) &&
+				      knot_remove_error_calc(&pd_task, k, error_sq_max, dims, &seed_states[i], &seed_values[i])))
+				{
+					seed_states[i].index = SPLIT_POINT_INVALID;
+				}
+			}
+
+			refit_seed_task_end(&pd_task, pd);
+		}
+
+		for (uint i = 0; i < knots_len; i++) {
+			if (seed_states[i].index != SPLIT_POINT_INVALID) {
+#ifdef USE_TPOOL
+				struct KnotRemoveState *r = rstate_pool_elem_alloc(epool);
+#else
+				struct KnotRemoveState *r = malloc(sizeof(*r));
+#endif
+				*r = seed_states[i];
+				refit_heap_insert_or_update(pd, heap, &knots[i].heap_node, seed_values[i], r);
+			}
+		}
+	}
+	else
+#endif  /* USE_PARALLEL */
+	{
+		for (uint i = 0; i < knots_len; i++) {
+			struct Knot *k = &knots[i];
+			if (k->can_remove && (k->is_removed == false) && (k->is_corner == false)) {
+				knot_remove_error_recalculate(&params, k, error_sq_max, dims);
+			}
 		}
 	}
 
+	struct KnotFit *knots_fit = pd->knots_fit;
+
 	while (HEAP_is_empty(heap) == false) {
 		struct Knot *k;
 
 		{
 			const double error_sq = HEAP_top_value(heap);
-			struct KnotRemoveState *r = HEAP_popmin(heap);
+			struct KnotRemoveState *r = refit_heap_popmin(pd, heap);
 			k = &knots[r->index];
 			k->heap_node = NULL;
-			k->prev->handles[1] = r->handles[0];
-			k->next->handles[0] = r->handles[1];
+			knots_fit[k->prev].handles[1] = r->handles[0];
+			knots_fit[k->next].handles[0] = r->handles[1];
 
-			k->prev->error_sq_next = error_sq;
+			knots_fit[k->prev].error_sq_next = error_sq;
 
 #ifdef USE_TPOOL
-			rstate_pool_elem_free(&epool, r);
+			rstate_pool_elem_free(epool, r);
 #else
 			free(r);
 #endif
@@ -553,38 +971,225 @@ static uint curve_incremental_simplify(
 			continue;
 		}
 
-		struct Knot *k_prev = k->prev;
-		struct Knot *k_next = k->next;
+		struct Knot *k_prev = &knots[k->prev];
+		struct Knot *k_next = &knots[k->next];
 
 		/* Remove ourselves */
-		k_next->prev = k_prev;
-		k_prev->next = k_next;
+		k_next->prev = k_prev->index;
+		k_prev->next = k_next->index;
 
-		k->next = NULL;
-		k->prev = NULL;
+		k->next = KNOT_INDEX_NONE;
+		k->prev = KNOT_INDEX_NONE;
 		k->is_removed = true;
 
-		if (k_prev->can_remove && (k_prev->is_corner == false) && (k_prev->prev && k_prev->next)) {
+		if (k_prev->can_remove && (k_prev->is_corner == false) &&
+		    (k_prev->prev != KNOT_INDEX_NONE) && (k_prev->next != KNOT_INDEX_NONE))
+		{
 			knot_remove_error_recalculate(&params, k_prev, error_sq_max, dims);
 		}
 
-		if (k_next->can_remove && (k_next->is_corner == false) && (k_next->prev && k_next->next)) {
+		if (k_next->can_remove && (k_next->is_corner == false) &&
+		    (k_next->prev != KNOT_INDEX_NONE) && (k_next->next != KNOT_INDEX_NONE))
+		{
 			knot_remove_error_recalculate(&params, k_next, error_sq_max, dims);
 		}
 
 		knots_len_remaining -= 1;
 	}
 
-#ifdef USE_TPOOL
-	rstate_pool_destroy(&epool);
-#endif
-
-	HEAP_free(heap, free);
+	assert(HEAP_is_empty(heap));
 
 	return knots_len_remaining;
 }
 
 
+/**
+ * Calculate the state of each knot in \a knots_index (stored by knot index),
+ * the index of states which exceed \a error_sq_max is set to #SPLIT_POINT_INVALID.
+ */
+static void knot_remove_error_calc_array(
+        const struct PointData *pd,
+        const struct Knot *knots, const uint *knots_index, const uint knots_index_len,
+        const double error_sq_max, const uint dims,
+        struct KnotRemoveState *states, double *values)
+{
+#ifdef USE_PARALLEL
+	if (refit_seed_use_parallel(pd, knots_index_len)) {
+#pragma omp parallel
+		{
+			struct PointData pd_task;
+			struct CurveFitContext ctx_task;
+			struct CurveFitStats stats_task;
+			refit_seed_task_begin(&pd_task, &ctx_task, &stats_task, pd);
+
+#pragma omp for schedule(dynamic, PARALLEL_SEED_CHUNK)
+			for (uint i = 0; i < knots_index_len; i++) {
+				const uint k_index = knots_index[i];
+				if (!knot_remove_error_calc(
+				        &pd_task, &knots[k_index], error_sq_max, dims, &states[k_index], &values[k_index]))
+				{
+					states[k_index].index = SPLIT_POINT_INVALID;
+				}
+			}
+
+			refit_seed_task_end(&pd_task, pd);
+		}
+	}
+	else
+#endif  /* USE_PARALLEL */
+	{
+		for (uint i = 0; i < knots_index_len; i++) {
+			const uint k_index = knots_index[i];
+			if (!knot_remove_error_calc(
+			        pd, &knots[k_index], error_sq_max, dims, &states[k_index], &values[k_index]))
+			{
+				states[k_index].index = SPLIT_POINT_INVALID;
+			}
+		}
+	}
+}
+
+struct KnotRoundCandidate {
+	double value;
+	uint index;
+};
+
+static int knot_round_candidate_cmp(const void *a_v, const void *b_v)
+{
+	const struct KnotRoundCandidate *a = a_v, *b = b_v;
+	if      (a->value < b->value) { return -1; }
+	else if (a->value > b->value) { return  1; }
+	/* Sort by index too, so the order doesn't depend on the sorting implementation. */
+	else if (a->index < b->index) { return -1; }
+	else if (a->index > b->index) { return  1; }
+	return 0;
+}
+
+/**
+ * A version of #curve_incremental_simplify which removes knots in rounds,
+ * see #CURVE_FIT_CALC_REFIT_ROUNDS.
+ *
+ * Removing a knot only changes the error of its neighbors,
+ * so knots which aren't next to each other can be removed in the same round,
+ * their neighbors are then re-calculated together (using multiple threads for large inputs).
+ *
+ * Return length after being reduced.
+ */
+static uint curve_incremental_simplify_rounds(
+        const struct PointData *pd,
+        struct Knot *knots, const uint knots_len, uint knots_len_remaining,
+        double error_sq_max, const uint dims)
+{
+	struct CurveFitContext *ctx = pd->ctx;
+
+	double *values;
+	struct KnotRemoveState *states = refit_seed_buffer_ensure(pd, knots_len, sizeof(*states), &values);
+
+	struct KnotRoundCandidate *candidates = curve_fit_buffer_ensure(
+	        ctx, &ctx->refit_rounds, (sizeof(*candidates) + (sizeof(uint) * 2)) * knots_len);
+	/* Knots to (re)calculate. */
+	uint *knots_index = (uint *)&candidates[knots_len];
+	/* The last round a knot's neighbor was removed (its state is out of date). */
+	uint *knots_round = &knots_index[knots_len];
+
+	uint knots_index_len = 0;
+	for (uint i = 0; i < knots_len; i++) {
+		const struct Knot *k = &knots[i];
+		if (k->can_remove && (k->is_removed == false) && (k->is_corner == false)) {
+			knots_index[knots_index_len++] = i;
+		}
+		states[i].index = SPLIT_POINT_INVALID;
+		knots_round[i] = 0;
+	}
+
+	knot_remove_error_calc_array(pd, knots, knots_index, knots_index_len, error_sq_max, dims, states, values);
+
+	uint candidates_len = 0;
+	for (uint i = 0; i < knots_index_len; i++) {
+		const uint k_index = knots_index[i];
+		if (states[k_index].index != SPLIT_POINT_INVALID) {
+			candidates[candidates_len].value = values[k_index];
+			candidates[candidates_len].index = k_index;
+			candidates_len++;
+		}
+	}
+
+	struct KnotFit *knots_fit = pd->knots_fit;
+
+	for (uint round = 1; (candidates_len != 0) && (knots_len_remaining > 2); round++) {
+		qsort(candidates, candidates_len, sizeof(*candidates), knot_round_candidate_cmp);
+
+		knots_index_len = 0;
+		for (uint i = 0; i < candidates_len; i++) {
+			struct Knot *k = &knots[candidates[i].index];
+			if (knots_round[k->index] == round) {
+				continue;
+			}
+			if (UNLIKELY(knots_len_remaining <= 2)) {
+				break;
+			}
+
+			const struct KnotRemoveState *r = &states[k->index];
+			knots_fit[k->prev].handles[1] = r->handles[0];
+			knots_fit[k->next].handles[0] = r->handles[1];
+
+			knots_fit[k->prev].error_sq_next = candidates[i].value;
+
+			struct Knot *k_prev = &knots[k->prev];
+			struct Knot *k_next = &knots[k->next];
+
+			/* Remove ourselves */
+			k_next->prev = k_prev->index;
+			k_prev->next = k_next->index;
+
+			k->next = KNOT_INDEX_NONE;
+			k->prev = KNOT_INDEX_NONE;
+			k->is_removed = true;
+			states[k->index].index = SPLIT_POINT_INVALID;
+
+			struct Knot *k_adjacent[2] = {k_prev, k_next};
+			for (uint j = 0; j < 2; j++) {
+				struct Knot *k_step = k_adjacent[j];
+				if (knots_round[k_step->index] != round) {
+					knots_round[k_step->index] = round;
+					if (k_step->can_remove && (k_step->is_corner == false) &&
+					    (k_step->prev != KNOT_INDEX_NONE) && (k_step->next != KNOT_INDEX_NONE))
+					{
+						knots_index[knots_index_len++] = k_step->index;
+					}
+					else {
+						states[k_step->index].index = SPLIT_POINT_INVALID;
+					}
+				}
+			}
+
+			knots_len_remaining -= 1;
+		}
+
+		knot_remove_error_calc_array(pd, knots, knots_index, knots_index_len, error_sq_max, dims, states, values);
+
+		/* Keep candidates which weren't changed, then add the neighbors. */
+		uint candidates_len_next = 0;
+		for (uint i = 0; i < candidates_len; i++) {
+			const uint k_index = candidates[i].index;
+			if ((states[k_index].index != SPLIT_POINT_INVALID) && (knots_round[k_index] != round)) {
+				candidates[candidates_len_next++] = candidates[i];
+			}
+		}
+		for (uint i = 0; i < knots_index_len; i++) {
+			const uint k_index = knots_index[i];
+			if (states[k_index].index != SPLIT_POINT_INVALID) {
+				candidates[candidates_len_next].value = values[k_index];
+				candidates[candidates_len_next].index = k_index;
+				candidates_len_next++;
+			}
+		}
+		candidates_len = candidates_len_next;
+	}
+
+	return knots_len_remaining;
+}
+
 #ifdef USE_KNOT_REFIT
 
 struct KnotRefit_Params {
@@ -595,15 +1200,24 @@ struct KnotRefit_Params {
 #endif
 };
 
-static void knot_refit_error_recalculate(
-        struct KnotRefit_Params *p,
-        struct Knot *knots, const uint knots_len,
-        struct Knot *k,
+/**
+ * Calculate the state for removing or re-fitting \a k (doesn't change the heap).
+ *
+ * \return false when neither improves on the current error.
+ */
+static bool knot_refit_error_calc(
+        const struct PointData *pd,
+        const struct Knot *knots, const uint knots_len,
+        const struct Knot *k,
         const double error_sq_max,
-        const uint dims)
+        const uint dims,
+        struct KnotRefitState *r_state, double *r_value)
 {
 	assert(k->can_remove);
 
+	const struct Knot *k_prev = &pd->knots[k->prev];
+	const struct Knot *k_next = &pd->knots[k->next];
+
 #ifdef USE_KNOT_REFIT_REMOVE
 	(void)knots_len;
 
@@ -613,45 +1227,32 @@ static void knot_refit_error_recalculate(
 
 		/* First check if we can remove, this allows to refit and remove as we go. */
 		const double cost_sq = knot_calc_curve_error_value_and_index(
-		        p->pd, k->prev, k->next,
-		        k->prev->tan[1], k->next->tan[0],
+		        pd, k_prev, k_next,
+		        k_prev->tan[1], k_next->tan[0],
 		        dims,
 		        handles, &refit_index);
 
 		if (cost_sq < error_sq_max) {
-			struct KnotRefitState *r;
-			if (k->heap_node) {
-				r = HEAP_node_ptr(k->heap_node);
-			}
-			else {
-#ifdef USE_TPOOL
-				r = refit_pool_elem_alloc(p->epool);
-#else
-				r = malloc(sizeof(*r));
-#endif
-				r->index = k->index;
-			}
+			r_state->index = k->index;
+			r_state->index_refit = SPLIT_POINT_INVALID;
 
-			r->index_refit = SPLIT_POINT_INVALID;
+			r_state->handles_prev[0] = handles[0];
+			r_state->handles_prev[1] = 0.0;  /* unused */
+			r_state->handles_next[0] = 0.0;  /* unused */
+			r_state->handles_next[1] = handles[1];
 
-			r->handles_prev[0] = handles[0];
-			r->handles_prev[1] = 0.0;  /* unused */
-			r->handles_next[0] = 0.0;  /* unused */
-			r->handles_next[1] = handles[1];
-
-			r->error_sq[0] = r->error_sq[1] = cost_sq;
+			r_state->error_sq[0] = r_state->error_sq[1] = cost_sq;
 
 			/* Always perform removal before refitting, (make a negative number) */
-			HEAP_insert_or_update(p->heap, &k->heap_node, cost_sq - error_sq_max, r);
-
-			return;
+			*r_value = cost_sq - error_sq_max;
+			return true;
 		}
 	}
 #else
 	(void)error_sq_max;
 
 	const uint refit_index = knot_find_split_point(
-	         p->pd, k->prev, k->next,
+	         pd, k_prev, k_next,
 	         knots_len,
 	         dims);
 
@@ -660,67 +1261,83 @@ static void knot_refit_error_recalculate(
 	if ((refit_index == SPLIT_POINT_INVALID) ||
 	    (refit_index == k->index))
 	{
-		goto remove;
+		return false;
 	}
 
-	struct Knot *k_refit = &knots[refit_index];
+	const struct Knot *k_refit = &knots[refit_index];
 
-	const double cost_sq_src_max = MAX2(k->prev->error_sq_next, k->error_sq_next);
+	const double cost_sq_src_max = MAX2(pd->knots_fit[k->prev].error_sq_next, pd->knots_fit[k->index].error_sq_next);
 	assert(cost_sq_src_max <= error_sq_max);
 
 	double cost_sq_dst[2];
 	double handles_prev[2], handles_next[2];
 
 	if ((((cost_sq_dst[0] = knot_calc_curve_error_value(
-	           p->pd, k->prev, k_refit,
-	           k->prev->tan[1], k_refit->tan[0],
+	           pd, k_prev, k_refit,
+	           k_prev->tan[1], k_refit->tan[0],
 	           dims,
 	           handles_prev)) < cost_sq_src_max) &&
 	     ((cost_sq_dst[1] = knot_calc_curve_error_value(
-	           p->pd, k_refit, k->next,
-	           k_refit->tan[1], k->next->tan[0],
+	           pd, k_refit, k_next,
+	           k_refit->tan[1], k_next->tan[0],
 	           dims,
 	           handles_next)) < cost_sq_src_max)))
 	{
-		{
-			struct KnotRefitState *r;
-			if (k->heap_node) {
-				r = HEAP_node_ptr(k->heap_node);
-			}
-			else {
-#ifdef USE_TPOOL
-				r = refit_pool_elem_alloc(p->epool);
-#else
-				r = malloc(sizeof(*r));
-#endif
-				r->index = k->index;
-			}
+		r_state->index = k->index;
+		r_state->index_refit = refit_index;
 
-			r->index_refit = refit_index;
+		r_state->handles_prev[0] = handles_prev[0];
+		r_state->handles_prev[1] = handles_prev[1];
 
-			r->handles_prev[0] = handles_prev[0];
-			r->handles_prev[1] = handles_prev[1];
+		r_state->handles_next[0] = handles_next[0];
+		r_state->handles_next[1] = handles_next[1];
 
-			r->handles_next[0] = handles_next[0];
-			r->handles_next[1] = handles_next[1];
+		r_state->error_sq[0] = cost_sq_dst[0];
+		r_state->error_sq[1] = cost_sq_dst[1];
 
-			r->error_sq[0] = cost_sq_dst[0];
-			r->error_sq[1] = cost_sq_dst[1];
+		const double cost_sq_dst_max = MAX2(cost_sq_dst[0], cost_sq_dst[1]);
 
-			const double cost_sq_dst_max = MAX2(cost_sq_dst[0], cost_sq_dst[1]);
+		assert(cost_sq_dst_max < cost_sq_src_max);
 
-			assert(cost_sq_dst_max < cost_sq_src_max);
+		/* Weight for the greatest improvement */
+		*r_value = cost_sq_src_max - cost_sq_dst_max;
+		return true;
+	}
+	return false;
+}
+
+static void knot_refit_error_recalculate(
+        struct KnotRefit_Params *p,
+        struct Knot *knots, const uint knots_len,
+        struct Knot *k,
+        const double error_sq_max,
+        const uint dims)
+{
+	struct KnotRefitState r_calc;
+	double value;
 
-			/* Weight for the greatest improvement */
-			HEAP_insert_or_update(p->heap, &k->heap_node, cost_sq_src_max - cost_sq_dst_max, r);
+	if (knot_refit_error_calc(p->pd, knots, knots_len, k, error_sq_max, dims, &r_calc, &value)) {
+		struct KnotRefitState *r;
+		if (k->heap_node) {
+			r = HEAP_node_ptr(k->heap_node);
 		}
+		else {
+#ifdef USE_TPOOL
+			r = refit_pool_elem_alloc(p->epool);
+#else
+			r = malloc(sizeof(*r));
+#endif
+		}
+
+		*r = r_calc;
+
+		refit_heap_insert_or_update(p->pd, p->heap, &k->heap_node, value, r);
 	}
 	else {
-remove:
 		if (k->heap_node) {
 			struct KnotRefitState *r;
 			r = HEAP_node_ptr(k->heap_node);
-			HEAP_remove(p->heap, k->heap_node);
+			refit_heap_remove(p->pd, p->heap, k->heap_node);
 
 #ifdef USE_TPOOL
 			refit_pool_elem_free(p->epool, r);
@@ -743,38 +1360,89 @@ static uint curve_incremental_simplify_refit(
         const double error_sq_max,
         const uint dims)
 {
+	struct CurveFitRefitCache *cache = refit_cache_ensure(pd->ctx);
+
 #ifdef USE_TPOOL
-	struct ElemPool_KnotRefitState epool;
+	struct ElemPool_KnotRefitState *epool = &cache->refit_pool;
 
-	refit_pool_create(&epool, 0);
+	refit_pool_clear(epool);
 #endif
 
-	Heap *heap = HEAP_new(knots_len_remaining);
+	Heap *heap = cache->heap;
 
 	struct KnotRefit_Params params = {
 	    .pd = pd,
 	    .heap = heap,
 #ifdef USE_TPOOL
-	    .epool = &epool,
+	    .epool = epool,
 #endif
 	};
 
-	for (uint i = 0; i < knots_len; i++) {
-		struct Knot *k = &knots[i];
-		if (k->can_remove &&
-		    (k->is_removed == false) &&
-		    (k->is_corner == false) &&
-		    (k->prev && k->next))
+#ifdef USE_PARALLEL
+	if (refit_seed_use_parallel(pd, knots_len)) {
+		double *seed_values;
+		struct KnotRefitState *seed_states = refit_seed_buffer_ensure(
+		        pd, knots_len, sizeof(*seed_states), &seed_values);
+
+#pragma omp parallel
 		{
-			knot_refit_error_recalculate(&params, knots, knots_len, k, error_sq_max, dims);
+			struct PointData pd_task;
+			struct CurveFitContext ctx_task;
+			struct CurveFitStats stats_task;
+			refit_seed_task_begin(&pd_task, &ctx_task, &stats_task, pd);
+
+#pragma omp for schedule(dynamic, PARALLEL_SEED_CHUNK)
+			for (uint i = 0; i < knots_len; i++) {
+				const struct Knot *k = &knots[i];
+				if (!(k->can_remove &&
+				      (k->is_removed == false) &&
+				      (k->is_corner == false) &&
+				      (k->prev != KNOT_INDEX_NONE) && (k->next != KNOT_INDEX_NONE) &&
+				      knot_refit_error_calc(
+				              &pd_task, knots, knots_len, k, error_sq_max, dims,
+				              &seed_states[i], &seed_values[i])))
+				{
+					seed_states[i].index = SPLIT_POINT_INVALID;
+				}
+			}
+
+			refit_seed_task_end(&pd_task, pd);
+		}
+
+		for (uint i = 0; i < knots_len; i++) {
+			if (seed_states[i].index != SPLIT_POINT_INVALID) {
+#ifdef USE_TPOOL
+				struct KnotRefitState *r = refit_pool_elem_alloc(epool);
+#else
+				struct KnotRefitState *r = malloc(sizeof(*r));
+#endif
+				*r = seed_states[i];
+				refit_heap_insert_or_update(pd, heap, &knots[i].heap_node, seed_values[i], r);
+			}
+		}
+	}
+	else
+#endif  /* USE_PARALLEL */
+	{
+		for (uint i = 0; i < knots_len; i++) {
+			struct Knot *k = &knots[i];
+			if (k->can_remove &&
+			    (k->is_removed == false) &&
+			    (k->is_corner == false) &&
+			    (k->prev != KNOT_INDEX_NONE) && (k->next != KNOT_INDEX_NONE))
+			{
+				knot_refit_error_recalculate(&params, knots, knots_len, k, error_sq_max, dims);
+			}
 		}
 	}
 
+	struct KnotFit *knots_fit = pd->knots_fit;
+
 	while (HEAP_is_empty(heap) == false) {
 		struct Knot *k_old, *k_refit;
 
 		{
-			struct KnotRefitState *r = HEAP_popmin(heap);
+			struct KnotRefitState *r = refit_heap_popmin(pd, heap);
 			k_old = &knots[r->index];
 			k_old->heap_node = NULL;
 
@@ -786,15 +1454,15 @@ static uint curve_incremental_simplify_refit(
 #endif
 			{
 				k_refit = &knots[r->index_refit];
-				k_refit->handles[0] = r->handles_prev[1];
-				k_refit->handles[1] = r->handles_next[0];
+				knots_fit[k_refit->index].handles[0] = r->handles_prev[1];
+				knots_fit[k_refit->index].handles[1] = r->handles_next[0];
 			}
 
-			k_old->prev->handles[1] = r->handles_prev[0];
-			k_old->next->handles[0] = r->handles_next[1];
+			knots_fit[k_old->prev].handles[1] = r->handles_prev[0];
+			knots_fit[k_old->next].handles[0] = r->handles_next[1];
 
 #ifdef USE_TPOOL
-			refit_pool_elem_free(&epool, r);
+			refit_pool_elem_free(epool, r);
 #else
 			free(r);
 #endif
@@ -804,17 +1472,17 @@ static uint curve_incremental_simplify_refit(
 			continue;
 		}
 
-		struct Knot *k_prev = k_old->prev;
-		struct Knot *k_next = k_old->next;
+		struct Knot *k_prev = &knots[k_old->prev];
+		struct Knot *k_next = &knots[k_old->next];
 
-		k_old->next = NULL;
-		k_old->prev = NULL;
+		k_old->next = KNOT_INDEX_NONE;
+		k_old->prev = KNOT_INDEX_NONE;
 		k_old->is_removed = true;
 
 #ifdef USE_KNOT_REFIT_REMOVE
 		if (k_refit == NULL) {
-			k_next->prev = k_prev;
-			k_prev->next = k_next;
+			k_next->prev = k_prev->index;
+			k_prev->next = k_next->index;
 
 			knots_len_remaining -= 1;
 		}
@@ -822,28 +1490,28 @@ static uint curve_incremental_simplify_refit(
 #endif
 		{
 			/* Remove ourselves */
-			k_next->prev = k_refit;
-			k_prev->next = k_refit;
+			k_next->prev = k_refit->index;
+			k_prev->next = k_refit->index;
 
-			k_refit->prev = k_prev;
-			k_refit->next = k_next;
+			k_refit->prev = k_prev->index;
+			k_refit->next = k_next->index;
 			k_refit->is_removed = false;
 		}
 
-		if (k_prev->can_remove && (k_prev->is_corner == false) && (k_prev->prev && k_prev->next)) {
+		if (k_prev->can_remove && (k_prev->is_corner == false) &&
+		    (k_prev->prev != KNOT_INDEX_NONE) && (k_prev->next != KNOT_INDEX_NONE))
+		{
 			knot_refit_error_recalculate(&params, knots, knots_len, k_prev, error_sq_max, dims);
 		}
 
-		if (k_next->can_remove && (k_next->is_corner == false) && (k_next->prev && k_next->next)) {
+		if (k_next->can_remove && (k_next->is_corner == false) &&
+		    (k_next->prev != KNOT_INDEX_NONE) && (k_next->next != KNOT_INDEX_NONE))
+		{
 			knot_refit_error_recalculate(&params, knots, knots_len, k_next, error_sq_max, dims);
 		}
 	}
 
-#ifdef USE_TPOOL
-	refit_pool_destroy(&epool);
-#endif
-
-	HEAP_free(heap, free);
+	assert(HEAP_is_empty(heap));
 
 	return knots_len_remaining;
 }
@@ -862,14 +1530,17 @@ struct KnotCorner_Params {
 };
 
 /**
- * (Re)calculate the error incurred from turning this into a corner.
+ * Calculate the state for turning \a k_split into a corner (doesn't change the heap).
+ *
+ * \return false when the corner exceeds \a error_sq_max.
  */
-static void knot_corner_error_recalculate(
-        struct KnotCorner_Params *p,
-        struct Knot *k_split,
-        struct Knot *k_prev, struct Knot *k_next,
+static bool knot_corner_error_calc(
+        const struct PointData *pd,
+        const struct Knot *k_split,
+        const struct Knot *k_prev, const struct Knot *k_next,
         const double error_sq_max,
-        const uint dims)
+        const uint dims,
+        struct KnotCornerState *r_state, double *r_value)
 {
 	assert(k_prev->can_remove && k_next->can_remove);
 
@@ -878,16 +1549,51 @@ static void knot_corner_error_recalculate(
 	double cost_sq_dst[2];
 
 	if (((cost_sq_dst[0] = knot_calc_curve_error_value(
-	          p->pd, k_prev, k_split,
+	          pd, k_prev, k_split,
 	          k_prev->tan[1], k_prev->tan[1],
 	          dims,
 	          handles_prev)) < error_sq_max) &&
 	    ((cost_sq_dst[1] = knot_calc_curve_error_value(
-	          p->pd, k_split, k_next,
+	          pd, k_split, k_next,
 	          k_next->tan[0], k_next->tan[0],
 	          dims,
 	          handles_next)) < error_sq_max))
 	{
+		r_state->index = k_split->index;
+
+		r_state->index_adjacent[0] = k_prev->index;
+		r_state->index_adjacent[1] = k_next->index;
+
+		/* Need to store handle lengths for both sides */
+		r_state->handles_prev[0] = handles_prev[0];
+		r_state->handles_prev[1] = handles_prev[1];
+
+		r_state->handles_next[0] = handles_next[0];
+		r_state->handles_next[1] = handles_next[1];
+
+		r_state->error_sq[0] = cost_sq_dst[0];
+		r_state->error_sq[1] = cost_sq_dst[1];
+
+		*r_value = MAX2(cost_sq_dst[0], cost_sq_dst[1]);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * (Re)calculate the error incurred from turning this into a corner.
+ */
+static void knot_corner_error_recalculate(
+        struct KnotCorner_Params *p,
+        struct Knot *k_split,
+        struct Knot *k_prev, struct Knot *k_next,
+        const double error_sq_max,
+        const uint dims)
+{
+	struct KnotCornerState c_calc;
+	double cost_max_sq;
+
+	if (knot_corner_error_calc(p->pd, k_split, k_prev, k_next, error_sq_max, dims, &c_calc, &cost_max_sq)) {
 		struct KnotCornerState *c;
 		if (k_split->heap_node) {
 			c = HEAP_node_ptr(k_split->heap_node);
@@ -898,30 +1604,17 @@ static void knot_corner_error_recalculate(
 #else
 			c = malloc(sizeof(*c));
 #endif
-			c->index = k_split->index;
 		}
 
-		c->index_adjacent[0] = k_prev->index;
-		c->index_adjacent[1] = k_next->index;
+		*c = c_calc;
 
-		/* Need to store handle lengths for both sides */
-		c->handles_prev[0] = handles_prev[0];
-		c->handles_prev[1] = handles_prev[1];
-
-		c->handles_next[0] = handles_next[0];
-		c->handles_next[1] = handles_next[1];
-
-		c->error_sq[0] = cost_sq_dst[0];
-		c->error_sq[1] = cost_sq_dst[1];
-
-		const double cost_max_sq = MAX2(cost_sq_dst[0], cost_sq_dst[1]);
-		HEAP_insert_or_update(p->heap, &k_split->heap_node, cost_max_sq, c);
+		refit_heap_insert_or_update(p->pd, p->heap, &k_split->heap_node, cost_max_sq, c);
 	}
 	else {
 		if (k_split->heap_node) {
 			struct KnotCornerState *c;
 			c = HEAP_node_ptr(k_split->heap_node);
-			HEAP_remove(p->heap, k_split->heap_node);
+			refit_heap_remove(p->pd, p->heap, k_split->heap_node);
 #ifdef USE_TPOOL
 			corner_pool_elem_free(p->epool, c);
 #else
@@ -933,6 +1626,78 @@ static void knot_corner_error_recalculate(
 }
 
 
+/**
+ * Find a knot between \a k_prev & the next knot to use as a corner,
+ * when the angle between them exceeds the corner angle.
+ *
+ * \return the knot to split at or NULL.
+ */
+static struct Knot *knot_corner_find_split(
+        const struct PointData *pd,
+        struct Knot *knots, const uint knots_len,
+        const struct Knot *k_prev,
+        const double corner_angle_cos, const double error_sq_collapse_max,
+        const uint dims)
+{
+	if (!((k_prev->is_removed == false) &&
+	      (k_prev->can_remove == true) &&
+	      ((k_prev->next != KNOT_INDEX_NONE) && knots[k_prev->next].can_remove)))
+	{
+		return NULL;
+	}
+
+	const struct Knot *k_next = &knots[k_prev->next];
+
+	const double *k_prev_tan[2] = {knot_tan(pd, k_prev, 0, dims), knot_tan(pd, k_prev, 1, dims)};
+	const double *k_next_tan[2] = {knot_tan(pd, k_next, 0, dims), knot_tan(pd, k_next, 1, dims)};
+
+	/* Angle outside threshold */
+	if (dot_vnvn(k_prev_tan[0], k_next_tan[1], dims) < corner_angle_cos) {
+#ifdef USE_VLA
+		double plane_no[dims];
+		double k_proj_ref[dims];
+		double k_proj_split[dims];
+#else
+		double *plane_no =       alloca(sizeof(double) * dims);
+		double *k_proj_ref =     alloca(sizeof(double) * dims);
+		double *k_proj_split =   alloca(sizeof(double) * dims);
+#endif
+
+		/* Measure distance projected onto a plane,
+		 * since the points may be offset along their own tangents. */
+		sub_vn_vnvn(plane_no, k_next_tan[0], k_prev_tan[1], dims);
+
+		/* Compare 2x so as to allow both to be changed by maximum of error_sq_max */
+		const uint split_index = knot_find_split_point_on_axis(
+		        pd, k_prev, k_next,
+		        knots_len,
+		        plane_no,
+		        dims);
+
+		if (split_index != SPLIT_POINT_INVALID) {
+			const double *co_prev  = &pd->points[k_prev->index * dims];
+			const double *co_next  = &pd->points[k_next->index * dims];
+			const double *co_split = &pd->points[split_index * dims];
+
+			project_vn_vnvn_normalized(k_proj_ref,   co_prev, k_prev_tan[1], dims);
+			project_vn_vnvn_normalized(k_proj_split, co_split, k_prev_tan[1], dims);
+
+			if (len_squared_vnvn(k_proj_ref, k_proj_split, dims) < error_sq_collapse_max) {
+
+				project_vn_vnvn_normalized(k_proj_ref,   co_next, k_next_tan[0], dims);
+				project_vn_vnvn_normalized(k_proj_split, co_split, k_next_tan[0], dims);
+
+				if (len_squared_vnvn(k_proj_ref, k_proj_split, dims) < error_sq_collapse_max) {
+					return &knots[split_index];
+				}
+			}
+		}
+	}
+
+	return NULL;
+}
+
+
 /**
  * Attempt to collapse close knots into corners,
  * as long as they fall below the error threshold.
@@ -945,88 +1710,95 @@ static uint curve_incremental_simplify_corners(
         const uint dims,
         uint *r_corner_index_len)
 {
+	struct CurveFitRefitCache *cache = refit_cache_ensure(pd->ctx);
+
 #ifdef USE_TPOOL
-	struct ElemPool_KnotCornerState epool;
+	struct ElemPool_KnotCornerState *epool = &cache->corner_pool;
 
-	corner_pool_create(&epool, 0);
+	corner_pool_clear(epool);
 #endif
 
-	Heap *heap = HEAP_new(0);
+	Heap *heap = cache->heap;
 
 	struct KnotCorner_Params params = {
 	    .pd = pd,
 	    .heap = heap,
 #ifdef USE_TPOOL
-	    .epool = &epool,
+	    .epool = epool,
 #endif
 	};
 
-#ifdef USE_VLA
-	double plane_no[dims];
-	double k_proj_ref[dims];
-	double k_proj_split[dims];
-#else
-	double *plane_no =       alloca(sizeof(double) * dims);
-	double *k_proj_ref =     alloca(sizeof(double) * dims);
-	double *k_proj_split =   alloca(sizeof(double) * dims);
-#endif
-
 	const double corner_angle_cos = cos(corner_angle);
 
 	uint corner_index_len = 0;
 
-	for (uint i = 0; i < knots_len; i++) {
-		if ((knots[i].is_removed == false) &&
-		    (knots[i].can_remove == true) &&
-		    (knots[i].next && knots[i].next->can_remove))
-		{
-			struct Knot *k_prev = &knots[i];
-			struct Knot *k_next = k_prev->next;
-
-			/* Angle outside threshold */
-			if (dot_vnvn(k_prev->tan[0], k_next->tan[1], dims) < corner_angle_cos) {
-				/* Measure distance projected onto a plane,
-				 * since the points may be offset along their own tangents. */
-				sub_vn_vnvn(plane_no, k_next->tan[0], k_prev->tan[1], dims);
-
-				/* Compare 2x so as to allow both to be changed by maximum of error_sq_max */
-				const uint split_index = knot_find_split_point_on_axis(
-				        pd, k_prev, k_next,
-				        knots_len,
-				        plane_no,
-				        dims);
-
-				if (split_index != SPLIT_POINT_INVALID) {
-					const double *co_prev  = &params.pd->points[k_prev->index * dims];
-					const double *co_next  = &params.pd->points[k_next->index * dims];
-					const double *co_split = &params.pd->points[split_index * dims];
+#ifdef USE_PARALLEL
+	if (refit_seed_use_parallel(pd, knots_len)) {
+		double *seed_values;
+		struct KnotCornerState *seed_states = refit_seed_buffer_ensure(
+		        pd, knots_len, sizeof(*seed_states), &seed_values);
 
-					project_vn_vnvn_normalized(k_proj_ref,   co_prev, k_prev->tan[1], dims);
-					project_vn_vnvn_normalized(k_proj_split, co_split, k_prev->tan[1], dims);
-
-					if (len_squared_vnvn(k_proj_ref, k_proj_split, dims) < error_sq_collapse_max) {
-
-						project_vn_vnvn_normalized(k_proj_ref,   co_next, k_next->tan[0], dims);
-						project_vn_vnvn_normalized(k_proj_split, co_split, k_next->tan[0], dims);
+#pragma omp parallel
+		{
+			struct PointData pd_task;
+			struct CurveFitContext ctx_task;
+			struct CurveFitStats stats_task;
+			refit_seed_task_begin(&pd_task, &ctx_task, &stats_task, pd);
 
-						if (len_squared_vnvn(k_proj_ref, k_proj_split, dims) < error_sq_collapse_max) {
+#pragma omp for schedule(dynamic, PARALLEL_SEED_CHUNK)
+			for (uint i = 0; i < knots_len; i++) {
+				const struct Knot *k_prev = &knots[i];
+				const struct Knot *k_split = knot_corner_find_split(
+				        &pd_task, knots, knots_len, k_prev,
+				        corner_angle_cos, error_sq_collapse_max,
+				        dims);
+				if (!(k_split && knot_corner_error_calc(
+				          &pd_task, k_split, k_prev, &knots[k_prev->next], error_sq_max, dims,
+				          &seed_states[i], &seed_values[i])))
+				{
+					seed_states[i].index = SPLIT_POINT_INVALID;
+				}
+			}
 
-							struct Knot *k_split = &knots[split_index];
+			refit_seed_task_end(&pd_task, pd);
+		}
 
-							knot_corner_error_recalculate(
-							        &params,
-							        k_split, k_prev, k_next,
-							        error_sq_max,
-							        dims);
-						}
-					}
-				}
+		/* Each split is between a different pair of knots, so only ever added once. */
+		for (uint i = 0; i < knots_len; i++) {
+			if (seed_states[i].index != SPLIT_POINT_INVALID) {
+#ifdef USE_TPOOL
+				struct KnotCornerState *c = corner_pool_elem_alloc(epool);
+#else
+				struct KnotCornerState *c = malloc(sizeof(*c));
+#endif
+				*c = seed_states[i];
+				refit_heap_insert_or_update(pd, heap, &knots[c->index].heap_node, seed_values[i], c);
+			}
+		}
+	}
+	else
+#endif  /* USE_PARALLEL */
+	{
+		for (uint i = 0; i < knots_len; i++) {
+			struct Knot *k_prev = &knots[i];
+			struct Knot *k_split = knot_corner_find_split(
+			        pd, knots, knots_len, k_prev,
+			        corner_angle_cos, error_sq_collapse_max,
+			        dims);
+			if (k_split) {
+				knot_corner_error_recalculate(
+				        &params,
+				        k_split, k_prev, &knots[k_prev->next],
+				        error_sq_max,
+				        dims);
 			}
 		}
 	}
 
+	struct KnotFit *knots_fit = pd->knots_fit;
+
 	while (HEAP_is_empty(heap) == false) {
-		struct KnotCornerState *c = HEAP_popmin(heap);
+		struct KnotCornerState *c = refit_heap_popmin(pd, heap);
 
 		struct Knot *k_split = &knots[c->index];
 
@@ -1036,28 +1808,28 @@ static uint curve_incremental_simplify_corners(
 
 		/* Insert */
 		k_split->is_removed = false;
-		k_split->prev = k_prev;
-		k_split->next = k_next;
-		k_prev->next = k_split;
-		k_next->prev = k_split;
+		k_split->prev = k_prev->index;
+		k_split->next = k_next->index;
+		k_prev->next = k_split->index;
+		k_next->prev = k_split->index;
 
 		/* Update tangents */
 		k_split->tan[0] = k_prev->tan[1];
 		k_split->tan[1] = k_next->tan[0];
 
 		/* Own handles */
-		k_prev->handles[1]  = c->handles_prev[0];
-		k_split->handles[0] = c->handles_prev[1];
-		k_split->handles[1] = c->handles_next[0];
-		k_next->handles[0]  = c->handles_next[1];
+		knots_fit[k_prev->index].handles[1]  = c->handles_prev[0];
+		knots_fit[k_split->index].handles[0] = c->handles_prev[1];
+		knots_fit[k_split->index].handles[1] = c->handles_next[0];
+		knots_fit[k_next->index].handles[0]  = c->handles_next[1];
 
-		k_prev->error_sq_next  = c->error_sq[0];
-		k_split->error_sq_next = c->error_sq[1];
+		knots_fit[k_prev->index].error_sq_next  = c->error_sq[0];
+		knots_fit[k_split->index].error_sq_next = c->error_sq[1];
 
 		k_split->heap_node = NULL;
 
 #ifdef USE_TPOOL
-		corner_pool_elem_free(&epool, c);
+		corner_pool_elem_free(epool, c);
 #else
 		free(c);
 #endif
@@ -1069,11 +1841,7 @@ static uint curve_incremental_simplify_corners(
 		corner_index_len++;
 	}
 
-#ifdef USE_TPOOL
-	corner_pool_destroy(&epool);
-#endif
-
-	HEAP_free(heap, free);
+	assert(HEAP_is_empty(heap));
 
 	*r_corner_index_len = corner_index_len;
 
@@ -1082,22 +1850,44 @@ static uint curve_incremental_simplify_corners(
 
 #endif  /* USE_CORNER_DETECT */
 
-int curve_fit_cubic_to_points_refit_db(
+/**
+ * Implements #curve_fit_cubic_to_points_refit_db & #curve_fit_cubic_to_points_refit_fl.
+ *
+ * \param r_cubic_array_fl: When set, the resulting cubics are written as floats
+ * (\a r_cubic_array is ignored).
+ */
+static int cubic_to_points_refit(
         const double *points,
-        const uint    points_len,
+        uint          points_len,
         const uint    dims,
-        const double  error_threshold,
+        double        error_threshold,
         const uint    calc_flag,
         const uint   *corners,
         const uint    corners_len,
         const double  corner_angle,
 
-        double **r_cubic_array, uint *r_cubic_array_len,
+        double **r_cubic_array, float **r_cubic_array_fl, uint *r_cubic_array_len,
         uint   **r_cubic_orig_index,
-        uint   **r_corner_index_array, uint *r_corner_index_len)
+        uint   **r_corner_index_array, uint *r_corner_index_len,
+        struct CurveFitContext *ctx)
 {
+	assert(ctx != NULL);
+	bool is_output_alloc_fail = false;
+
+	/* Maps the decimated points back to the input points. */
+	const uint *decimate_index = NULL;
+	if ((calc_flag & CURVE_FIT_CALC_DECIMATE) && (points_len > 2)) {
+		const double error_threshold_decimate = error_threshold * ctx->decimate_factor;
+		decimate_index = curve_fit_points_decimate_db(
+		        ctx, points, points_len, dims, error_threshold_decimate, corners, corners_len,
+		        &points, &points_len, &corners);
+		error_threshold -= error_threshold_decimate;
+	}
+
 	const uint knots_len = points_len;
-	struct Knot *knots = malloc(sizeof(struct Knot) * knots_len);
+	struct Knot *knots = curve_fit_buffer_ensure(ctx, &ctx->refit_knots, sizeof(struct Knot) * knots_len);
+	struct KnotFit *knots_fit = curve_fit_buffer_ensure(
+	        ctx, &ctx->refit_knots_fit, sizeof(struct KnotFit) * knots_len);
 
 #ifndef USE_CORNER_DETECT
 	(void)r_corner_index_array;
@@ -1111,43 +1901,33 @@ int curve_fit_cubic_to_points_refit_db(
 	(void)corner_angle;
 #endif
 
-	/* Over alloc the list x2 for cyclic curves,
-	 * so we can evaluate across the start/end */
-	double *points_alloc = NULL;
-	if (is_cyclic) {
-		points_alloc = malloc((sizeof(double) * points_len * dims) * 2);
-		memcpy(points_alloc,                       points,       sizeof(double) * points_len * dims);
-		memcpy(points_alloc + (points_len * dims), points_alloc, sizeof(double) * points_len * dims);
-		points = points_alloc;
-	}
-
-	double *tangents = malloc(sizeof(double) * knots_len * 2 * dims);
+	/* One tangent for each knot, corners passed in have a second tangent (after the knots). */
+	const uint tangents_len = knots_len + ((corners != NULL) ? corners_len : 0);
+	double *tangents = curve_fit_buffer_ensure(
+	        ctx, &ctx->refit_tangents, sizeof(double) * tangents_len * dims);
 
-	{
-		double *t_step = tangents;
-		for (uint i = 0; i < knots_len; i++) {
-			knots[i].next = (knots + i) + 1;
-			knots[i].prev = (knots + i) - 1;
-
-			knots[i].heap_node = NULL;
-			knots[i].index = i;
-			knots[i].can_remove = true;
-			knots[i].is_removed = false;
-			knots[i].is_corner = false;
-			knots[i].error_sq_next = 0.0;
-			knots[i].tan[0] = t_step; t_step += dims;
-			knots[i].tan[1] = t_step; t_step += dims;
-		}
-		assert(t_step == &tangents[knots_len * 2 * dims]);
+	for (uint i = 0; i < knots_len; i++) {
+		knots[i].next = i + 1;
+		knots[i].prev = i - 1;
+
+		knots[i].heap_node = NULL;
+		knots[i].index = i;
+		knots[i].can_remove = true;
+		knots[i].is_removed = false;
+		knots[i].is_corner = false;
+		knots[i].tan[0] = i;
+		knots[i].tan[1] = i;
+
+		knots_fit[i].error_sq_next = 0.0;
 	}
 
 	if (is_cyclic) {
-		knots[0].prev = &knots[knots_len - 1];
-		knots[knots_len - 1].next = &knots[0];
+		knots[0].prev = knots_len - 1;
+		knots[knots_len - 1].next = 0;
 	}
 	else {
-		knots[0].prev = NULL;
-		knots[knots_len - 1].next = NULL;
+		knots[0].prev = KNOT_INDEX_NONE;
+		knots[knots_len - 1].next = KNOT_INDEX_NONE;
 
 		/* always keep end-points */
 		knots[0].can_remove = false;
@@ -1166,10 +1946,12 @@ int curve_fit_cubic_to_points_refit_db(
 			const uint i_next = (is_cyclic && i_curr == knots_end) ? 0 : i_curr + 1;
 
 			struct Knot *k = &knots[i_curr];
-			k->handles[0] = normalize_vn_vnvn(
-			        k->tan[0], &points[i_prev * dims], &points[i_curr * dims], dims) /  3;
-			k->handles[1] = normalize_vn_vnvn(
-			        k->tan[1], &points[i_curr * dims], &points[i_next * dims], dims) / -3;
+			struct KnotFit *k_fit = &knots_fit[i_curr];
+			k->tan[1] = knots_len + corner_i;
+			k_fit->handles[0] = normalize_vn_vnvn(
+			        &tangents[k->tan[0] * dims], &points[i_prev * dims], &points[i_curr * dims], dims) /  3;
+			k_fit->handles[1] = normalize_vn_vnvn(
+			        &tangents[k->tan[1] * dims], &points[i_curr * dims], &points[i_next * dims], dims) / -3;
 
 			k->is_corner = true;
 		}
@@ -1178,7 +1960,8 @@ int curve_fit_cubic_to_points_refit_db(
 	}
 
 #ifdef USE_LENGTH_CACHE
-	double *points_length_cache = malloc(sizeof(double) * points_len * (is_cyclic ? 2 : 1));
+	double *points_length_cache = curve_fit_buffer_ensure(
+	        ctx, &ctx->refit_length_cache, sizeof(double) * points_len);
 #endif
 
 	/* Initialize tangents,
@@ -1197,10 +1980,11 @@ int curve_fit_cubic_to_points_refit_db(
 		/* 2x normalize calculations, but correct */
 
 		for (uint i = 0; i < knots_len; i++) {
-			Knot *k = &knots[i];
+			struct Knot *k = &knots[i];
+			double *k_tan = &tangents[k->tan[0] * dims];
 
-			if (k->prev) {
-				sub_vn_vnvn(tan_prev, &points[k->prev->index * dims], &points[k->index * dims], dims);
+			if (k->prev != KNOT_INDEX_NONE) {
+				sub_vn_vnvn(tan_prev, &points[k->prev * dims], &points[k->index * dims], dims);
 #ifdef USE_LENGTH_CACHE
 				points_length_cache[i] =
 #endif
@@ -1211,8 +1995,8 @@ int curve_fit_cubic_to_points_refit_db(
 				len_prev = 0.0;
 			}
 
-			if (k->next) {
-				sub_vn_vnvn(tan_next, &points[k->index * dims], &points[k->next->index * dims], dims);
+			if (k->next != KNOT_INDEX_NONE) {
+				sub_vn_vnvn(tan_next, &points[k->index * dims], &points[k->next * dims], dims);
 				len_next = normalize_vn(tan_next, dims);
 			}
 			else {
@@ -1220,21 +2004,18 @@ int curve_fit_cubic_to_points_refit_db(
 				len_next = 0.0;
 			}
 
-			add_vn_vnvn(k->tan[0], tan_prev, tan_next, dims);
-			normalize_vn(k->tan[0], dims);
-			copy_vnvn(k->tan[1], k->tan[0], dims);
-			k->handles[0] = len_prev /  3;
-			k->handles[1] = len_next / -3;
+			add_vn_vnvn(k_tan, tan_prev, tan_next, dims);
+			normalize_vn(k_tan, dims);
+			knots_fit[i].handles[0] = len_prev /  3;
+			knots_fit[i].handles[1] = len_next / -3;
 		}
 #else
 		if (knots_len < 2) {
 			/* NOP, set dummy values */
 			for (uint i = 0; i < knots_len; i++) {
-				struct Knot *k = &knots[i];
-				zero_vn(k->tan[0], dims);
-				zero_vn(k->tan[1], dims);
-				k->handles[0] = 0.0;
-				k->handles[1] = 0.0;
+				zero_vn(&tangents[i * dims], dims);
+				knots_fit[i].handles[0] = 0.0;
+				knots_fit[i].handles[1] = 0.0;
 #ifdef USE_LENGTH_CACHE
 				points_length_cache[i] = 0.0;
 #endif
@@ -1244,18 +2025,17 @@ int curve_fit_cubic_to_points_refit_db(
 			len_prev = normalize_vn_vnvn(
 			        tan_prev, &points[(knots_len - 2) * dims], &points[(knots_len - 1) * dims], dims);
 			for (uint i_curr = knots_len - 1, i_next = 0; i_next < knots_len; i_curr = i_next++) {
-				struct Knot *k = &knots[i_curr];
 #ifdef USE_LENGTH_CACHE
 				points_length_cache[i_next] =
 #endif
 				len_next = normalize_vn_vnvn(tan_next, &points[i_curr * dims], &points[i_next * dims], dims);
 
-				if (k->is_corner == false) {
-					add_vn_vnvn(k->tan[0], tan_prev, tan_next, dims);
-					normalize_vn(k->tan[0], dims);
-					copy_vnvn(k->tan[1], k->tan[0], dims);
-					k->handles[0] = len_prev /  3;
-					k->handles[1] = len_next / -3;
+				if (knots[i_curr].is_corner == false) {
+					double *k_tan = &tangents[i_curr * dims];
+					add_vn_vnvn(k_tan, tan_prev, tan_next, dims);
+					normalize_vn(k_tan, dims);
+					knots_fit[i_curr].handles[0] = len_prev /  3;
+					knots_fit[i_curr].handles[1] = len_next / -3;
 				}
 
 				copy_vnvn(tan_prev, tan_next, dims);
@@ -1270,26 +2050,23 @@ int curve_fit_cubic_to_points_refit_db(
 			len_prev = normalize_vn_vnvn(
 			        tan_prev, &points[0 * dims], &points[1 * dims], dims);
 			if (knots[0].is_corner == false) {
-				copy_vnvn(knots[0].tan[0], tan_prev, dims);
-				copy_vnvn(knots[0].tan[1], tan_prev, dims);
-				knots[0].handles[0] = len_prev /  3;
-				knots[0].handles[1] = len_prev / -3;
+				copy_vnvn(&tangents[0 * dims], tan_prev, dims);
+				knots_fit[0].handles[0] = len_prev /  3;
+				knots_fit[0].handles[1] = len_prev / -3;
 			}
 
 			for (uint i_curr = 1, i_next = 2; i_next < knots_len; i_curr = i_next++) {
-				struct Knot *k = &knots[i_curr];
-
 #ifdef USE_LENGTH_CACHE
 				points_length_cache[i_next] =
 #endif
 				len_next = normalize_vn_vnvn(tan_next, &points[i_curr * dims], &points[i_next * dims], dims);
 
-				if (k->is_corner == false) {
-					add_vn_vnvn(k->tan[0], tan_prev, tan_next, dims);
-					normalize_vn(k->tan[0], dims);
-					copy_vnvn(k->tan[1], k->tan[0], dims);
-					k->handles[0] = len_prev /  3;
-					k->handles[1] = len_next / -3;
+				if (knots[i_curr].is_corner == false) {
+					double *k_tan = &tangents[i_curr * dims];
+					add_vn_vnvn(k_tan, tan_prev, tan_next, dims);
+					normalize_vn(k_tan, dims);
+					knots_fit[i_curr].handles[0] = len_prev /  3;
+					knots_fit[i_curr].handles[1] = len_next / -3;
 				}
 
 				copy_vnvn(tan_prev, tan_next, dims);
@@ -1297,45 +2074,57 @@ int curve_fit_cubic_to_points_refit_db(
 			}
 
 			if (knots[knots_len - 1].is_corner == false) {
-				copy_vnvn(knots[knots_len - 1].tan[0], tan_next, dims);
-				copy_vnvn(knots[knots_len - 1].tan[1], tan_next, dims);
-
-				knots[knots_len - 1].handles[0] = len_next /  3;
-				knots[knots_len - 1].handles[1] = len_next / -3;
+				copy_vnvn(&tangents[(knots_len - 1) * dims], tan_next, dims);
+				knots_fit[knots_len - 1].handles[0] = len_next /  3;
+				knots_fit[knots_len - 1].handles[1] = len_next / -3;
 			}
 		}
 #endif
 	}
 
-#ifdef USE_LENGTH_CACHE
-	if (is_cyclic) {
-		memcpy(&points_length_cache[points_len], points_length_cache, sizeof(double) * points_len);
-	}
-#endif
-
 
 #if 0
 	for (uint i = 0; i < knots_len; i++) {
-		Knot *k = &knots[i];
-		printf("TAN %.8f %.8f %.8f %.8f\n", k->tan[0][0], k->tan[0][1], k->tan[1][0], k->tan[0][1]);
+		const struct Knot *k = &knots[i];
+		const double *k_tan_l = &tangents[k->tan[0] * dims], *k_tan_r = &tangents[k->tan[1] * dims];
+		printf("TAN %.8f %.8f %.8f %.8f\n", k_tan_l[0], k_tan_l[1], k_tan_r[0], k_tan_r[1]);
 	}
 #endif
 
-	const struct PointData pd = {
+	struct PointData pd = {
 		.points = points,
 		.points_len = points_len,
 #ifdef USE_LENGTH_CACHE
 		.points_length_cache = points_length_cache,
 #endif
+#ifdef USE_SPAN_CACHE
+		.span_cache = NULL,
+#endif
+		.knots = knots,
+		.knots_fit = knots_fit,
+		.tangents = tangents,
+		.ctx = ctx,
+		.calc_flag = calc_flag,
 	};
 
+#ifdef USE_SPAN_CACHE
+	span_cache_init(&pd, knots_len);
+#endif
+
 	uint knots_len_remaining = knots_len;
 
 	/* 'curve_incremental_simplify_refit' can be called here, but its very slow
 	 * just remove all within the threshold first. */
-	knots_len_remaining = curve_incremental_simplify(
-	        &pd, knots, knots_len, knots_len_remaining,
-	        SQUARE(error_threshold), dims);
+	if (calc_flag & CURVE_FIT_CALC_REFIT_ROUNDS) {
+		knots_len_remaining = curve_incremental_simplify_rounds(
+		        &pd, knots, knots_len, knots_len_remaining,
+		        SQUARE(error_threshold), dims);
+	}
+	else {
+		knots_len_remaining = curve_incremental_simplify(
+		        &pd, knots, knots_len, knots_len_remaining,
+		        SQUARE(error_threshold), dims);
+	}
 
 #ifdef USE_CORNER_DETECT
 	if (use_corner_detect) {
@@ -1369,32 +2158,38 @@ int curve_fit_cubic_to_points_refit_db(
 			*r_corner_index_len += 2;
 		}
 
-		uint *corner_index_array = malloc(sizeof(uint) * (*r_corner_index_len));
-		uint k_index = 0, c_index = 0;
-		uint i = 0;
-		const uint knots_len_clamped = is_cyclic ? knots_len : knots_len - 1;
+		uint *corner_index_array = curve_fit_output_alloc(
+		        ctx, CURVE_FIT_OUTPUT_CORNER_INDEX, sizeof(uint) * (*r_corner_index_len));
+		if (corner_index_array) {
+			uint k_index = 0, c_index = 0;
+			uint i = 0;
+			const uint knots_len_clamped = is_cyclic ? knots_len : knots_len - 1;
 
-		if (is_cyclic == false) {
-			corner_index_array[c_index++] = k_index;
-			k_index++;
-			i++;
-		}
+			if (is_cyclic == false) {
+				corner_index_array[c_index++] = k_index;
+				k_index++;
+				i++;
+			}
 
-		for (; i < knots_len_clamped; i++) {
-			if (knots[i].is_removed == false) {
-				if (knots[i].is_corner == true) {
-					corner_index_array[c_index++] = k_index;
+			for (; i < knots_len_clamped; i++) {
+				if (knots[i].is_removed == false) {
+					if (knots[i].is_corner == true) {
+						corner_index_array[c_index++] = k_index;
+					}
+					k_index++;
 				}
+			}
+
+			if (is_cyclic == false && knots_len > 1) {
+				corner_index_array[c_index++] = k_index;
 				k_index++;
 			}
-		}
 
-		if (is_cyclic == false && knots_len > 1) {
-			corner_index_array[c_index++] = k_index;
-			k_index++;
+			assert(c_index == *r_corner_index_len);
+		}
+		else {
+			is_output_alloc_fail = true;
 		}
-
-		assert(c_index == *r_corner_index_len);
 		*r_corner_index_array = corner_index_array;
 	}
 	else {
@@ -1403,19 +2198,18 @@ int curve_fit_cubic_to_points_refit_db(
 	}
 #endif  /* USE_CORNER_DETECT */
 
-#ifdef USE_LENGTH_CACHE
-	free(points_length_cache);
-#endif
-
 	uint *cubic_orig_index = NULL;
 
 	if (r_cubic_orig_index) {
-		cubic_orig_index = malloc(sizeof(uint) * knots_len_remaining);
+		cubic_orig_index = curve_fit_output_alloc(
+		        ctx, CURVE_FIT_OUTPUT_CUBIC_ORIG_INDEX, sizeof(uint) * knots_len_remaining);
+		if (cubic_orig_index == NULL) {
+			is_output_alloc_fail = true;
+		}
 	}
 
 	struct Knot *knots_first = NULL;
 	{
-		struct Knot *k;
 		for (uint i = 0; i < knots_len; i++) {
 			if (knots[i].is_removed == false) {
 				knots_first = &knots[i];
@@ -1424,9 +2218,9 @@ int curve_fit_cubic_to_points_refit_db(
 		}
 
 		if (cubic_orig_index) {
-			k = knots_first;
-			for (uint i = 0; i < knots_len_remaining; i++, k = k->next) {
-				cubic_orig_index[i] = k->index;
+			uint k_index = knots_first->index;
+			for (uint i = 0; i < knots_len_remaining; i++, k_index = knots[k_index].next) {
+				cubic_orig_index[i] = decimate_index ? decimate_index[k_index] : k_index;
 			}
 		}
 	}
@@ -1434,48 +2228,95 @@ int curve_fit_cubic_to_points_refit_db(
 	/* Correct unused handle endpoints - not essential, but nice behavior */
 	if (is_cyclic == false) {
 		struct Knot *knots_last = knots_first;
-		while (knots_last->next) {
-			knots_last = knots_last->next;
+		while (knots_last->next != KNOT_INDEX_NONE) {
+			knots_last = &knots[knots_last->next];
 		}
-		knots_first->handles[0] = -knots_first->handles[1];
-		knots_last->handles[1]  = -knots_last->handles[0];
+		knots_fit[knots_first->index].handles[0] = -knots_fit[knots_first->index].handles[1];
+		knots_fit[knots_last->index].handles[1]  = -knots_fit[knots_last->index].handles[0];
 	}
 
 	/* 3x for one knot and two handles */
-	double *cubic_array = malloc(sizeof(double) * knots_len_remaining * 3 * dims);
+	const uint cubic_array_flat_len = knots_len_remaining * 3 * dims;
+	void *cubic_array = curve_fit_output_alloc(
+	        ctx, CURVE_FIT_OUTPUT_CUBIC_ARRAY,
+	        (r_cubic_array_fl ? sizeof(float) : sizeof(double)) * cubic_array_flat_len);
 
-	{
-		double *c_step = cubic_array;
-		struct Knot *k = knots_first;
-		for (uint i = 0; i < knots_len_remaining; i++, k = k->next) {
-			const double *p = &points[k->index * dims];
-
-			madd_vn_vnvn_fl(c_step, p, k->tan[0], k->handles[0], dims);
-			c_step += dims;
-			copy_vnvn(c_step, p, dims);
-			c_step += dims;
-			madd_vn_vnvn_fl(c_step, p, k->tan[1], k->handles[1], dims);
-			c_step += dims;
+	if (cubic_array) {
+#ifdef USE_VLA
+		double c_knot[3 * dims];
+#else
+		double *c_knot = alloca(sizeof(double) * 3 * dims);
+#endif
+		uint k_index = knots_first->index;
+		for (uint i = 0; i < knots_len_remaining; i++, k_index = knots[k_index].next) {
+			const struct Knot *k = &knots[k_index];
+			const struct KnotFit *k_fit = &knots_fit[k_index];
+			const double *p = &points[k_index * dims];
+
+			madd_vn_vnvn_fl(&c_knot[0 * dims], p, knot_tan(&pd, k, 0, dims), k_fit->handles[0], dims);
+			copy_vnvn(&c_knot[1 * dims], p, dims);
+			madd_vn_vnvn_fl(&c_knot[2 * dims], p, knot_tan(&pd, k, 1, dims), k_fit->handles[1], dims);
+
+			if (r_cubic_array_fl) {
+				copy_vnfl_vndb(&((float *)cubic_array)[i * 3 * dims], c_knot, 3 * dims);
+			}
+			else {
+				copy_vnvn(&((double *)cubic_array)[i * 3 * dims], c_knot, 3 * dims);
+			}
 		}
-		assert(c_step == &cubic_array[knots_len_remaining * 3 * dims]);
 	}
-
-	if (points_alloc) {
-		free(points_alloc);
-		points_alloc = NULL;
+	else {
+		is_output_alloc_fail = true;
 	}
 
-	free(knots);
-	free(tangents);
-
 	if (r_cubic_orig_index) {
 		*r_cubic_orig_index = cubic_orig_index;
 	}
 
-	*r_cubic_array = cubic_array;
+	if (r_cubic_array_fl) {
+		*r_cubic_array_fl = cubic_array;
+	}
+	else {
+		*r_cubic_array = cubic_array;
+	}
 	*r_cubic_array_len = knots_len_remaining;
 
-	return 0;
+	return is_output_alloc_fail ? 1 : 0;
+}
+
+int curve_fit_cubic_to_points_refit_db(
+        const double *points,
+        const uint    points_len,
+        const uint    dims,
+        const double  error_threshold,
+        const uint    calc_flag,
+        const uint   *corners,
+        const uint    corners_len,
+        const double  corner_angle,
+
+        double **r_cubic_array, uint *r_cubic_array_len,
+        uint   **r_cubic_orig_index,
+        uint   **r_corner_index_array, uint *r_corner_index_len,
+        struct CurveFitContext *ctx)
+{
+	struct CurveFitContext ctx_local;
+	if (ctx == NULL) {
+		ctx = curve_fit_context_init(&ctx_local);
+	}
+
+	int result = cubic_to_points_refit(
+	        points, points_len, dims, error_threshold, calc_flag, corners, corners_len,
+	        corner_angle,
+	        r_cubic_array, NULL, r_cubic_array_len,
+	        r_cubic_orig_index,
+	        r_corner_index_array, r_corner_index_len,
+	        ctx);
+
+	if (ctx == &ctx_local) {
+		curve_fit_context_clear(&ctx_local);
+	}
+
+	return result;
 }
 
 
@@ -1491,36 +2332,30 @@ int curve_fit_cubic_to_points_refit_fl(
 
         float **r_cubic_array, unsigned int *r_cubic_array_len,
         unsigned int   **r_cubic_orig_index,
-        unsigned int   **r_corner_index_array, unsigned int *r_corner_index_len)
+        unsigned int   **r_corner_index_array, unsigned int *r_corner_index_len,
+        struct CurveFitContext *ctx)
 {
+	struct CurveFitContext ctx_local;
+	if (ctx == NULL) {
+		ctx = curve_fit_context_init(&ctx_local);
+	}
+
 	const uint points_flat_len = points_len * dims;
-	double *points_db = malloc(sizeof(double) * points_flat_len);
+	double *points_db = curve_fit_buffer_ensure(ctx, &ctx->points_db, sizeof(double) * points_flat_len);
 
 	copy_vndb_vnfl(points_db, points, points_flat_len);
 
-	double *cubic_array_db = NULL;
-	float  *cubic_array_fl = NULL;
-	uint    cubic_array_len = 0;
-
-	int result = curve_fit_cubic_to_points_refit_db(
+	int result = cubic_to_points_refit(
 	        points_db, points_len, dims, error_threshold, calc_flag, corners, corners_len,
 	        corner_angle,
-	        &cubic_array_db, &cubic_array_len,
+	        NULL, r_cubic_array, r_cubic_array_len,
 	        r_cubic_orig_index,
-	        r_corner_index_array, r_corner_index_len);
-	free(points_db);
-
-	if (!result) {
-		uint cubic_array_flat_len = cubic_array_len * 3 * dims;
-		cubic_array_fl = malloc(sizeof(float) * cubic_array_flat_len);
-		for (uint i = 0; i < cubic_array_flat_len; i++) {
-			cubic_array_fl[i] = (float)cubic_array_db[i];
-		}
-		free(cubic_array_db);
-	}
+	        r_corner_index_array, r_corner_index_len,
+	        ctx);
 
-	*r_cubic_array = cubic_array_fl;
-	*r_cubic_array_len = cubic_array_len;
+	if (ctx == &ctx_local) {
+		curve_fit_context_clear(&ctx_local);
+	}
 
 	return result;
 }
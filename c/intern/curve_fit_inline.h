@@ -28,6 +28,9 @@
 
 /** \file curve_fit_inline.h
  *  \ingroup curve_fit
+ *
+ * \note `uint` & `real` must be defined before including this file,
+ * `real` is the floating point type used by the vector functions.
  */
 
 /** \name Simple Vector Math Lib
@@ -39,42 +42,55 @@
 #  define MINLINE static inline
 #endif
 
-MINLINE double sq(const double d)
+/**
+ * Loops over dimensions are short, when the number of dimensions is known at compile time
+ * (see `USE_DIMS_SPECIALIZE`) this allows them to be fully unrolled.
+ */
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 8)
+#  define DIMS_UNROLL _Pragma("GCC unroll 4")
+#else
+#  define DIMS_UNROLL
+#endif
+
+MINLINE real sq(const real d)
 {
 	return d * d;
 }
 
 #ifndef _MSC_VER
-MINLINE double min(const double a, const double b)
+MINLINE real min(const real a, const real b)
 {
 	return b < a ? b : a;
 }
 
-MINLINE double max(const double a, const double b)
+MINLINE real max(const real a, const real b)
 {
 	return a < b ? b : a;
 }
 #endif
 
 MINLINE void zero_vn(
-        double v0[], const uint dims)
+        real v0[], const uint dims)
 {
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
 		v0[j] = 0.0;
 	}
 }
 
 MINLINE void flip_vn_vnvn(
-        double v_out[], const double v0[], const double v1[], const uint dims)
+        real v_out[], const real v0[], const real v1[], const uint dims)
 {
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
 		v_out[j] = v0[j] + (v0[j] - v1[j]);
 	}
 }
 
 MINLINE void copy_vnvn(
-        double v0[], const double v1[], const uint dims)
+        real v0[], const real v1[], const uint dims)
 {
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
 		v0[j] = v1[j];
 	}
@@ -83,6 +99,7 @@ MINLINE void copy_vnvn(
 MINLINE void copy_vnfl_vndb(
         float v0[], const double v1[], const uint dims)
 {
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
 		v0[j] = (float)v1[j];
 	}
@@ -91,15 +108,17 @@ MINLINE void copy_vnfl_vndb(
 MINLINE void copy_vndb_vnfl(
         double v0[], const float v1[], const uint dims)
 {
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
 		v0[j] = (double)v1[j];
 	}
 }
 
-MINLINE double dot_vnvn(
-        const double v0[], const double v1[], const uint dims)
+MINLINE real dot_vnvn(
+        const real v0[], const real v1[], const uint dims)
 {
-	double d = 0.0;
+	real d = 0.0;
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
 		d += v0[j] * v1[j];
 	}
@@ -107,60 +126,67 @@ MINLINE double dot_vnvn(
 }
 
 MINLINE void add_vn_vnvn(
-        double v_out[], const double v0[], const double v1[], const uint dims)
+        real v_out[], const real v0[], const real v1[], const uint dims)
 {
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
 		v_out[j] = v0[j] + v1[j];
 	}
 }
 
 MINLINE void sub_vn_vnvn(
-        double v_out[], const double v0[], const double v1[], const uint dims)
+        real v_out[], const real v0[], const real v1[], const uint dims)
 {
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
 		v_out[j] = v0[j] - v1[j];
 	}
 }
 
 MINLINE void iadd_vnvn(
-        double v0[], const double v1[], const uint dims)
+        real v0[], const real v1[], const uint dims)
 {
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
 		v0[j] += v1[j];
 	}
 }
 
 MINLINE void isub_vnvn(
-        double v0[], const double v1[], const uint dims)
+        real v0[], const real v1[], const uint dims)
 {
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
 		v0[j] -= v1[j];
 	}
 }
 
 MINLINE void madd_vn_vnvn_fl(
-        double v_out[],
-        const double v0[], const double v1[],
-        const double f, const uint dims)
+        real v_out[],
+        const real v0[], const real v1[],
+        const real f, const uint dims)
 {
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
 		v_out[j] = v0[j] + v1[j] * f;
 	}
 }
 
 MINLINE void msub_vn_vnvn_fl(
-        double v_out[],
-        const double v0[], const double v1[],
-        const double f, const uint dims)
+        real v_out[],
+        const real v0[], const real v1[],
+        const real f, const uint dims)
 {
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
 		v_out[j] = v0[j] - v1[j] * f;
 	}
 }
 
 MINLINE void miadd_vn_vn_fl(
-        double v_out[], const double v0[], double f, const uint dims)
+        real v_out[], const real v0[], real f, const uint dims)
 {
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
 		v_out[j] += v0[j] * f;
 	}
@@ -168,8 +194,9 @@ MINLINE void miadd_vn_vn_fl(
 
 #if 0
 MINLINE void misub_vn_vn_fl(
-        double v_out[], const double v0[], double f, const uint dims)
+        real v_out[], const real v0[], real f, const uint dims)
 {
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
 		v_out[j] -= v0[j] * f;
 	}
@@ -177,75 +204,80 @@ MINLINE void misub_vn_vn_fl(
 #endif
 
 MINLINE void mul_vnvn_fl(
-        double v_out[],
-        const double v0[], const double f, const uint dims)
+        real v_out[],
+        const real v0[], const real f, const uint dims)
 {
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
 		v_out[j] = v0[j] * f;
 	}
 }
 
-MINLINE void imul_vn_fl(double v0[], const double f, const uint dims)
+MINLINE void imul_vn_fl(real v0[], const real f, const uint dims)
 {
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
 		v0[j] *= f;
 	}
 }
 
 
-MINLINE double len_squared_vnvn(
-        const double v0[], const double v1[], const uint dims)
+MINLINE real len_squared_vnvn(
+        const real v0[], const real v1[], const uint dims)
 {
-	double d = 0.0;
+	real d = 0.0;
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
 		d += sq(v0[j] - v1[j]);
 	}
 	return d;
 }
 
-MINLINE double len_squared_vn(
-        const double v0[], const uint dims)
+MINLINE real len_squared_vn(
+        const real v0[], const uint dims)
 {
-	double d = 0.0;
+	real d = 0.0;
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
 		d += sq(v0[j]);
 	}
 	return d;
 }
 
-MINLINE double len_vnvn(
-        const double v0[], const double v1[], const uint dims)
+MINLINE real len_vnvn(
+        const real v0[], const real v1[], const uint dims)
 {
 	return sqrt(len_squared_vnvn(v0, v1, dims));
 }
 
-MINLINE double len_vn(
-        const double v0[], const uint dims)
+MINLINE real len_vn(
+        const real v0[], const uint dims)
 {
 	return sqrt(len_squared_vn(v0, dims));
 }
 
 /* special case, save us negating a copy, then getting the length */
-MINLINE double len_squared_negated_vnvn(
-        const double v0[], const double v1[], const uint dims)
+MINLINE real len_squared_negated_vnvn(
+        const real v0[], const real v1[], const uint dims)
 {
-	double d = 0.0;
+	real d = 0.0;
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
 		d += sq(v0[j] + v1[j]);
 	}
 	return d;
 }
 
-MINLINE double len_negated_vnvn(
-        const double v0[], const double v1[], const uint dims)
+MINLINE real len_negated_vnvn(
+        const real v0[], const real v1[], const uint dims)
 {
 	return sqrt(len_squared_negated_vnvn(v0, v1, dims));
 }
 
-MINLINE double normalize_vn(
-        double v0[], const uint dims)
+MINLINE real normalize_vn(
+        real v0[], const uint dims)
 {
-	double d = len_squared_vn(v0, dims);
+	real d = len_squared_vn(v0, dims);
 	if (d != 0.0 && ((d = sqrt(d)) != 0.0)) {
 		imul_vn_fl(v0, 1.0 / d, dims);
 	}
@@ -253,13 +285,14 @@ MINLINE double normalize_vn(
 }
 
 /* v_out = (v0 - v1).normalized() */
-MINLINE double normalize_vn_vnvn(
-        double v_out[],
-        const double v0[], const double v1[], const uint dims)
+MINLINE real normalize_vn_vnvn(
+        real v_out[],
+        const real v0[], const real v1[], const uint dims)
 {
-	double d = 0.0;
+	real d = 0.0;
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
-		double a = v0[j] - v1[j];
+		real a = v0[j] - v1[j];
 		d += sq(a);
 		v_out[j] = a;
 	}
@@ -269,19 +302,20 @@ MINLINE double normalize_vn_vnvn(
 	return d;
 }
 
-MINLINE bool is_almost_zero_ex(double val, double eps)
+MINLINE bool is_almost_zero_ex(real val, real eps)
 {
 	return (-eps < val) && (val < eps);
 }
 
-MINLINE bool is_almost_zero(double val)
+MINLINE bool is_almost_zero(real val)
 {
 	return is_almost_zero_ex(val, 1e-8);
 }
 
 MINLINE bool equals_vnvn(
-		const double v0[], const double v1[], const uint dims)
+		const real v0[], const real v1[], const uint dims)
 {
+	DIMS_UNROLL
 	for (uint j = 0; j < dims; j++) {
 		if (v0[j] != v1[j]) {
 			return false;
@@ -291,21 +325,21 @@ MINLINE bool equals_vnvn(
 }
 
 MINLINE void project_vn_vnvn(
-        double v_out[], const double p[], const double v_proj[], const uint dims)
+        real v_out[], const real p[], const real v_proj[], const uint dims)
 {
-	const double mul = dot_vnvn(p, v_proj, dims) / dot_vnvn(v_proj, v_proj, dims);
+	const real mul = dot_vnvn(p, v_proj, dims) / dot_vnvn(v_proj, v_proj, dims);
 	mul_vnvn_fl(v_out, v_proj, mul, dims);
 }
 
 MINLINE void project_vn_vnvn_normalized(
-        double v_out[], const double p[], const double v_proj[], const uint dims)
+        real v_out[], const real p[], const real v_proj[], const uint dims)
 {
-	const double mul = dot_vnvn(p, v_proj, dims);
+	const real mul = dot_vnvn(p, v_proj, dims);
 	mul_vnvn_fl(v_out, v_proj, mul, dims);
 }
 
 MINLINE void project_plane_vn_vnvn_normalized(
-        double v_out[], const double v[], const double v_plane[], const uint dims)
+        real v_out[], const real v[], const real v_plane[], const uint dims)
 {
 	assert(v != v_out);
 	project_vn_vnvn_normalized(v_out, v, v_plane, dims);
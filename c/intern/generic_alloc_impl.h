@@ -180,11 +180,18 @@ static void pool_create(struct TPOOL_STRUCT *pool, unsigned int tot_reserve)
 MAYBE_UNUSED
 static void pool_clear(struct TPOOL_STRUCT *pool)
 {
-	/* Remove all except the last chunk */
-	while (pool->chunk->prev) {
-		struct TPoolChunk *chunk_prev = pool->chunk->prev;
-		free(pool->chunk);
-		pool->chunk = chunk_prev;
+	/* Merge all chunks into a single chunk,
+	 * so a pool which is cleared & reused won't need to allocate again. */
+	if (pool->chunk->prev) {
+		unsigned int tot_elems = 0;
+		struct TPoolChunk *chunk = pool->chunk;
+		do {
+			struct TPoolChunk *chunk_prev = chunk->prev;
+			tot_elems += chunk->bufsize;
+			free(chunk);
+			chunk = chunk_prev;
+		} while (chunk);
+		pool->chunk = pool_alloc_chunk(tot_elems, NULL);
 	}
 	pool->chunk->size = 0;
 	pool->free = NULL;
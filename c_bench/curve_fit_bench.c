@@ -0,0 +1,600 @@
+/*
+ * Copyright (c) 2016, Campbell Barton.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** \file curve_fit_bench.c
+ *  \ingroup curve_fit
+ *
+ * Benchmark for the C API (no Python involved).
+ *
+ * Times #curve_fit_cubic_to_points_db, #curve_fit_cubic_to_points_refit_db
+ * and #curve_fit_corners_detect_db on the freehand strokes in `tests/data`
+ * as well as generated strokes of different dimensions & lengths,
+ * for each error threshold.
+ *
+ * Each case is called repeatedly (reusing a #CurveFitContext, as an application would),
+ * reporting the points fitted per second (from the median time),
+ * the number of segments and the latency percentiles of a single call.
+ *
+ * For corner detection, segments are the spans between corners.
+ */
+
+#ifdef _MSC_VER
+#  define _USE_MATH_DEFINES
+#endif
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <time.h>
+#endif
+
+#include "curve_fit_nd.h"
+
+typedef unsigned int uint;
+
+#ifndef CURVE_FIT_BENCH_DATA_DIR
+#  define CURVE_FIT_BENCH_DATA_DIR "tests/data"
+#endif
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof(*(arr)))
+
+/* -------------------------------------------------------------------- */
+
+/** \name Utilities
+ * \{ */
+
+/**
+ * \return monotonic time in seconds.
+ */
+static double time_now(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec * 1e-9);
+#endif
+}
+
+static int cmp_double(const void *a_p, const void *b_p)
+{
+	const double a = *(const double *)a_p;
+	const double b = *(const double *)b_p;
+	return (a < b) ? -1 : ((a > b) ? 1 : 0);
+}
+
+/**
+ * Nearest rank percentile of sorted \a values.
+ */
+static double percentile_sorted(const double *values, const uint values_len, const double percent)
+{
+	uint index = (uint)ceil((percent / 100.0) * (double)values_len);
+	if (index != 0) {
+		index -= 1;
+	}
+	if (index >= values_len) {
+		index = values_len - 1;
+	}
+	return values[index];
+}
+
+/** \} */
+
+
+/* -------------------------------------------------------------------- */
+
+/** \name Input Curves
+ * \{ */
+
+typedef struct BenchInput {
+	char    name[64];
+	double *points;
+	uint    points_len;
+	uint    dims;
+	bool    is_cyclic;
+} BenchInput;
+
+/**
+ * Load a file from `tests/data`, these are Python modules with a tuple of points:
+ * `data = ((x, y), ...)`.
+ *
+ * \return false when the file can't be read or doesn't contain any points.
+ */
+static bool bench_input_load(BenchInput *input, const char *dirpath, const char *name)
+{
+	char filepath[1024];
+	snprintf(filepath, sizeof(filepath), "%s/%s.py", dirpath, name);
+
+	FILE *fp = fopen(filepath, "rb");
+	if (fp == NULL) {
+		return false;
+	}
+	fseek(fp, 0, SEEK_END);
+	const long text_len = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	char *text = malloc((size_t)text_len + 1);
+	const size_t text_read = fread(text, 1, (size_t)text_len, fp);
+	text[text_read] = '\0';
+	fclose(fp);
+
+	uint dims = 0;
+	uint points_len = 0;
+	uint points_alloc = 1024;
+	double *points = NULL;
+
+	for (const char *c = strchr(text, '('); c; c = strchr(c + 1, '(')) {
+		/* Read a tuple of numbers (skipping the tuple containing them). */
+		double co[16];
+		uint co_len = 0;
+		const char *c_num = c + 1;
+		while (co_len < ARRAY_SIZE(co)) {
+			char *c_end;
+			co[co_len] = strtod(c_num, &c_end);
+			if (c_end == c_num) {
+				break;
+			}
+			co_len += 1;
+			c_num = c_end + strspn(c_end, " \t");
+			if (*c_num != ',') {
+				break;
+			}
+			c_num += 1;
+		}
+		if (co_len == 0) {
+			continue;
+		}
+
+		if (dims == 0) {
+			dims = co_len;
+			points = malloc(sizeof(double) * dims * points_alloc);
+		}
+		else if (co_len != dims) {
+			fprintf(stderr, "%s: mixed dimensions (%u, %u)\n", filepath, dims, co_len);
+			points_len = 0;
+			break;
+		}
+
+		if (points_len == points_alloc) {
+			points_alloc *= 2;
+			points = realloc(points, sizeof(double) * dims * points_alloc);
+		}
+		memcpy(&points[points_len * dims], co, sizeof(double) * dims);
+		points_len += 1;
+	}
+
+	free(text);
+
+	if (points_len == 0) {
+		free(points);
+		return false;
+	}
+
+	snprintf(input->name, sizeof(input->name), "%s", name);
+	input->points = points;
+	input->points_len = points_len;
+	input->dims = dims;
+	input->is_cyclic = (strstr(name, "_cyclic") != NULL);
+	return true;
+}
+
+/**
+ * A simple random number generator, so generated inputs match on all systems.
+ */
+static double rng_get_double(uint *rng)
+{
+	/* xorshift32 */
+	uint x = *rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*rng = x;
+	return (double)x / 4294967295.0;
+}
+
+/**
+ * Generate a stroke similar to freehand input:
+ * evenly spaced points with a wandering direction, occasional sharp turns & some noise,
+ * dimensions after the first two are smoothly varying values (pressure for e.g.).
+ */
+static void bench_input_generate(BenchInput *input, const uint points_len, const uint dims)
+{
+	const double step = 0.02;
+	const double noise = 0.0005;
+
+	double *points = malloc(sizeof(double) * dims * points_len);
+	uint rng = 0x2545f491 ^ (points_len * 31) ^ dims;
+
+	double co[2] = {0.0, 0.0};
+	double angle = 0.0;
+	double angle_velocity = 0.0;
+
+	for (uint i = 0; i < points_len; i++) {
+		double *p = &points[i * dims];
+
+		angle_velocity = (angle_velocity * 0.98) + ((rng_get_double(&rng) - 0.5) * 0.01);
+		angle += angle_velocity;
+		if (rng_get_double(&rng) < (1.0 / 500.0)) {
+			/* A corner, between 60 & 150 degrees. */
+			angle += ((rng_get_double(&rng) < 0.5) ? -1.0 : 1.0) * (M_PI / 3.0) * (1.0 + (rng_get_double(&rng) * 1.5));
+		}
+		co[0] += cos(angle) * step;
+		co[1] += sin(angle) * step;
+
+		p[0] = co[0] + ((rng_get_double(&rng) - 0.5) * noise);
+		p[1] = co[1] + ((rng_get_double(&rng) - 0.5) * noise);
+		for (uint j = 2; j < dims; j++) {
+			p[j] = 0.5 + (0.5 * sin((double)i * step * (double)j));
+		}
+	}
+
+	snprintf(input->name, sizeof(input->name), "generated");
+	input->points = points;
+	input->points_len = points_len;
+	input->dims = dims;
+	input->is_cyclic = false;
+}
+
+/** \} */
+
+
+/* -------------------------------------------------------------------- */
+
+/** \name Benchmark Cases
+ * \{ */
+
+enum {
+	BENCH_METHOD_FIT     = 0,
+	BENCH_METHOD_REFIT   = 1,
+	BENCH_METHOD_CORNERS = 2,
+};
+#define BENCH_METHOD_NUM 3
+
+static const char *bench_method_names[BENCH_METHOD_NUM] = {
+	"fit",
+	"refit",
+	"corners",
+};
+
+typedef struct BenchOptions {
+	/** Minimum time to spend on each case (in seconds). */
+	double time_min;
+	/** Minimum number of calls for each case. */
+	uint   calls_min;
+	uint   calc_flag;
+	double corner_angle;
+	/** Enabled methods, indexed by `BENCH_METHOD_*`. */
+	bool   use_method[BENCH_METHOD_NUM];
+} BenchOptions;
+
+/**
+ * Run one call for \a method.
+ *
+ * \return the number of segments, or -1 on failure.
+ */
+static int bench_method_call(
+        const int method, const BenchInput *input, const double error_threshold,
+        const BenchOptions *options,
+        struct CurveFitContext *ctx)
+{
+	const uint calc_flag = options->calc_flag | (input->is_cyclic ? CURVE_FIT_CALC_CYCLIC : 0);
+	double *cubic_array = NULL;
+	uint cubic_array_len = 0;
+	uint *cubic_orig_index = NULL;
+	uint *corners = NULL;
+	uint corners_len = 0;
+	int result;
+	int segments = 0;
+
+	switch (method) {
+		case BENCH_METHOD_FIT:
+		{
+			/* Cyclic curves aren't supported, fit as a regular curve. */
+			result = curve_fit_cubic_to_points_db(
+			        input->points, input->points_len, input->dims, error_threshold,
+			        calc_flag & ~CURVE_FIT_CALC_CYCLIC,
+			        NULL, 0,
+			        &cubic_array, &cubic_array_len,
+			        &cubic_orig_index,
+			        NULL, NULL,
+			        ctx);
+			segments = (int)cubic_array_len - 1;
+			break;
+		}
+		case BENCH_METHOD_REFIT:
+		{
+			result = curve_fit_cubic_to_points_refit_db(
+			        input->points, input->points_len, input->dims, error_threshold,
+			        calc_flag,
+			        NULL, 0,
+			        options->corner_angle,
+			        &cubic_array, &cubic_array_len,
+			        &cubic_orig_index,
+			        &corners, &corners_len,
+			        ctx);
+			segments = (int)cubic_array_len - ((calc_flag & CURVE_FIT_CALC_CYCLIC) ? 0 : 1);
+			break;
+		}
+		case BENCH_METHOD_CORNERS:
+		default:
+		{
+			/* Matches values Blender uses for freehand drawing. */
+			const double radius_min = error_threshold / 8.0;
+			const double radius_max = error_threshold * 2.0;
+			const uint samples_max = 16;
+			result = curve_fit_corners_detect_db(
+			        input->points, input->points_len, input->dims,
+			        radius_min, radius_max, samples_max,
+			        options->corner_angle,
+			        &corners, &corners_len,
+			        ctx);
+			/* The end points are included (when any corners are found). */
+			segments = (corners_len != 0) ? (int)corners_len - 1 : 1;
+			break;
+		}
+	}
+
+	free(cubic_array);
+	free(cubic_orig_index);
+	free(corners);
+
+	return (result == 0) ? segments : -1;
+}
+
+static bool bench_case_run(
+        const int method, const BenchInput *input, const double error_threshold,
+        const BenchOptions *options,
+        struct CurveFitContext *ctx)
+{
+	uint times_alloc = 64;
+	uint times_len = 0;
+	double *times = malloc(sizeof(*times) * times_alloc);
+	double time_total = 0.0;
+	int segments = 0;
+
+	/* Warm up (so the context buffers have been allocated). */
+	if ((segments = bench_method_call(method, input, error_threshold, options, ctx)) == -1) {
+		free(times);
+		return false;
+	}
+
+	while ((times_len < options->calls_min) || (time_total < options->time_min)) {
+		const double time_begin = time_now();
+		bench_method_call(method, input, error_threshold, options, ctx);
+		const double time_call = time_now() - time_begin;
+
+		if (times_len == times_alloc) {
+			times_alloc *= 2;
+			times = realloc(times, sizeof(*times) * times_alloc);
+		}
+		times[times_len++] = time_call;
+		time_total += time_call;
+	}
+
+	qsort(times, times_len, sizeof(*times), cmp_double);
+
+	const double time_median = percentile_sorted(times, times_len, 50.0);
+	printf("%-8s %-30s %4u %8u %8.4f %7u %9d %12.0f %10.4f %10.4f %10.4f %10.4f\n",
+	       bench_method_names[method], input->name, input->dims, input->points_len, error_threshold,
+	       times_len, segments,
+	       (time_median > 0.0) ? ((double)input->points_len / time_median) : 0.0,
+	       time_median * 1e3,
+	       percentile_sorted(times, times_len, 90.0) * 1e3,
+	       percentile_sorted(times, times_len, 99.0) * 1e3,
+	       times[times_len - 1] * 1e3);
+	fflush(stdout);
+
+	free(times);
+	return true;
+}
+
+static bool bench_input_run(
+        const BenchInput *input,
+        const double *error_thresholds, const uint error_thresholds_len,
+        const BenchOptions *options,
+        struct CurveFitContext *ctx)
+{
+	bool ok = true;
+	for (int method = 0; method < BENCH_METHOD_NUM; method++) {
+		if (!options->use_method[method]) {
+			continue;
+		}
+		for (uint i = 0; i < error_thresholds_len; i++) {
+			if (!bench_case_run(method, input, error_thresholds[i], options, ctx)) {
+				fprintf(stderr, "%s: %s failed\n", input->name, bench_method_names[method]);
+				ok = false;
+			}
+		}
+	}
+	return ok;
+}
+
+/** \} */
+
+
+/* -------------------------------------------------------------------- */
+
+/** \name Main
+ * \{ */
+
+static void print_help(const char *exe)
+{
+	printf("Usage: %s [options]\n"
+	       "\n"
+	       "Options:\n"
+	       "  --data DIR            Directory containing the test strokes (default \"%s\").\n"
+	       "  --time SECONDS        Minimum time to spend on each case (default 0.25).\n"
+	       "  --points-max NUMBER   Skip generated inputs longer than this (default 100000).\n"
+	       "  --method NAME         Only run: fit, refit or corners (may be passed multiple times).\n"
+	       "  --corner-angle DEG    Corner angle for refit & corner detection (default 70, 180 to disable).\n"
+	       "  --fast                Use CURVE_FIT_CALC_FAST.\n"
+	       "  --high-quality        Use CURVE_FIT_CALC_HIGH_QUALIY.\n"
+	       "  --parallel            Use CURVE_FIT_CALC_PARALLEL.\n"
+	       "  --decimate            Use CURVE_FIT_CALC_DECIMATE.\n"
+	       "  --multires            Use CURVE_FIT_CALC_MULTIRES.\n"
+	       "  --refit-rounds        Use CURVE_FIT_CALC_REFIT_ROUNDS.\n",
+	       exe, CURVE_FIT_BENCH_DATA_DIR);
+}
+
+int main(int argc, char **argv)
+{
+	static const char *data_names[] = {
+		"test_curve_freehand_01",
+		"test_curve_freehand_02",
+		"test_curve_freehand_03",
+		"test_curve_freehand_04_cyclic",
+	};
+	static const uint generate_dims[] = {2, 3, 4};
+	static const uint generate_lengths[] = {1000, 10000, 100000};
+	static const double error_thresholds[] = {0.01, 0.001};
+
+	const char *data_dir = CURVE_FIT_BENCH_DATA_DIR;
+	uint points_max = 100000;
+	bool use_method_any = false;
+
+	BenchOptions options = {
+		.time_min = 0.25,
+		.calls_min = 5,
+		.calc_flag = 0,
+		.corner_angle = 70.0 * (M_PI / 180.0),
+	};
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *arg_value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+			print_help(argv[0]);
+			return 0;
+		}
+		else if (strcmp(arg, "--fast") == 0) {
+			options.calc_flag |= CURVE_FIT_CALC_FAST;
+		}
+		else if (strcmp(arg, "--high-quality") == 0) {
+			options.calc_flag |= CURVE_FIT_CALC_HIGH_QUALIY;
+		}
+		else if (strcmp(arg, "--parallel") == 0) {
+			options.calc_flag |= CURVE_FIT_CALC_PARALLEL;
+		}
+		else if (strcmp(arg, "--decimate") == 0) {
+			options.calc_flag |= CURVE_FIT_CALC_DECIMATE;
+		}
+		else if (strcmp(arg, "--multires") == 0) {
+			options.calc_flag |= CURVE_FIT_CALC_MULTIRES;
+		}
+		else if (strcmp(arg, "--refit-rounds") == 0) {
+			options.calc_flag |= CURVE_FIT_CALC_REFIT_ROUNDS;
+		}
+		else if (arg_value == NULL) {
+			fprintf(stderr, "Unknown or incomplete argument \"%s\" (see --help)\n", arg);
+			return 1;
+		}
+		else {
+			if (strcmp(arg, "--data") == 0) {
+				data_dir = arg_value;
+			}
+			else if (strcmp(arg, "--time") == 0) {
+				options.time_min = atof(arg_value);
+			}
+			else if (strcmp(arg, "--points-max") == 0) {
+				points_max = (uint)strtoul(arg_value, NULL, 10);
+			}
+			else if (strcmp(arg, "--corner-angle") == 0) {
+				options.corner_angle = atof(arg_value) * (M_PI / 180.0);
+			}
+			else if (strcmp(arg, "--method") == 0) {
+				int method;
+				for (method = 0; method < BENCH_METHOD_NUM; method++) {
+					if (strcmp(arg_value, bench_method_names[method]) == 0) {
+						break;
+					}
+				}
+				if (method == BENCH_METHOD_NUM) {
+					fprintf(stderr, "Unknown method \"%s\"\n", arg_value);
+					return 1;
+				}
+				options.use_method[method] = true;
+				use_method_any = true;
+			}
+			else {
+				fprintf(stderr, "Unknown argument \"%s\" (see --help)\n", arg);
+				return 1;
+			}
+			i += 1;
+		}
+	}
+
+	if (use_method_any == false) {
+		for (int method = 0; method < BENCH_METHOD_NUM; method++) {
+			options.use_method[method] = true;
+		}
+	}
+
+	printf("%-8s %-30s %4s %8s %8s %7s %9s %12s %10s %10s %10s %10s\n",
+	       "method", "input", "dims", "points", "error",
+	       "calls", "segments", "points/s",
+	       "p50 (ms)", "p90 (ms)", "p99 (ms)", "max (ms)");
+
+	struct CurveFitContext *ctx = curve_fit_context_create();
+	bool ok = true;
+
+	for (uint i = 0; i < ARRAY_SIZE(data_names); i++) {
+		BenchInput input;
+		if (!bench_input_load(&input, data_dir, data_names[i])) {
+			fprintf(stderr, "Unable to load \"%s\" from \"%s\" (see --data)\n", data_names[i], data_dir);
+			ok = false;
+			continue;
+		}
+		ok &= bench_input_run(&input, error_thresholds, ARRAY_SIZE(error_thresholds), &options, ctx);
+		free(input.points);
+	}
+
+	for (uint i = 0; i < ARRAY_SIZE(generate_lengths); i++) {
+		if (generate_lengths[i] > points_max) {
+			continue;
+		}
+		for (uint j = 0; j < ARRAY_SIZE(generate_dims); j++) {
+			BenchInput input;
+			bench_input_generate(&input, generate_lengths[i], generate_dims[j]);
+			ok &= bench_input_run(&input, error_thresholds, ARRAY_SIZE(error_thresholds), &options, ctx);
+			free(input.points);
+		}
+	}
+
+	curve_fit_context_free(ctx);
+
+	return ok ? 0 : 1;
+}
+
+/** \} */
@@ -148,7 +148,8 @@ static PyObject *M_Curve_fit_nd_curve_from_points(PyObject *self, PyObject *args
 
 	        &cubic_array, &cubic_array_len,
 	        &cubic_orig_index,
-	        NULL, NULL) != 0)
+	        NULL, NULL,
+	        NULL) != 0)
 #else
 	if (curve_fit_cubic_to_points_refit_db(
 	        points_data, points_len, dims, error_threshold, calc_flag,
@@ -156,7 +157,8 @@ static PyObject *M_Curve_fit_nd_curve_from_points(PyObject *self, PyObject *args
 	        corner_angle,  /* only difference! */
 	        &cubic_array, &cubic_array_len,
 	        &cubic_orig_index,
-	        &corner_indices, &corner_indices_len) != 0)
+	        &corner_indices, &corner_indices_len,
+	        NULL) != 0)
 #endif
 	{
 
@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2016, Campbell Barton.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** \file curve_fit_test_budget.c
+ *  \ingroup curve_fit
+ *
+ * Test #curve_fit_cubic_to_points_budget_db, both when the budget runs out & when it doesn't.
+ */
+
+#ifdef _MSC_VER
+#  define _USE_MATH_DEFINES
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "curve_fit_nd.h"
+
+#include "curve_fit_test_utils.h"
+
+/* Allow for minor discrepancy measuring the error. */
+#define ERROR_MARGIN 1.01
+
+#define ERROR_THRESHOLD 0.005
+
+typedef struct FitResult {
+	int     ret;
+	double *cubic_array;
+	uint    cubic_array_len;
+	uint   *cubic_orig_index;
+	uint   *corner_index_array;
+	uint    corner_index_len;
+	int     is_complete;
+} FitResult;
+
+static void fit_result_free(FitResult *r)
+{
+	free(r->cubic_array);
+	free(r->cubic_orig_index);
+	free(r->corner_index_array);
+}
+
+/**
+ * Check the curve is a valid chain of cubics & the corners are kept.
+ */
+static void test_result_check(
+        const double *points, const uint points_len, const uint dims,
+        const uint *corners, const uint corners_len,
+        const FitResult *r)
+{
+	TEST_CHECK(r->ret == 0);
+	TEST_CHECK(r->cubic_array_len >= 2);
+	if (r->cubic_array_len < 2) {
+		return;
+	}
+
+	/* The end points are kept. */
+	TEST_CHECK(r->cubic_orig_index[0] == 0);
+	TEST_CHECK(r->cubic_orig_index[r->cubic_array_len - 1] == points_len - 1);
+	for (uint i = 1; i < r->cubic_array_len; i++) {
+		TEST_CHECK(r->cubic_orig_index[i - 1] < r->cubic_orig_index[i]);
+	}
+	for (uint i = 0; i < r->cubic_array_len; i++) {
+		const double *co = &r->cubic_array[((i * 3) + 1) * dims];
+		TEST_CHECK(memcmp(co, &points[r->cubic_orig_index[i] * dims], sizeof(double) * dims) == 0);
+	}
+
+	/* Corner indices reference knots at the corners passed in. */
+	if (corners) {
+		TEST_CHECK(r->corner_index_len == corners_len);
+		for (uint i = 0; i < r->corner_index_len; i++) {
+			TEST_CHECK(r->corner_index_array[i] < r->cubic_array_len);
+			if (r->corner_index_array[i] < r->cubic_array_len) {
+				TEST_CHECK(r->cubic_orig_index[r->corner_index_array[i]] == corners[i]);
+			}
+		}
+	}
+
+	/* A complete curve is within the threshold. */
+	if (r->is_complete) {
+		const double error = test_curve_error_max(
+		        points, points_len, dims, r->cubic_array, r->cubic_array_len, r->cubic_orig_index, false);
+		TEST_CHECK(error < ERROR_THRESHOLD * ERROR_MARGIN);
+	}
+}
+
+static void test_budget(
+        const double *points, const uint points_len, const uint dims,
+        const uint *corners, const uint corners_len)
+{
+	FitResult r_all = {0};
+	r_all.ret = curve_fit_cubic_to_points_db(
+	        points, points_len, dims, ERROR_THRESHOLD, 0, corners, corners_len,
+	        &r_all.cubic_array, &r_all.cubic_array_len,
+	        &r_all.cubic_orig_index,
+	        &r_all.corner_index_array, &r_all.corner_index_len,
+	        NULL);
+	r_all.is_complete = 1;
+	test_result_check(points, points_len, dims, corners, corners_len, &r_all);
+
+	const uint budgets[] = {0, 1, 10, 100, 1000, 5000, points_len * 1000};
+	uint cubic_array_len_prev = 0;
+	for (uint i = 0; i < ARRAY_SIZE(budgets); i++) {
+		FitResult r = {0};
+		r.is_complete = -1;
+		r.ret = curve_fit_cubic_to_points_budget_db(
+		        points, points_len, dims, ERROR_THRESHOLD, 0, corners, corners_len, budgets[i],
+		        &r.cubic_array, &r.cubic_array_len,
+		        &r.cubic_orig_index,
+		        &r.corner_index_array, &r.corner_index_len,
+		        &r.is_complete,
+		        NULL);
+		TEST_CHECK(r.is_complete == 0 || r.is_complete == 1);
+		test_result_check(points, points_len, dims, corners, corners_len, &r);
+
+		if (budgets[i] <= 1) {
+			/* A cubic between each pair of corners. */
+			TEST_CHECK(r.is_complete == 0);
+			TEST_CHECK(r.cubic_array_len == (corners ? corners_len : 2));
+		}
+		else {
+			/* Larger budgets split more. */
+			TEST_CHECK(r.cubic_array_len >= cubic_array_len_prev);
+		}
+		cubic_array_len_prev = r.cubic_array_len;
+
+		if (i == ARRAY_SIZE(budgets) - 1) {
+			/* The same as fitting without a budget. */
+			TEST_CHECK(r.is_complete == 1);
+			TEST_CHECK(r.cubic_array_len == r_all.cubic_array_len);
+			TEST_CHECK(r.corner_index_len == r_all.corner_index_len);
+			if (r.cubic_array_len == r_all.cubic_array_len) {
+				TEST_CHECK(memcmp(r.cubic_array, r_all.cubic_array,
+				                  sizeof(double) * r.cubic_array_len * 3 * dims) == 0);
+				TEST_CHECK(memcmp(r.cubic_orig_index, r_all.cubic_orig_index,
+				                  sizeof(uint) * r.cubic_array_len) == 0);
+			}
+			if (corners && (r.corner_index_len == r_all.corner_index_len)) {
+				TEST_CHECK(memcmp(r.corner_index_array, r_all.corner_index_array,
+				                  sizeof(uint) * r.corner_index_len) == 0);
+			}
+		}
+
+		fit_result_free(&r);
+	}
+
+	fit_result_free(&r_all);
+}
+
+/**
+ * Fitting again using the same context gives the same result,
+ * only allocating the output arrays (even when the budget runs out).
+ */
+static void test_budget_context(
+        const double *points, const uint points_len, const uint dims,
+        const uint *corners, const uint corners_len)
+{
+	struct CurveFitContext *ctx = curve_fit_context_create();
+	struct CurveFitStats stats[2];
+	FitResult r[2] = {{0}};
+	for (uint i = 0; i < 2; i++) {
+		memset(&stats[i], 0, sizeof(stats[i]));
+		curve_fit_context_stats_set(ctx, &stats[i]);
+		r[i].is_complete = -1;
+		r[i].ret = curve_fit_cubic_to_points_budget_db(
+		        points, points_len, dims, ERROR_THRESHOLD, 0, corners, corners_len, 1000,
+		        &r[i].cubic_array, &r[i].cubic_array_len,
+		        &r[i].cubic_orig_index,
+		        &r[i].corner_index_array, &r[i].corner_index_len,
+		        &r[i].is_complete,
+		        ctx);
+		TEST_CHECK(r[i].is_complete == 0);
+		test_result_check(points, points_len, dims, corners, corners_len, &r[i]);
+	}
+
+	TEST_CHECK(r[0].cubic_array_len == r[1].cubic_array_len);
+	if (r[0].cubic_array_len == r[1].cubic_array_len) {
+		TEST_CHECK(memcmp(r[0].cubic_array, r[1].cubic_array,
+		                  sizeof(double) * r[0].cubic_array_len * 3 * dims) == 0);
+	}
+
+	const size_t output_bytes =
+	        (sizeof(double) * r[1].cubic_array_len * 3 * dims) +
+	        (sizeof(uint) * r[1].cubic_array_len) +
+	        (sizeof(uint) * r[1].corner_index_len);
+	TEST_CHECK(stats[0].alloc_bytes > output_bytes);
+	TEST_CHECK(stats[1].alloc_bytes == output_bytes);
+
+	curve_fit_context_stats_set(ctx, NULL);
+	curve_fit_context_free(ctx);
+	fit_result_free(&r[0]);
+	fit_result_free(&r[1]);
+}
+
+/**
+ * With a large budget the single precision version matches #curve_fit_cubic_to_points_fl.
+ */
+static void test_budget_float(const double *points, const uint points_len, const uint dims)
+{
+	float *points_fl = malloc(sizeof(float) * points_len * dims);
+	for (uint i = 0; i < points_len * dims; i++) {
+		points_fl[i] = (float)points[i];
+	}
+
+	float *cubic_array_all, *cubic_array;
+	uint cubic_array_all_len, cubic_array_len;
+	uint *cubic_orig_index_all, *cubic_orig_index;
+	int is_complete = -1;
+	TEST_CHECK(curve_fit_cubic_to_points_fl(
+	        points_fl, points_len, dims, ERROR_THRESHOLD, 0, NULL, 0,
+	        &cubic_array_all, &cubic_array_all_len, &cubic_orig_index_all,
+	        NULL, NULL, NULL) == 0);
+	TEST_CHECK(curve_fit_cubic_to_points_budget_fl(
+	        points_fl, points_len, dims, ERROR_THRESHOLD, 0, NULL, 0, points_len * 1000,
+	        &cubic_array, &cubic_array_len, &cubic_orig_index,
+	        NULL, NULL, &is_complete, NULL) == 0);
+	TEST_CHECK(is_complete == 1);
+	TEST_CHECK(cubic_array_len == cubic_array_all_len);
+	if (cubic_array_len == cubic_array_all_len) {
+		TEST_CHECK(memcmp(cubic_array, cubic_array_all, sizeof(float) * cubic_array_len * 3 * dims) == 0);
+		TEST_CHECK(memcmp(cubic_orig_index, cubic_orig_index_all, sizeof(uint) * cubic_array_len) == 0);
+	}
+
+	/* The budget running out. */
+	free(cubic_array);
+	free(cubic_orig_index);
+	is_complete = -1;
+	TEST_CHECK(curve_fit_cubic_to_points_budget_fl(
+	        points_fl, points_len, dims, ERROR_THRESHOLD, 0, NULL, 0, 0,
+	        &cubic_array, &cubic_array_len, &cubic_orig_index,
+	        NULL, NULL, &is_complete, NULL) == 0);
+	TEST_CHECK(is_complete == 0);
+	TEST_CHECK(cubic_array_len == 2);
+
+	free(cubic_array);
+	free(cubic_orig_index);
+	free(cubic_array_all);
+	free(cubic_orig_index_all);
+	free(points_fl);
+}
+
+int main(void)
+{
+	const uint points_len = 1000;
+	const uint dims = 2;
+	double *points = test_points_generate(points_len, dims, 0);
+
+	uint *corners, corners_len;
+	TEST_CHECK(curve_fit_corners_detect_db(
+	        points, points_len, dims, 0.001, 0.05, 16, M_PI / 4,
+	        &corners, &corners_len,
+	        NULL) == 0);
+	TEST_CHECK(corners_len > 2);
+
+	test_budget(points, points_len, dims, NULL, 0);
+	test_budget(points, points_len, dims, corners, corners_len);
+	test_budget_context(points, points_len, dims, NULL, 0);
+	test_budget_context(points, points_len, dims, corners, corners_len);
+	test_budget_float(points, points_len, dims);
+
+	free(corners);
+	free(points);
+
+	return test_result("budget");
+}
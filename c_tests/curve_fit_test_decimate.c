@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2016, Campbell Barton.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** \file curve_fit_test_decimate.c
+ *  \ingroup curve_fit
+ *
+ * Test #CURVE_FIT_CALC_DECIMATE keeps corners & original indices.
+ */
+
+#ifdef _MSC_VER
+#  define _USE_MATH_DEFINES
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "curve_fit_nd.h"
+
+#include "curve_fit_test_utils.h"
+
+/* Allow for minor discrepancy measuring the error. */
+#define ERROR_MARGIN 1.01
+
+#define ERROR_THRESHOLD 0.01
+
+enum {
+	FIT_CUBIC = 0,
+	FIT_REFIT = 1,
+};
+
+/**
+ * Dense points along straight lines (with a corner between each line).
+ */
+static double *points_generate_lines(
+        const uint points_len, const uint dims,
+        uint **r_corners, uint *r_corners_len)
+{
+	const uint lines_len = 5;
+	const uint line_points_len = (points_len - 1) / lines_len;
+	double *points = malloc(sizeof(double) * points_len * dims);
+	uint *corners = malloc(sizeof(uint) * (lines_len + 2));
+	uint corners_len = 0;
+
+	double co[2] = {0.0, 0.0};
+	for (uint i = 0; i < points_len; i++) {
+		const uint line = i / line_points_len;
+		if ((i % line_points_len) == 0) {
+			corners[corners_len++] = i;
+		}
+		/* Turn 90 degrees for each line, alternating directions. */
+		const double angle = (line % 2) ? (M_PI / 2) : 0.0;
+		/* Uneven spacing, much smaller than the error threshold. */
+		const double step = 0.0005 * (1.0 + (double)(i % 3));
+		co[0] += cos(angle) * step;
+		co[1] += sin(angle) * step;
+
+		double *p = &points[i * dims];
+		p[0] = co[0];
+		p[1] = co[1];
+		for (uint j = 2; j < dims; j++) {
+			p[j] = 0.0;
+		}
+	}
+	if (corners[corners_len - 1] != points_len - 1) {
+		corners[corners_len++] = points_len - 1;
+	}
+
+	*r_corners = corners;
+	*r_corners_len = corners_len;
+	return points;
+}
+
+static void test_decimate(
+        const double *points, const uint points_len, const uint dims,
+        const uint *corners, const uint corners_len,
+        const uint fit_type)
+{
+	struct CurveFitContext *ctx = curve_fit_context_create();
+	struct CurveFitStats stats = {0};
+	struct CurveFitStats stats_decimate = {0};
+
+	for (uint pass = 0; pass < 2; pass++) {
+		const bool use_decimate = (pass == 1);
+		const uint calc_flag = use_decimate ? CURVE_FIT_CALC_DECIMATE : 0;
+
+		curve_fit_context_stats_set(ctx, use_decimate ? &stats_decimate : &stats);
+
+		double *cubic_array;
+		uint *cubic_orig_index, *corner_index_array = NULL;
+		uint cubic_array_len, corner_index_len = 0;
+		int ret;
+		if (fit_type == FIT_CUBIC) {
+			ret = curve_fit_cubic_to_points_db(
+			        points, points_len, dims, ERROR_THRESHOLD, calc_flag, corners, corners_len,
+			        &cubic_array, &cubic_array_len,
+			        &cubic_orig_index,
+			        &corner_index_array, &corner_index_len,
+			        ctx);
+		}
+		else {
+			ret = curve_fit_cubic_to_points_refit_db(
+			        points, points_len, dims, ERROR_THRESHOLD, calc_flag, corners, corners_len, M_PI,
+			        &cubic_array, &cubic_array_len,
+			        &cubic_orig_index,
+			        &corner_index_array, &corner_index_len,
+			        ctx);
+		}
+		TEST_CHECK(ret == 0);
+		TEST_CHECK(cubic_array_len >= 2);
+
+		/* Indices of the points passed in, in order, including the end points. */
+		TEST_CHECK(cubic_orig_index[0] == 0);
+		TEST_CHECK(cubic_orig_index[cubic_array_len - 1] == points_len - 1);
+		for (uint i = 0; i < cubic_array_len; i++) {
+			TEST_CHECK(cubic_orig_index[i] < points_len);
+			if (i != 0) {
+				TEST_CHECK(cubic_orig_index[i - 1] < cubic_orig_index[i]);
+			}
+			if (cubic_orig_index[i] < points_len) {
+				const double *co = &cubic_array[((i * 3) + 1) * dims];
+				TEST_CHECK(memcmp(co, &points[cubic_orig_index[i] * dims], sizeof(double) * dims) == 0);
+			}
+		}
+
+		/* Corners are kept. */
+		if (corners) {
+			TEST_CHECK(corner_index_len == corners_len);
+			for (uint i = 0; i < corner_index_len; i++) {
+				TEST_CHECK(corner_index_array[i] < cubic_array_len);
+				if (corner_index_array[i] < cubic_array_len) {
+					TEST_CHECK(cubic_orig_index[corner_index_array[i]] == corners[i]);
+				}
+			}
+		}
+
+		const double error = test_curve_error_max(
+		        points, points_len, dims, cubic_array, cubic_array_len, cubic_orig_index, false);
+		TEST_CHECK(error < ERROR_THRESHOLD * ERROR_MARGIN);
+
+		free(cubic_array);
+		free(cubic_orig_index);
+		free(corner_index_array);
+	}
+
+	/* Ensure points were removed (re-fitting starts with a knot for each point). */
+	if (fit_type == FIT_REFIT) {
+		TEST_CHECK(stats_decimate.heap_insert_count * 4 < stats.heap_insert_count);
+	}
+
+	curve_fit_context_free(ctx);
+}
+
+int main(void)
+{
+	const uint points_len = 5001;
+
+	for (uint dims = 2; dims <= 3; dims++) {
+		uint *corners, corners_len;
+		double *points = points_generate_lines(points_len, dims, &corners, &corners_len);
+		TEST_CHECK(corners_len > 2);
+
+		for (uint fit_type = FIT_CUBIC; fit_type <= FIT_REFIT; fit_type++) {
+			test_decimate(points, points_len, dims, corners, corners_len, fit_type);
+			test_decimate(points, points_len, dims, NULL, 0, fit_type);
+		}
+
+		free(corners);
+		free(points);
+	}
+
+	return test_result("decimate");
+}
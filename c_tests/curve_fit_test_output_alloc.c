@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2016, Campbell Barton.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** \file curve_fit_test_output_alloc.c
+ *  \ingroup curve_fit
+ *
+ * Test arrays allocated by #curve_fit_context_output_alloc_set,
+ * both when allocating succeeds & when each array fails to allocate.
+ */
+
+#ifdef _MSC_VER
+#  define _USE_MATH_DEFINES
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "curve_fit_nd.h"
+
+#include "curve_fit_test_utils.h"
+
+#define OUTPUT_NUM 3
+
+/** Bytes after each array which must not be written to. */
+#define OUTPUT_GUARD_SIZE 64
+#define OUTPUT_GUARD_BYTE 0xa5
+
+/* -------------------------------------------------------------------- */
+
+/** \name Output Allocation Callback
+ * \{ */
+
+typedef struct OutputAlloc {
+	/** `1 << CURVE_FIT_OUTPUT_*` for arrays which fail to allocate. */
+	uint fail_mask;
+
+	void  *data[OUTPUT_NUM];
+	size_t size[OUTPUT_NUM];
+	uint   alloc_count[OUTPUT_NUM];
+} OutputAlloc;
+
+static void *output_alloc_fn(void *user_data, unsigned int output, size_t size)
+{
+	OutputAlloc *oa = user_data;
+	TEST_CHECK(output < OUTPUT_NUM);
+	if (output >= OUTPUT_NUM) {
+		return NULL;
+	}
+	oa->alloc_count[output] += 1;
+	oa->size[output] = size;
+	if (oa->fail_mask & (1u << output)) {
+		return NULL;
+	}
+	/* Only one array of each kind is expected (see #test_output_compare), don't leak others. */
+	free(oa->data[output]);
+	oa->data[output] = malloc(size + OUTPUT_GUARD_SIZE);
+	memset(oa->data[output], OUTPUT_GUARD_BYTE, size + OUTPUT_GUARD_SIZE);
+	return oa->data[output];
+}
+
+static bool output_alloc_guard_is_set(const OutputAlloc *oa, const uint output)
+{
+	const unsigned char *guard = (const unsigned char *)oa->data[output] + oa->size[output];
+	for (uint i = 0; i < OUTPUT_GUARD_SIZE; i++) {
+		if (guard[i] != OUTPUT_GUARD_BYTE) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void output_alloc_free(OutputAlloc *oa)
+{
+	for (uint i = 0; i < OUTPUT_NUM; i++) {
+		free(oa->data[i]);
+	}
+	memset(oa, 0, sizeof(*oa));
+}
+
+/** \} */
+
+
+/* -------------------------------------------------------------------- */
+
+/** \name Fitting Functions
+ *
+ * Each function is called with the same arguments, storing its result in a #FitOutput.
+ * \{ */
+
+typedef struct FitInput {
+	double *points;
+	uint    points_len;
+	uint    dims;
+	uint   *corners;
+	uint    corners_len;
+} FitInput;
+
+typedef struct FitOutput {
+	int     ret;
+	/** Indexed by `CURVE_FIT_OUTPUT_*`. */
+	void   *data[OUTPUT_NUM];
+	size_t  size[OUTPUT_NUM];
+} FitOutput;
+
+static void fit_output_sizes(FitOutput *out, const uint cubic_array_len, const uint corner_index_len, const uint dims)
+{
+	out->size[CURVE_FIT_OUTPUT_CUBIC_ARRAY] = sizeof(double) * cubic_array_len * 3 * dims;
+	out->size[CURVE_FIT_OUTPUT_CUBIC_ORIG_INDEX] = sizeof(uint) * cubic_array_len;
+	out->size[CURVE_FIT_OUTPUT_CORNER_INDEX] = sizeof(uint) * corner_index_len;
+}
+
+static void fit_cubic(const FitInput *in, struct CurveFitContext *ctx, FitOutput *out)
+{
+	double *cubic_array = NULL;
+	uint *cubic_orig_index = NULL, *corner_index_array = NULL;
+	uint cubic_array_len = 0, corner_index_len = 0;
+	out->ret = curve_fit_cubic_to_points_db(
+	        in->points, in->points_len, in->dims, 0.01, 0, in->corners, in->corners_len,
+	        &cubic_array, &cubic_array_len,
+	        &cubic_orig_index,
+	        &corner_index_array, &corner_index_len,
+	        ctx);
+	out->data[CURVE_FIT_OUTPUT_CUBIC_ARRAY] = cubic_array;
+	out->data[CURVE_FIT_OUTPUT_CUBIC_ORIG_INDEX] = cubic_orig_index;
+	out->data[CURVE_FIT_OUTPUT_CORNER_INDEX] = corner_index_array;
+	fit_output_sizes(out, cubic_array_len, corner_index_len, in->dims);
+}
+
+static void fit_refit(const FitInput *in, struct CurveFitContext *ctx, FitOutput *out)
+{
+	double *cubic_array = NULL;
+	uint *cubic_orig_index = NULL, *corner_index_array = NULL;
+	uint cubic_array_len = 0, corner_index_len = 0;
+	out->ret = curve_fit_cubic_to_points_refit_db(
+	        in->points, in->points_len, in->dims, 0.01, 0, NULL, 0, M_PI / 4,
+	        &cubic_array, &cubic_array_len,
+	        &cubic_orig_index,
+	        &corner_index_array, &corner_index_len,
+	        ctx);
+	out->data[CURVE_FIT_OUTPUT_CUBIC_ARRAY] = cubic_array;
+	out->data[CURVE_FIT_OUTPUT_CUBIC_ORIG_INDEX] = cubic_orig_index;
+	out->data[CURVE_FIT_OUTPUT_CORNER_INDEX] = corner_index_array;
+	fit_output_sizes(out, cubic_array_len, corner_index_len, in->dims);
+}
+
+static void fit_corners_detect(const FitInput *in, struct CurveFitContext *ctx, FitOutput *out)
+{
+	uint *corners = NULL;
+	uint corners_len = 0;
+	out->ret = curve_fit_corners_detect_db(
+	        in->points, in->points_len, in->dims, 0.001, 0.05, 16, M_PI / 4,
+	        &corners, &corners_len,
+	        ctx);
+	out->data[CURVE_FIT_OUTPUT_CORNER_INDEX] = corners;
+	out->size[CURVE_FIT_OUTPUT_CORNER_INDEX] = sizeof(uint) * corners_len;
+}
+
+typedef struct FitFunction {
+	const char *name;
+	void (*fit_fn)(const FitInput *in, struct CurveFitContext *ctx, FitOutput *out);
+	/** `1 << CURVE_FIT_OUTPUT_*` for arrays returned. */
+	uint output_mask;
+} FitFunction;
+
+/** \} */
+
+
+/* -------------------------------------------------------------------- */
+
+/** \name Tests
+ * \{ */
+
+/**
+ * Compare the arrays returned using \a oa with \a out_ref (allocated with `malloc`).
+ */
+static void test_output_compare(
+        const FitFunction *fit, const OutputAlloc *oa,
+        const FitOutput *out, const FitOutput *out_ref)
+{
+	for (uint i = 0; i < OUTPUT_NUM; i++) {
+		if ((fit->output_mask & (1u << i)) == 0) {
+			continue;
+		}
+
+		/* Lengths are set, even when the array can't be allocated. */
+		TEST_CHECK(out->size[i] == out_ref->size[i]);
+		TEST_CHECK(oa->alloc_count[i] == 1);
+		/* The size requested is the size of the array returned. */
+		TEST_CHECK(oa->size[i] == out_ref->size[i]);
+
+		if (oa->fail_mask & (1u << i)) {
+			TEST_CHECK(out->data[i] == NULL);
+		}
+		else {
+			TEST_CHECK(out->data[i] == oa->data[i]);
+			if (out->data[i] && out_ref->data[i]) {
+				TEST_CHECK(memcmp(out->data[i], out_ref->data[i], out_ref->size[i]) == 0);
+				TEST_CHECK(output_alloc_guard_is_set(oa, i));
+			}
+		}
+	}
+}
+
+static void test_output_alloc(const FitFunction *fit, const FitInput *in)
+{
+	struct CurveFitContext *ctx = curve_fit_context_create();
+
+	/* The result when arrays are allocated using `malloc`. */
+	FitOutput out_ref = {0};
+	fit->fit_fn(in, ctx, &out_ref);
+	TEST_CHECK(out_ref.ret == 0);
+	for (uint i = 0; i < OUTPUT_NUM; i++) {
+		if (fit->output_mask & (1u << i)) {
+			TEST_CHECK(out_ref.data[i] != NULL);
+		}
+	}
+
+	OutputAlloc oa = {0};
+	curve_fit_context_output_alloc_set(ctx, output_alloc_fn, &oa);
+
+	/* All arrays allocated. */
+	{
+		FitOutput out = {0};
+		fit->fit_fn(in, ctx, &out);
+		TEST_CHECK(out.ret == 0);
+		test_output_compare(fit, &oa, &out, &out_ref);
+		output_alloc_free(&oa);
+	}
+
+	/* Each array failing to allocate. */
+	for (uint i = 0; i < OUTPUT_NUM; i++) {
+		if ((fit->output_mask & (1u << i)) == 0) {
+			continue;
+		}
+		oa.fail_mask = (1u << i);
+		FitOutput out = {0};
+		fit->fit_fn(in, ctx, &out);
+		TEST_CHECK(out.ret == 1);
+		test_output_compare(fit, &oa, &out, &out_ref);
+		output_alloc_free(&oa);
+	}
+
+	/* Using `malloc` again. */
+	{
+		curve_fit_context_output_alloc_set(ctx, NULL, NULL);
+		FitOutput out = {0};
+		fit->fit_fn(in, ctx, &out);
+		TEST_CHECK(out.ret == 0);
+		for (uint i = 0; i < OUTPUT_NUM; i++) {
+			TEST_CHECK(oa.alloc_count[i] == 0);
+			TEST_CHECK(out.size[i] == out_ref.size[i]);
+			if (out.data[i] && out_ref.data[i]) {
+				TEST_CHECK(memcmp(out.data[i], out_ref.data[i], out_ref.size[i]) == 0);
+			}
+			free(out.data[i]);
+		}
+	}
+
+	for (uint i = 0; i < OUTPUT_NUM; i++) {
+		free(out_ref.data[i]);
+	}
+	curve_fit_context_free(ctx);
+}
+
+/** \} */
+
+
+int main(void)
+{
+	const FitFunction fit_functions[] = {
+		{"cubic", fit_cubic,
+		 (1u << CURVE_FIT_OUTPUT_CUBIC_ARRAY) |
+		 (1u << CURVE_FIT_OUTPUT_CUBIC_ORIG_INDEX) |
+		 (1u << CURVE_FIT_OUTPUT_CORNER_INDEX)},
+		{"refit", fit_refit,
+		 (1u << CURVE_FIT_OUTPUT_CUBIC_ARRAY) |
+		 (1u << CURVE_FIT_OUTPUT_CUBIC_ORIG_INDEX) |
+		 (1u << CURVE_FIT_OUTPUT_CORNER_INDEX)},
+		{"corners_detect", fit_corners_detect,
+		 (1u << CURVE_FIT_OUTPUT_CORNER_INDEX)},
+	};
+
+	FitInput in = {0};
+	in.points_len = 1000;
+	in.dims = 2;
+	in.points = test_points_generate(in.points_len, in.dims, 0);
+
+	/* Corners so the corner indices are returned when fitting. */
+	TEST_CHECK(curve_fit_corners_detect_db(
+	        in.points, in.points_len, in.dims, 0.001, 0.05, 16, M_PI / 4,
+	        &in.corners, &in.corners_len,
+	        NULL) == 0);
+	TEST_CHECK(in.corners_len > 2);
+
+	for (uint i = 0; i < ARRAY_SIZE(fit_functions); i++) {
+		printf("%s\n", fit_functions[i].name);
+		test_output_alloc(&fit_functions[i], &in);
+	}
+
+	free(in.corners);
+	free(in.points);
+
+	return test_result("output_alloc");
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2016, Campbell Barton.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** \file curve_fit_test_stats.c
+ *  \ingroup curve_fit
+ *
+ * Test statistics collected with #curve_fit_context_stats_set.
+ */
+
+#ifdef _MSC_VER
+#  define _USE_MATH_DEFINES
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "curve_fit_nd.h"
+
+#include "curve_fit_test_utils.h"
+
+#define ERROR_THRESHOLD 0.001
+
+enum {
+	FIT_CUBIC = 0,
+	FIT_REFIT = 1,
+};
+
+typedef struct FitInput {
+	double *points;
+	uint    points_len;
+	uint    dims;
+	uint   *corners;
+	uint    corners_len;
+} FitInput;
+
+static void fit_call(const FitInput *in, const uint fit_type, const uint calc_flag, struct CurveFitContext *ctx)
+{
+	double *cubic_array;
+	uint *cubic_orig_index, *corner_index_array;
+	uint cubic_array_len, corner_index_len;
+	int ret;
+	if (fit_type == FIT_CUBIC) {
+		ret = curve_fit_cubic_to_points_db(
+		        in->points, in->points_len, in->dims, ERROR_THRESHOLD, calc_flag, in->corners, in->corners_len,
+		        &cubic_array, &cubic_array_len,
+		        &cubic_orig_index,
+		        &corner_index_array, &corner_index_len,
+		        ctx);
+	}
+	else {
+		ret = curve_fit_cubic_to_points_refit_db(
+		        in->points, in->points_len, in->dims, ERROR_THRESHOLD, calc_flag, NULL, 0, M_PI / 4,
+		        &cubic_array, &cubic_array_len,
+		        &cubic_orig_index,
+		        &corner_index_array, &corner_index_len,
+		        ctx);
+	}
+	TEST_CHECK(ret == 0);
+	free(cubic_array);
+	free(cubic_orig_index);
+	free(corner_index_array);
+}
+
+/**
+ * Check the counters which don't depend on memory already allocated by the context are the same.
+ */
+static void test_stats_compare(const struct CurveFitStats *a, const struct CurveFitStats *b)
+{
+	TEST_CHECK(a->fit_count               == b->fit_count);
+	TEST_CHECK(a->fit_stack_max           == b->fit_stack_max);
+	TEST_CHECK(a->reparameterize_count    == b->reparameterize_count);
+	TEST_CHECK(a->fallback_circular_count == b->fallback_circular_count);
+	TEST_CHECK(a->fallback_offset_count   == b->fallback_offset_count);
+	TEST_CHECK(a->fit_single_count        == b->fit_single_count);
+	TEST_CHECK(a->heap_insert_count       == b->heap_insert_count);
+	TEST_CHECK(a->heap_update_count       == b->heap_update_count);
+	TEST_CHECK(a->heap_remove_count       == b->heap_remove_count);
+	TEST_CHECK(a->heap_pop_count          == b->heap_pop_count);
+	TEST_CHECK(a->span_cache_hit_count    == b->span_cache_hit_count);
+}
+
+/**
+ * Counters are set for each kind of fitting, reset by the caller & added to between calls.
+ */
+static void test_stats_collect(const FitInput *in, const uint fit_type, const uint calc_flag)
+{
+	struct CurveFitContext *ctx = curve_fit_context_create();
+	struct CurveFitStats stats_first = {0};
+	curve_fit_context_stats_set(ctx, &stats_first);
+	fit_call(in, fit_type, calc_flag, ctx);
+
+	TEST_CHECK(stats_first.fit_count != 0);
+	TEST_CHECK(stats_first.reparameterize_count != 0);
+	TEST_CHECK(stats_first.alloc_bytes != 0);
+	if (fit_type == FIT_CUBIC) {
+		TEST_CHECK(stats_first.fit_stack_max != 0);
+		TEST_CHECK(stats_first.fit_single_count == 0);
+		TEST_CHECK(stats_first.heap_insert_count == 0);
+		TEST_CHECK(stats_first.heap_pop_count == 0);
+	}
+	else {
+		TEST_CHECK(stats_first.fit_single_count == stats_first.fit_count);
+		TEST_CHECK(stats_first.heap_insert_count != 0);
+		TEST_CHECK(stats_first.heap_update_count != 0);
+		TEST_CHECK(stats_first.heap_remove_count != 0);
+		TEST_CHECK(stats_first.heap_pop_count != 0);
+		TEST_CHECK(stats_first.span_cache_hit_count != 0);
+	}
+
+	/* Reset by the caller, the same as the first call
+	 * (except for memory which the context has already allocated). */
+	struct CurveFitStats stats = {0};
+	curve_fit_context_stats_set(ctx, &stats);
+	fit_call(in, fit_type, calc_flag, ctx);
+	test_stats_compare(&stats, &stats_first);
+	TEST_CHECK(stats.alloc_bytes != 0);
+	TEST_CHECK(stats.alloc_bytes < stats_first.alloc_bytes);
+
+	/* Without resetting, counters are added to (the largest value is kept for the maximum). */
+	const struct CurveFitStats stats_second = stats;
+	fit_call(in, fit_type, calc_flag, ctx);
+	TEST_CHECK(stats.fit_count            == stats_second.fit_count * 2);
+	TEST_CHECK(stats.fit_stack_max        == stats_second.fit_stack_max);
+	TEST_CHECK(stats.reparameterize_count == stats_second.reparameterize_count * 2);
+	TEST_CHECK(stats.fit_single_count     == stats_second.fit_single_count * 2);
+	TEST_CHECK(stats.heap_insert_count    == stats_second.heap_insert_count * 2);
+	TEST_CHECK(stats.heap_pop_count       == stats_second.heap_pop_count * 2);
+	TEST_CHECK(stats.span_cache_hit_count == stats_second.span_cache_hit_count * 2);
+	TEST_CHECK(stats.alloc_bytes          == stats_second.alloc_bytes * 2);
+
+	/* No longer collected. */
+	const struct CurveFitStats stats_third = stats;
+	curve_fit_context_stats_set(ctx, NULL);
+	fit_call(in, fit_type, calc_flag, ctx);
+	TEST_CHECK(memcmp(&stats, &stats_third, sizeof(stats)) == 0);
+
+	curve_fit_context_free(ctx);
+}
+
+/**
+ * Statistics from each thread add up to the same values as calculating on a single thread.
+ */
+static void test_stats_parallel(const FitInput *in, const uint fit_type, const uint calc_flag)
+{
+	struct CurveFitStats stats = {0};
+	struct CurveFitStats stats_parallel = {0};
+	struct CurveFitContext *ctx = curve_fit_context_create();
+
+	curve_fit_context_stats_set(ctx, &stats);
+	fit_call(in, fit_type, calc_flag, ctx);
+	curve_fit_context_stats_set(ctx, &stats_parallel);
+	fit_call(in, fit_type, calc_flag | CURVE_FIT_CALC_PARALLEL, ctx);
+
+	if (fit_type == FIT_CUBIC) {
+		TEST_CHECK(stats_parallel.fit_count               == stats.fit_count);
+		TEST_CHECK(stats_parallel.reparameterize_count    == stats.reparameterize_count);
+		TEST_CHECK(stats_parallel.fallback_circular_count == stats.fallback_circular_count);
+		TEST_CHECK(stats_parallel.fallback_offset_count   == stats.fallback_offset_count);
+		/* Calculated for each thread. */
+		TEST_CHECK(stats_parallel.fit_stack_max           <= stats.fit_stack_max);
+		TEST_CHECK(stats_parallel.fit_stack_max           != 0);
+	}
+	else {
+		/* Spans cached on one thread may be calculated by another,
+		 * so only the total number of spans is the same. */
+		TEST_CHECK(stats_parallel.fit_single_count + stats_parallel.span_cache_hit_count ==
+		           stats.fit_single_count + stats.span_cache_hit_count);
+		TEST_CHECK(stats_parallel.heap_insert_count == stats.heap_insert_count);
+		TEST_CHECK(stats_parallel.heap_update_count == stats.heap_update_count);
+		TEST_CHECK(stats_parallel.heap_remove_count == stats.heap_remove_count);
+		TEST_CHECK(stats_parallel.heap_pop_count    == stats.heap_pop_count);
+	}
+	TEST_CHECK(stats_parallel.alloc_bytes != 0);
+
+	curve_fit_context_free(ctx);
+}
+
+int main(void)
+{
+	FitInput in = {0};
+	/* Enough points for the refit functions to use multiple threads. */
+	in.points_len = 5000;
+	in.dims = 2;
+	in.points = test_points_generate(in.points_len, in.dims, 0);
+
+	TEST_CHECK(curve_fit_corners_detect_db(
+	        in.points, in.points_len, in.dims, 0.001, 0.05, 16, M_PI / 4,
+	        &in.corners, &in.corners_len,
+	        NULL) == 0);
+	TEST_CHECK(in.corners_len > 2);
+
+	const uint calc_flags[] = {0, CURVE_FIT_CALC_REFIT_ROUNDS};
+	for (uint fit_type = FIT_CUBIC; fit_type <= FIT_REFIT; fit_type++) {
+		for (uint i = 0; i < ARRAY_SIZE(calc_flags); i++) {
+			test_stats_collect(&in, fit_type, calc_flags[i]);
+			test_stats_parallel(&in, fit_type, calc_flags[i]);
+		}
+	}
+
+	free(in.corners);
+	free(in.points);
+
+	return test_result("stats");
+}
@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2016, Campbell Barton.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** \file curve_fit_test_stream.c
+ *  \ingroup curve_fit
+ *
+ * Test the streaming API (#curve_fit_stream_begin_db & related functions).
+ */
+
+#ifdef _MSC_VER
+#  define _USE_MATH_DEFINES
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "curve_fit_nd.h"
+
+#include "curve_fit_test_utils.h"
+
+/* Allow for minor discrepancy measuring the error. */
+#define ERROR_MARGIN 1.01
+
+/* -------------------------------------------------------------------- */
+
+/** \name Utilities
+ * \{ */
+
+/**
+ * Check the result is within the error threshold & starts and ends at the first & last points.
+ */
+static void test_curve_check(
+        const double *points, const uint points_len, const uint dims, const double error_threshold,
+        const double *cubic_array, const uint cubic_array_len, const uint *cubic_orig_index)
+{
+	TEST_CHECK(cubic_array_len >= 2);
+	if (cubic_array_len < 2) {
+		return;
+	}
+	TEST_CHECK(cubic_orig_index[0] == 0);
+	TEST_CHECK(cubic_orig_index[cubic_array_len - 1] == points_len - 1);
+	for (uint i = 1; i < cubic_array_len; i++) {
+		TEST_CHECK(cubic_orig_index[i - 1] < cubic_orig_index[i]);
+	}
+	TEST_CHECK(memcmp(&cubic_array[1 * dims], &points[0], sizeof(double) * dims) == 0);
+	TEST_CHECK(memcmp(
+	        &cubic_array[(((cubic_array_len - 1) * 3) + 1) * dims],
+	        &points[(points_len - 1) * dims], sizeof(double) * dims) == 0);
+
+	const double error = test_curve_error_max(
+	        points, points_len, dims, cubic_array, cubic_array_len, cubic_orig_index, false);
+	TEST_CHECK(error < error_threshold * ERROR_MARGIN);
+}
+
+/** \} */
+
+
+/* -------------------------------------------------------------------- */
+
+/** \name Tests
+ * \{ */
+
+/**
+ * Committed cubics don't change as points are added & the result is within the error threshold.
+ */
+static void test_stream_stable(const double *points, const uint points_len, const uint dims)
+{
+	const double error_threshold = 0.01;
+	struct CurveFitStream *stream = curve_fit_stream_begin_db(dims, error_threshold, 0);
+
+	/* The previous stable cubics (the last handle may change). */
+	double *stable_prev = malloc(sizeof(double) * points_len * 3 * dims);
+	uint stable_prev_len = 0;
+	uint stable_prev_change_count = 0;
+
+	/* Add points in differently sized chunks. */
+	for (uint i = 0, step = 1; i < points_len; i += step, step = (step % 7) + 1) {
+		const uint step_clamp = (i + step <= points_len) ? step : points_len - i;
+		curve_fit_stream_append_db(stream, &points[i * dims], step_clamp);
+
+		const double *stable;
+		uint stable_len;
+		curve_fit_stream_stable_db(stream, &stable, &stable_len);
+
+		TEST_CHECK(stable_len >= stable_prev_len);
+		TEST_CHECK(stable_len <= i + step_clamp);
+		if (stable_prev_len != 0) {
+			TEST_CHECK(memcmp(stable, stable_prev, sizeof(double) * ((stable_prev_len * 3) - 1) * dims) == 0);
+		}
+		if (stable_len != stable_prev_len) {
+			stable_prev_change_count += 1;
+		}
+		if (stable_len != 0) {
+			memcpy(stable_prev, stable, sizeof(double) * stable_len * 3 * dims);
+		}
+		stable_prev_len = stable_len;
+	}
+
+	/* Ensure cubics were committed while adding points (otherwise this test doesn't do much). */
+	TEST_CHECK(stable_prev_change_count > 2);
+
+	double *cubic_array;
+	uint cubic_array_len;
+	uint *cubic_orig_index;
+	TEST_CHECK(curve_fit_stream_finish_db(stream, &cubic_array, &cubic_array_len, &cubic_orig_index) == 0);
+
+	/* The committed cubics start the result. */
+	TEST_CHECK(cubic_array_len >= stable_prev_len);
+	if (stable_prev_len != 0) {
+		TEST_CHECK(memcmp(cubic_array, stable_prev, sizeof(double) * ((stable_prev_len * 3) - 1) * dims) == 0);
+	}
+
+	test_curve_check(
+	        points, points_len, dims, error_threshold,
+	        cubic_array, cubic_array_len, cubic_orig_index);
+
+	/* The result of fitting all points at once is also within the threshold. */
+	double *cubic_array_all;
+	uint cubic_array_all_len;
+	uint *cubic_orig_index_all;
+	TEST_CHECK(curve_fit_cubic_to_points_db(
+	        points, points_len, dims, error_threshold, 0, NULL, 0,
+	        &cubic_array_all, &cubic_array_all_len, &cubic_orig_index_all,
+	        NULL, NULL, NULL) == 0);
+	test_curve_check(
+	        points, points_len, dims, error_threshold,
+	        cubic_array_all, cubic_array_all_len, cubic_orig_index_all);
+
+	/* Committing cubics early may give more cubics, but not many more. */
+	TEST_CHECK(cubic_array_len >= 2);
+	TEST_CHECK(cubic_array_len <= cubic_array_all_len * 2);
+
+	free(cubic_array_all);
+	free(cubic_orig_index_all);
+	free(cubic_array);
+	free(cubic_orig_index);
+	free(stable_prev);
+}
+
+/**
+ * Smooth strokes which don't need to be split are still committed while adding points,
+ * so the number of points re-fitted each time doesn't increase with the length of the stroke.
+ */
+static void test_stream_smooth(const uint dims, const bool is_arc)
+{
+	const uint points_len = 20000;
+	const double error_threshold = 0.01;
+	/* Much larger than the number of points the stream keeps, small compared to `points_len`. */
+	const uint points_uncommitted_max = 4096;
+
+	double *points = malloc(sizeof(double) * points_len * dims);
+	for (uint i = 0; i < points_len; i++) {
+		const double t = (double)i / (double)(points_len - 1);
+		double *pt = &points[i * dims];
+		for (uint j = 0; j < dims; j++) {
+			pt[j] = 0.0;
+		}
+		if (is_arc) {
+			/* A quarter of a circle with a radius of 100. */
+			pt[0] = cos(t * (M_PI / 2)) * 100.0;
+			pt[1] = sin(t * (M_PI / 2)) * 100.0;
+		}
+		else {
+			pt[0] = t * 100.0;
+			pt[1] = t * 50.0;
+		}
+	}
+
+	struct CurveFitStream *stream = curve_fit_stream_begin_db(dims, error_threshold, 0);
+	uint stable_prev_len = 0;
+	uint stable_prev_index = 0;
+	uint stable_change_count = 0;
+
+	for (uint i = 0; i < points_len; i += 4) {
+		curve_fit_stream_append_db(stream, &points[i * dims], 4);
+
+		const double *stable;
+		uint stable_len;
+		curve_fit_stream_stable_db(stream, &stable, &stable_len);
+		TEST_CHECK(stable_len >= stable_prev_len);
+		if (stable_len != stable_prev_len) {
+			stable_change_count += 1;
+			stable_prev_len = stable_len;
+			stable_prev_index = i;
+		}
+		TEST_CHECK((i + 4) - stable_prev_index <= points_uncommitted_max);
+	}
+
+	TEST_CHECK(stable_change_count >= points_len / points_uncommitted_max);
+
+	double *cubic_array;
+	uint cubic_array_len;
+	uint *cubic_orig_index;
+	TEST_CHECK(curve_fit_stream_finish_db(stream, &cubic_array, &cubic_array_len, &cubic_orig_index) == 0);
+	test_curve_check(
+	        points, points_len, dims, error_threshold,
+	        cubic_array, cubic_array_len, cubic_orig_index);
+
+	free(cubic_array);
+	free(cubic_orig_index);
+	free(points);
+}
+
+/**
+ * Streams with too few points to fit a curve to.
+ */
+static void test_stream_few_points(const double *points, const uint dims)
+{
+	for (uint points_len = 0; points_len <= 2; points_len++) {
+		struct CurveFitStream *stream = curve_fit_stream_begin_db(dims, 0.01, 0);
+		if (points_len != 0) {
+			curve_fit_stream_append_db(stream, points, points_len);
+		}
+
+		const double *stable;
+		uint stable_len;
+		curve_fit_stream_stable_db(stream, &stable, &stable_len);
+		TEST_CHECK(stable_len == 0);
+
+		double *cubic_array;
+		uint cubic_array_len;
+		uint *cubic_orig_index;
+		TEST_CHECK(curve_fit_stream_finish_db(stream, &cubic_array, &cubic_array_len, &cubic_orig_index) == 0);
+
+		if (points_len == 0) {
+			TEST_CHECK(cubic_array_len == 0);
+		}
+		else {
+			/* A single cubic (the points of the first & last knot are the same for a single point). */
+			TEST_CHECK(cubic_array_len == 2);
+			if (cubic_array_len == 2) {
+				TEST_CHECK(cubic_orig_index[0] == 0);
+				TEST_CHECK(cubic_orig_index[1] == points_len - 1);
+				TEST_CHECK(memcmp(&cubic_array[1 * dims], &points[0], sizeof(double) * dims) == 0);
+				TEST_CHECK(memcmp(&cubic_array[4 * dims], &points[(points_len - 1) * dims], sizeof(double) * dims) == 0);
+			}
+		}
+		free(cubic_array);
+		free(cubic_orig_index);
+	}
+
+	/* Freeing the stream without a result. */
+	{
+		struct CurveFitStream *stream = curve_fit_stream_begin_db(dims, 0.01, 0);
+		curve_fit_stream_append_db(stream, points, 2);
+		TEST_CHECK(curve_fit_stream_finish_db(stream, NULL, NULL, NULL) == 0);
+	}
+}
+
+/**
+ * Single precision streams give a similar result.
+ */
+static void test_stream_float(const double *points, const uint points_len, const uint dims)
+{
+	const double error_threshold = 0.01;
+	float *points_fl = malloc(sizeof(float) * points_len * dims);
+	for (uint i = 0; i < points_len * dims; i++) {
+		points_fl[i] = (float)points[i];
+	}
+
+	struct CurveFitStream *stream = curve_fit_stream_begin_fl(dims, (float)error_threshold, 0);
+	for (uint i = 0; i < points_len; i++) {
+		curve_fit_stream_append_fl(stream, &points_fl[i * dims], 1);
+	}
+
+	float *cubic_array_fl;
+	uint cubic_array_len;
+	uint *cubic_orig_index;
+	TEST_CHECK(curve_fit_stream_finish_fl(stream, &cubic_array_fl, &cubic_array_len, &cubic_orig_index) == 0);
+
+	/* Measure using the single precision points. */
+	double *points_db = malloc(sizeof(double) * points_len * dims);
+	for (uint i = 0; i < points_len * dims; i++) {
+		points_db[i] = (double)points_fl[i];
+	}
+	double *cubic_array = malloc(sizeof(double) * cubic_array_len * 3 * dims);
+	for (uint i = 0; i < cubic_array_len * 3 * dims; i++) {
+		cubic_array[i] = (double)cubic_array_fl[i];
+	}
+	test_curve_check(
+	        points_db, points_len, dims, error_threshold,
+	        cubic_array, cubic_array_len, cubic_orig_index);
+
+	free(cubic_array);
+	free(points_db);
+	free(cubic_array_fl);
+	free(cubic_orig_index);
+	free(points_fl);
+}
+
+/** \} */
+
+
+int main(void)
+{
+	const uint points_len = 2000;
+
+	for (uint dims = 2; dims <= 3; dims++) {
+		double *points = test_points_generate(points_len, dims, dims);
+		test_stream_stable(points, points_len, dims);
+		test_stream_few_points(points, dims);
+		test_stream_float(points, points_len, dims);
+		free(points);
+
+		test_stream_smooth(dims, false);
+		test_stream_smooth(dims, true);
+	}
+
+	return test_result("stream");
+}
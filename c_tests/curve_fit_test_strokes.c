@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2016, Campbell Barton.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** \file curve_fit_test_strokes.c
+ *  \ingroup curve_fit
+ *
+ * Test the freehand strokes in `tests/data` are fitted within the error threshold,
+ * for calculation flags which change how the curve is fitted.
+ *
+ * Also check #CURVE_FIT_CALC_PARALLEL doesn't change the result.
+ */
+
+#ifdef _MSC_VER
+#  define _USE_MATH_DEFINES
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "curve_fit_nd.h"
+
+#include "curve_fit_test_utils.h"
+
+/* Allow for minor discrepancy measuring the error. */
+#define ERROR_MARGIN 1.01
+
+enum {
+	FIT_CUBIC = 0,
+	FIT_REFIT = 1,
+};
+
+typedef struct TestStroke {
+	/** The name of the file in `tests/data` (generated when NULL). */
+	const char *name;
+	/** The number of points to generate (when there is no file). */
+	uint points_len;
+	double error_threshold;
+	double corner_angle;
+	bool is_cyclic;
+} TestStroke;
+
+typedef struct TestFlags {
+	uint fit_type;
+	uint calc_flag;
+} TestFlags;
+
+static double *test_stroke_points(const TestStroke *stroke, uint *r_points_len, uint *r_dims)
+{
+	if (stroke->name) {
+		return test_points_load(stroke->name, r_points_len, r_dims);
+	}
+	*r_points_len = stroke->points_len;
+	*r_dims = 2;
+	return test_points_generate(stroke->points_len, 2, 0);
+}
+
+static void test_stroke(const TestStroke *stroke, const TestFlags *test_flags)
+{
+	uint points_len, dims;
+	double *points = test_stroke_points(stroke, &points_len, &dims);
+	TEST_CHECK(points != NULL);
+	if (points == NULL) {
+		return;
+	}
+
+	/* Fitting doesn't support cyclic curves. */
+	const bool is_cyclic = stroke->is_cyclic && (test_flags->fit_type == FIT_REFIT);
+	const uint calc_flag = test_flags->calc_flag | (is_cyclic ? CURVE_FIT_CALC_CYCLIC : 0);
+
+	double *cubic_array;
+	uint *cubic_orig_index, *corner_index_array = NULL;
+	uint cubic_array_len, corner_index_len = 0;
+	int ret;
+	if (test_flags->fit_type == FIT_CUBIC) {
+		ret = curve_fit_cubic_to_points_db(
+		        points, points_len, dims, stroke->error_threshold, calc_flag, NULL, 0,
+		        &cubic_array, &cubic_array_len,
+		        &cubic_orig_index,
+		        NULL, NULL,
+		        NULL);
+	}
+	else {
+		ret = curve_fit_cubic_to_points_refit_db(
+		        points, points_len, dims, stroke->error_threshold, calc_flag, NULL, 0, stroke->corner_angle,
+		        &cubic_array, &cubic_array_len,
+		        &cubic_orig_index,
+		        &corner_index_array, &corner_index_len,
+		        NULL);
+	}
+	TEST_CHECK(ret == 0);
+	TEST_CHECK(cubic_array_len >= 2);
+
+	const double error = test_curve_error_max(
+	        points, points_len, dims, cubic_array, cubic_array_len, cubic_orig_index, is_cyclic);
+	printf("%s (%s, flag=0x%x): %u knots, error %.6f (threshold %.6f)\n",
+	       stroke->name ? stroke->name : "generated", (test_flags->fit_type == FIT_CUBIC) ? "fit" : "refit", calc_flag,
+	       cubic_array_len, error, stroke->error_threshold);
+	TEST_CHECK(error < stroke->error_threshold * ERROR_MARGIN);
+
+	free(cubic_array);
+	free(cubic_orig_index);
+	free(corner_index_array);
+	free(points);
+}
+
+/**
+ * A smooth, slightly noisy wave, fitted with long spans which are split as tasks.
+ */
+static double *test_points_wave(const uint points_len)
+{
+	const double step = 0.00005;
+	const double noise = 0.0005;
+
+	double *points = malloc(sizeof(double) * 2 * points_len);
+	uint rng = 1;
+	for (uint i = 0; i < points_len; i++) {
+		double t[2];
+		for (uint j = 0; j < 2; j++) {
+			/* Repeatable noise, in the [-0.5, 0.5) range. */
+			rng = (rng * 1103515245u) + 12345u;
+			t[j] = ((double)((rng >> 8) & 0xffff) / 65536.0) - 0.5;
+		}
+		points[(i * 2) + 0] = ((double)i * step) + (t[0] * noise);
+		points[(i * 2) + 1] = sin((double)i * step) + (t[1] * noise);
+	}
+	return points;
+}
+
+/**
+ * #CURVE_FIT_CALC_PARALLEL gives the same result as the single threaded code.
+ */
+static void test_stroke_parallel(
+        const double *points, const uint points_len, const uint dims, const double error_threshold,
+        const uint calc_flag)
+{
+	double *cubic_array[2];
+	uint *cubic_orig_index[2];
+	uint cubic_array_len[2];
+	for (uint i = 0; i < 2; i++) {
+		TEST_CHECK(curve_fit_cubic_to_points_db(
+		        points, points_len, dims, error_threshold,
+		        calc_flag | (i ? CURVE_FIT_CALC_PARALLEL : 0), NULL, 0,
+		        &cubic_array[i], &cubic_array_len[i],
+		        &cubic_orig_index[i],
+		        NULL, NULL,
+		        NULL) == 0);
+	}
+
+	TEST_CHECK(cubic_array_len[0] == cubic_array_len[1]);
+	if (cubic_array_len[0] == cubic_array_len[1]) {
+		TEST_CHECK(memcmp(
+		        cubic_array[0], cubic_array[1],
+		        sizeof(double) * cubic_array_len[0] * 3 * dims) == 0);
+		TEST_CHECK(memcmp(
+		        cubic_orig_index[0], cubic_orig_index[1],
+		        sizeof(uint) * cubic_array_len[0]) == 0);
+	}
+
+	for (uint i = 0; i < 2; i++) {
+		free(cubic_array[i]);
+		free(cubic_orig_index[i]);
+	}
+}
+
+int main(void)
+{
+	const TestStroke strokes[] = {
+		/* Matches the values used by `tests/tests.py`. */
+		{"test_curve_freehand_01", 0, 0.01, M_PI, false},
+		{"test_curve_freehand_02", 0, 0.01, M_PI, false},
+		{"test_curve_freehand_03", 0, 0.01, 30.0 * (M_PI / 180.0), false},
+		{"test_curve_freehand_04_cyclic", 0, 0.0075, 70.0 * (M_PI / 180.0), true},
+		/* Long enough for #CURVE_FIT_CALC_MULTIRES to fit lower resolution points. */
+		{NULL, 20000, 0.001, M_PI, false},
+	};
+
+	const TestFlags test_flags[] = {
+		{FIT_CUBIC, 0},
+		{FIT_CUBIC, CURVE_FIT_CALC_MULTIRES},
+		{FIT_CUBIC, CURVE_FIT_CALC_MULTIRES | CURVE_FIT_CALC_PARALLEL},
+		{FIT_CUBIC, CURVE_FIT_CALC_FAST},
+		{FIT_REFIT, 0},
+		{FIT_REFIT, CURVE_FIT_CALC_REFIT_ROUNDS},
+		{FIT_REFIT, CURVE_FIT_CALC_REFIT_ROUNDS | CURVE_FIT_CALC_PARALLEL},
+	};
+
+	for (uint i = 0; i < ARRAY_SIZE(strokes); i++) {
+		for (uint j = 0; j < ARRAY_SIZE(test_flags); j++) {
+			test_stroke(&strokes[i], &test_flags[j]);
+		}
+	}
+
+	for (uint i = 0; i < ARRAY_SIZE(strokes); i++) {
+		uint points_len, dims;
+		double *points = test_stroke_points(&strokes[i], &points_len, &dims);
+		TEST_CHECK(points != NULL);
+		if (points != NULL) {
+			test_stroke_parallel(points, points_len, dims, strokes[i].error_threshold, 0);
+			test_stroke_parallel(points, points_len, dims, strokes[i].error_threshold, CURVE_FIT_CALC_MULTIRES);
+			free(points);
+		}
+	}
+
+	{
+		const uint points_len = 100000;
+		double *points = test_points_wave(points_len);
+		test_stroke_parallel(points, points_len, 2, 0.001, 0);
+		test_stroke_parallel(points, points_len, 2, 0.001, CURVE_FIT_CALC_MULTIRES);
+		free(points);
+	}
+
+	return test_result("strokes");
+}
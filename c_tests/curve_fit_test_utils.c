@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) 2016, Campbell Barton.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** \file curve_fit_test_utils.c
+ *  \ingroup curve_fit
+ */
+
+#ifdef _MSC_VER
+#  define _USE_MATH_DEFINES
+#endif
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "curve_fit_test_utils.h"
+
+#ifndef CURVE_FIT_TEST_DATA_DIR
+#  define CURVE_FIT_TEST_DATA_DIR "tests/data"
+#endif
+
+/* -------------------------------------------------------------------- */
+
+/** \name Checks
+ * \{ */
+
+static uint test_check_count = 0;
+static uint test_check_fail_count = 0;
+
+bool test_check(const bool success, const char *expr_str, const char *file, const int line)
+{
+	test_check_count += 1;
+	if (success == false) {
+		test_check_fail_count += 1;
+		fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr_str);
+	}
+	return success;
+}
+
+int test_result(const char *name)
+{
+	printf("%s: %u checks, %u failed\n", name, test_check_count, test_check_fail_count);
+	return (test_check_fail_count == 0) ? 0 : 1;
+}
+
+/** \} */
+
+
+/* -------------------------------------------------------------------- */
+
+/** \name Input Points
+ * \{ */
+
+static double rng_get_double(uint *rng)
+{
+	/* xorshift32 */
+	uint x = *rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*rng = x;
+	return (double)x / 4294967295.0;
+}
+
+double *test_points_generate(const uint points_len, const uint dims, const uint seed)
+{
+	const double step = 0.02;
+	const double noise = 0.0005;
+
+	double *points = malloc(sizeof(double) * dims * points_len);
+	uint rng = 0x2545f491 ^ (seed * 31);
+
+	double co[2] = {0.0, 0.0};
+	double angle = 0.0;
+	double angle_velocity = 0.0;
+
+	for (uint i = 0; i < points_len; i++) {
+		double *p = &points[i * dims];
+
+		angle_velocity = (angle_velocity * 0.98) + ((rng_get_double(&rng) - 0.5) * 0.05);
+		angle += angle_velocity;
+		if (rng_get_double(&rng) < (1.0 / 100.0)) {
+			/* A corner, between 60 & 150 degrees. */
+			angle += ((rng_get_double(&rng) < 0.5) ? -1.0 : 1.0) * (M_PI / 3.0) * (1.0 + (rng_get_double(&rng) * 1.5));
+		}
+		co[0] += cos(angle) * step;
+		co[1] += sin(angle) * step;
+
+		p[0] = co[0] + ((rng_get_double(&rng) - 0.5) * noise);
+		p[1] = co[1] + ((rng_get_double(&rng) - 0.5) * noise);
+		for (uint j = 2; j < dims; j++) {
+			p[j] = 0.5 + (0.5 * sin((double)i * step * (double)j));
+		}
+	}
+
+	return points;
+}
+
+/**
+ * Test data files are Python modules with a tuple of points: `data = ((x, y), ...)`.
+ */
+double *test_points_load(const char *name, uint *r_points_len, uint *r_dims)
+{
+	char filepath[1024];
+	snprintf(filepath, sizeof(filepath), "%s/%s.py", CURVE_FIT_TEST_DATA_DIR, name);
+
+	FILE *fp = fopen(filepath, "rb");
+	if (fp == NULL) {
+		fprintf(stderr, "%s: can't be opened\n", filepath);
+		return NULL;
+	}
+	fseek(fp, 0, SEEK_END);
+	const long text_len = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	char *text = malloc((size_t)text_len + 1);
+	const size_t text_read = fread(text, 1, (size_t)text_len, fp);
+	text[text_read] = '\0';
+	fclose(fp);
+
+	uint dims = 0;
+	uint points_len = 0;
+	uint points_alloc = 1024;
+	double *points = NULL;
+
+	for (const char *c = strchr(text, '('); c; c = strchr(c + 1, '(')) {
+		/* Read a tuple of numbers (skipping the tuple containing them). */
+		double co[16];
+		uint co_len = 0;
+		const char *c_num = c + 1;
+		while (co_len < ARRAY_SIZE(co)) {
+			char *c_end;
+			co[co_len] = strtod(c_num, &c_end);
+			if (c_end == c_num) {
+				break;
+			}
+			co_len += 1;
+			c_num = c_end + strspn(c_end, " \t");
+			if (*c_num != ',') {
+				break;
+			}
+			c_num += 1;
+		}
+		if (co_len == 0) {
+			continue;
+		}
+
+		if (dims == 0) {
+			dims = co_len;
+			points = malloc(sizeof(double) * dims * points_alloc);
+		}
+		else if (co_len != dims) {
+			fprintf(stderr, "%s: mixed dimensions (%u, %u)\n", filepath, dims, co_len);
+			points_len = 0;
+			break;
+		}
+
+		if (points_len == points_alloc) {
+			points_alloc *= 2;
+			points = realloc(points, sizeof(double) * dims * points_alloc);
+		}
+		memcpy(&points[points_len * dims], co, sizeof(double) * dims);
+		points_len += 1;
+	}
+
+	free(text);
+
+	if (points_len == 0) {
+		free(points);
+		return NULL;
+	}
+
+	*r_points_len = points_len;
+	*r_dims = dims;
+	return points;
+}
+
+/** \} */
+
+
+/* -------------------------------------------------------------------- */
+
+/** \name Curve Error
+ * \{ */
+
+/** The number of steps to search each cubic for the closest position (before refining). */
+#define CUBIC_SEARCH_STEPS 64
+#define CUBIC_REFINE_STEPS 32
+
+static void cubic_calc_point(
+        const double *p0, const double *p1, const double *p2, const double *p3,
+        const double t, const uint dims, double *r_co)
+{
+	const double s = 1.0 - t;
+	for (uint j = 0; j < dims; j++) {
+		r_co[j] = (p0[j] * s * s * s) + (p1[j] * 3.0 * s * s * t) + (p2[j] * 3.0 * s * t * t) + (p3[j] * t * t * t);
+	}
+}
+
+static double cubic_calc_dist_squared(
+        const double *p0, const double *p1, const double *p2, const double *p3,
+        const double t, const double *co, const uint dims)
+{
+	double co_cubic[16];
+	assert(dims <= ARRAY_SIZE(co_cubic));
+	cubic_calc_point(p0, p1, p2, p3, t, dims, co_cubic);
+	double dist_sq = 0.0;
+	for (uint j = 0; j < dims; j++) {
+		const double d = co_cubic[j] - co[j];
+		dist_sq += d * d;
+	}
+	return dist_sq;
+}
+
+/**
+ * \return The squared distance from \a co to the closest position on the cubic.
+ */
+static double cubic_calc_closest_dist_squared(
+        const double *p0, const double *p1, const double *p2, const double *p3,
+        const double *co, const uint dims)
+{
+	double t_best = 0.0;
+	double dist_best_sq = cubic_calc_dist_squared(p0, p1, p2, p3, 0.0, co, dims);
+	for (uint i = 1; i <= CUBIC_SEARCH_STEPS; i++) {
+		const double t = (double)i / (double)CUBIC_SEARCH_STEPS;
+		const double dist_sq = cubic_calc_dist_squared(p0, p1, p2, p3, t, co, dims);
+		if (dist_sq < dist_best_sq) {
+			dist_best_sq = dist_sq;
+			t_best = t;
+		}
+	}
+
+	/* Refine, stepping both ways from the closest position. */
+	double t_step = 0.5 / (double)CUBIC_SEARCH_STEPS;
+	for (uint i = 0; i < CUBIC_REFINE_STEPS; i++) {
+		for (int side = -1; side <= 1; side += 2) {
+			const double t = t_best + (t_step * side);
+			if (t >= 0.0 && t <= 1.0) {
+				const double dist_sq = cubic_calc_dist_squared(p0, p1, p2, p3, t, co, dims);
+				if (dist_sq < dist_best_sq) {
+					dist_best_sq = dist_sq;
+					t_best = t;
+				}
+			}
+		}
+		t_step *= 0.5;
+	}
+	return dist_best_sq;
+}
+
+double test_curve_error_max(
+        const double *points, const uint points_len, const uint dims,
+        const double *cubic_array, const uint cubic_array_len,
+        const uint *cubic_orig_index,
+        const bool is_cyclic)
+{
+	const uint cubic_len = is_cyclic ? cubic_array_len : cubic_array_len - 1;
+	double error_max_sq = 0.0;
+	for (uint k = 0; k < cubic_len; k++) {
+		const uint k_next = (k + 1) % cubic_array_len;
+		const double *p0 = &cubic_array[((k * 3) + 1) * dims];
+		const double *p1 = &cubic_array[((k * 3) + 2) * dims];
+		const double *p2 = &cubic_array[((k_next * 3) + 0) * dims];
+		const double *p3 = &cubic_array[((k_next * 3) + 1) * dims];
+
+		/* Wrap around for the last span of cyclic curves. */
+		const uint i_first = cubic_orig_index[k];
+		const uint i_last = cubic_orig_index[k_next] + ((cubic_orig_index[k_next] < i_first) ? points_len : 0);
+		for (uint i = i_first; i <= i_last; i++) {
+			const double dist_sq = cubic_calc_closest_dist_squared(
+			        p0, p1, p2, p3, &points[(i % points_len) * dims], dims);
+			if (dist_sq > error_max_sq) {
+				error_max_sq = dist_sq;
+			}
+		}
+	}
+	return sqrt(error_max_sq);
+}
+
+/** \} */
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2016, Campbell Barton.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __CURVE_FIT_TEST_UTILS_H__
+#define __CURVE_FIT_TEST_UTILS_H__
+
+/** \file curve_fit_test_utils.h
+ *  \ingroup curve_fit
+ *
+ * Utilities shared by the tests for the C API.
+ */
+
+#include <stdbool.h>
+
+typedef unsigned int uint;
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof(*(arr)))
+
+/**
+ * Check \a expr is true, otherwise report the failure (the test continues).
+ */
+#define TEST_CHECK(expr) \
+	test_check((expr) ? true : false, #expr, __FILE__, __LINE__)
+
+bool test_check(const bool success, const char *expr_str, const char *file, const int line);
+
+/**
+ * \return The exit code for the test (nonzero when any checks failed).
+ */
+int test_result(const char *name);
+
+/**
+ * Generate a stroke similar to freehand input (evenly spaced points with a wandering direction),
+ * the result is the same for each \a seed.
+ */
+double *test_points_generate(const uint points_len, const uint dims, const uint seed);
+
+/**
+ * Load a stroke from `tests/data` (by name, without the extension).
+ *
+ * \return The points or NULL when the file can't be read.
+ */
+double *test_points_load(const char *name, uint *r_points_len, uint *r_dims);
+
+/**
+ * \return The largest distance from \a points to the curve,
+ * each point is measured against the cubic which spans it (using \a cubic_orig_index).
+ *
+ * \param cubic_array, cubic_array_len, cubic_orig_index: As returned by #curve_fit_cubic_to_points_db.
+ */
+double test_curve_error_max(
+        const double *points, const uint points_len, const uint dims,
+        const double *cubic_array, const uint cubic_array_len,
+        const uint *cubic_orig_index,
+        const bool is_cyclic);
+
+#endif  /* __CURVE_FIT_TEST_UTILS_H__ */